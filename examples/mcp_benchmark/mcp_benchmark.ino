@@ -0,0 +1,87 @@
+/*
+  Papilio Arcade - MCP Benchmark Firmware
+  =======================================
+
+  PapilioMCP.h with the instrumentation (Z command) built in, for measuring
+  the serial/Wishbone path with the host script:
+
+    python server/mcp_benchmark.py --port COM4 --output bench.json
+
+  The script times every request from the host and reads the device-side
+  cycle counts with Z, so each result separates serial/USB overhead from
+  the time spent on the Wishbone bus.
+
+  Build variants to compare (build_flags or the defines below):
+    -DMCP_SPI_SPEED=20000000   SPI clock to the FPGA (reported in the JSON)
+    -DMCP_SPI_BURST=0          Single-byte bridge transactions
+    -DMCP_CALIBRATE_ID=0x8302  Calibrate the clock/read wait in begin()
+    -DBENCH_TASK_MODE=1        Service the commands from beginTask()
+    -DMCP_USB_DIRECT=1         Replies straight into the USB-Serial-JTAG FIFO
+    -DBENCH_SKETCH_LOAD=N      Sketch writes N LED registers per loop, so
+                               MCP traffic competes for the bus
+
+  BENCH_SCRATCH must be RAM in the gateware (framebuffer by default); the
+  script writes test patterns there. Each framebuffer pixel is a 4-byte
+  slot that keeps only lane 0, so BENCH_SCRATCH_LANES is 4 and the script
+  runs with --lanes 4. For byte-addressable RAM set both to 1; only then
+  is the 4-byte burst check (negotiateBurst) run against the scratch.
+*/
+
+#ifndef PAPILIO_MCP_ENABLED
+#define PAPILIO_MCP_ENABLED
+#endif
+#define MCP_ENABLE_STATS 1
+#ifndef MCP_ENABLE_TEXT
+#define MCP_ENABLE_TEXT  1   // For the text engine fill rate
+#endif
+
+#ifndef BENCH_TASK_MODE
+#define BENCH_TASK_MODE   0
+#endif
+#ifndef BENCH_SKETCH_LOAD
+#define BENCH_SKETCH_LOAD 0
+#endif
+#ifndef BENCH_SCRATCH
+#define BENCH_SCRATCH     0x1000
+#endif
+#ifndef BENCH_SCRATCH_LANES
+#define BENCH_SCRATCH_LANES 4
+#endif
+
+#include <PapilioMCP.h>
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n========================================");
+  Serial.println("  Papilio Arcade - MCP Benchmark Firmware");
+  Serial.println("========================================\n");
+
+#if BENCH_TASK_MODE
+  PapilioMCP.beginTask();
+#else
+  PapilioMCP.begin();
+#endif
+#if BENCH_SCRATCH_LANES == 1
+  PapilioMCP.negotiateBurst(BENCH_SCRATCH);
+#endif
+  PapilioMCP.resetStats();
+
+  Serial.printf("SPI %lu Hz, %s mode, sketch load %d writes/loop\n",
+                (unsigned long)MCP_SPI_SPEED, BENCH_TASK_MODE ? "task" : "update()",
+                BENCH_SKETCH_LOAD);
+  Serial.println("Run server/mcp_benchmark.py against this port.\n");
+}
+
+void loop() {
+  PapilioMCP.update();
+
+#if BENCH_SKETCH_LOAD
+  static uint8_t level = 0;
+  level++;
+  for (int i = 0; i < BENCH_SKETCH_LOAD; i++) {
+    PapilioMCP.wishboneWrite(0x8100 + i % 3, level);
+  }
+#endif
+}
@@ -7,6 +7,7 @@
   - Read/write Wishbone bus registers on the FPGA
   - Control RGB LED, video modes, text display
   - Program the FPGA via USB JTAG bridge
+  - Fill/blit the framebuffer with DMA while serial stays responsive
   
   Usage:
   1. Add this environment to platformio.ini or use the provided one
@@ -18,11 +19,16 @@
     H             - Help
     W AAAA DD     - Write DD to Wishbone address AAAA
     R AAAA        - Read from Wishbone address AAAA
-    M AAAA NN     - Read NN bytes starting at AAAA
+    M AAAA NN     - Read NN bytes starting at AAAA (NNNN allowed, max 256)
+    X AAAA LLLL   - Stream LLLL bytes from AAAA in numbered chunks + CRC
+    Q op;op;...   - Batch of Wishbone ops in one round trip (as PapilioMCP.h)
+    A AAAA MM VV [TTTTTTTT [IIII]] - Wait until (AAAA & MM) == VV, times in us
+    E S|F|R|I ... - Text engine, only changed cells are sent (as PapilioMCP.h)
     D             - Dump debug registers
     F CC          - Fill framebuffer with color CC
     P XXXX YYYY CC - Put pixel at (x,y) with color
-    S XX YY CC text - Draw text string
+    S XX YY CC[BB] text - Draw text string, foreground CC on background BB
+    B XX YY WW HH LLLL - Blit an RLE/delta-coded rectangle (LLLL raw bytes follow)
     T             - Draw test pattern
     J [1|0]       - Enable/disable JTAG bridge
     G             - GPIO loopback test
@@ -38,8 +44,11 @@
 #include <SPI.h>
 #include "soc/usb_serial_jtag_reg.h"
 #include "soc/gpio_sig_map.h"
+#include "soc/spi_periph.h"
 #include "esp_rom_gpio.h"
+#include "esp_heap_caps.h"
 #include "hal/usb_serial_jtag_ll.h"
+#include "driver/spi_master.h"
 
 // ============================================================================
 // Pin Configuration - Adjust for your board
@@ -68,6 +77,72 @@
 // SPI clock speed - 8MHz works well with the FPGA bridge
 #define SPI_SPEED 8000000
 
+// Wishbone bridge command byte (see PapilioMCP.h)
+#define WB_CMD_READ   0x00
+#define WB_CMD_WRITE  0x01
+#define WB_CMD_BURST  0x02  // Stream N data bytes after one header
+#define WB_CMD_FIXED  0x04  // With BURST: keep the address (FIFO port)
+
+// ASCII memory dumps
+#define M_MAX         256       // Bytes per M command line
+#define STREAM_CHUNK  64        // Bytes per X chunk line
+
+// Batch ops (same encoding as MCP_BATCH_* in PapilioMCP.h)
+#define BATCH_WRITE        0x01
+#define BATCH_WRITE_FIXED  0x02
+#define BATCH_READ         0x03
+#define BATCH_POLL         0x04
+#define BATCH_DELAY        0x05
+#define BATCH_FILL         0x06
+#define POLL_TIMEOUT_MS    100  // Q poll default when @TTTT is omitted
+#define AWAIT_TIMEOUT_US   1000000  // A command default timeout
+
+// Text screen: 80x26 cells behind the character port
+#define TEXT_COLS        80
+#define TEXT_ROWS        26
+#define TEXT_CURSOR_X    0x0021  // CURSOR_Y and ATTR follow at +1, +2
+#define TEXT_CHAR_PORT   0x0024  // Writes a char at the cursor and advances it
+#define TEXT_GAP         3       // Unchanged cells bridged rather than re-seeking
+
+// DMA engine - uses the otherwise idle FSPI host. SPIClass(HSPI) above is
+// SPI3 on the ESP32-S3; the two share the pins by swapping the GPIO matrix
+// output routing for the duration of a DMA job.
+#define DMA_HOST      SPI2_HOST
+#define ARDUINO_HOST  SPI3_HOST
+#define DMA_CHUNK     4092      // Bytes per queued transaction (x2 buffers)
+
+// Framebuffer: 160x120 pixels, one 4-byte Wishbone slot per pixel in a
+// 15-bit window. Bursts must not run past 0x7FFF into the register space.
+#define FB_WIDTH      160
+#define FB_HEIGHT     120
+#define FB_PIXELS     (FB_WIDTH * FB_HEIGHT)
+#define FB_WINDOW     0x8000
+
+// Blit stream (B command): one token byte, count = (token & 0x3F) + 1
+#define BLIT_LITERAL  0x00      // count colour bytes follow
+#define BLIT_RUN      0x40      // next byte repeated count times
+#define BLIT_SKIP     0x80      // leave count pixels unchanged
+#define BLIT_SKIP64   0xC0      // leave count * 64 pixels unchanged
+#define BLIT_TIMEOUT_MS 1000    // Idle time before a short stream is abandoned
+
+// Glyph cache: 5x7 font expanded to colour tiles, LRU replaced
+#define GLYPH_W       5
+#define GLYPH_H       7
+#define GLYPH_ADVANCE 6         // Glyph plus one background column
+#define GLYPH_SLOTS   32
+
+// Register map dumped by D. The host finds registers by name in the dump,
+// so a different gateware only needs its addresses changed here.
+struct RegRange {
+  const char* name;
+  uint16_t start;
+  uint16_t len;
+};
+constexpr RegRange registerMap[] = {
+  { "RGB_LED",    0x8100, 4 },
+  { "VIDEO_MODE", 0x8000, 1 },   // Just above the framebuffer window
+};
+
 // ============================================================================
 // Global State
 // ============================================================================
@@ -77,6 +152,18 @@ String mcpBuffer = "";
 bool usb_was_connected = false;
 bool jtag_enabled = false;
 
+// Device-side shadow of the text screen (E command)
+uint8_t textChar[TEXT_COLS * TEXT_ROWS];
+uint8_t textAttr[TEXT_COLS * TEXT_ROWS];
+uint8_t textKnown[(TEXT_COLS * TEXT_ROWS + 7) / 8];
+uint32_t textCells = 0;
+uint32_t textWritten = 0;
+uint32_t textRuns = 0;
+
+void textInvalidate() {
+  memset(textKnown, 0, sizeof(textKnown));
+}
+
 // ============================================================================
 // USB JTAG Bridge Functions
 // ============================================================================
@@ -128,6 +215,213 @@ void unroute_usb_jtag_to_gpio() {
   Serial.println("[JTAG] Bridge disabled");
 }
 
+// ============================================================================
+// DMA Transfer Engine
+// ============================================================================
+// Large transfers (fill, blit, bulk read) are streamed as one burst: a 3-byte
+// header followed by queued spi_master transactions that alternate between
+// two DMA buffers. loop() calls dmaService() to collect finished buffers and
+// queue the next ones, so serial commands keep being processed while the
+// bus runs. Anything else that touches SPI calls dmaWait() first.
+
+enum DmaOp : uint8_t { DMA_IDLE, DMA_FILL, DMA_WRITE, DMA_READ };
+
+// Produces len bytes of a DMA_WRITE stream starting at byte offset
+typedef void (*DmaGenerator)(uint8_t* buf, uint32_t offset, uint32_t len);
+
+struct DmaJob {
+  DmaOp op;
+  const char* label;      // Name in the completion line ("FILL", ...)
+  uint8_t value;          // DMA_FILL byte
+  const uint8_t* src;     // DMA_WRITE source (or nullptr to use gen)
+  DmaGenerator gen;       // DMA_WRITE generator
+  uint8_t* dst;           // DMA_READ destination
+  uint32_t total;         // Bytes in the job
+  uint32_t queued;        // Bytes handed to the driver
+  uint32_t done;          // Bytes completed
+  uint8_t inflight;       // Transactions queued but not collected
+  uint8_t next;           // Buffer for the next transaction
+  unsigned long startUs;
+  unsigned long elapsedUs;
+};
+
+spi_device_handle_t dmaDev = nullptr;
+uint8_t* dmaBuf[2] = { nullptr, nullptr };
+spi_transaction_t dmaTrans[2];
+DmaJob dmaJob = {};
+
+void dmaAttachPins() {
+  esp_rom_gpio_connect_out_signal(SPI_CLK,  spi_periph_signal[DMA_HOST].spiclk_out, false, false);
+  esp_rom_gpio_connect_out_signal(SPI_MOSI, spi_periph_signal[DMA_HOST].spid_out, false, false);
+}
+
+void dmaReleasePins() {
+  esp_rom_gpio_connect_out_signal(SPI_CLK,  spi_periph_signal[ARDUINO_HOST].spiclk_out, false, false);
+  esp_rom_gpio_connect_out_signal(SPI_MOSI, spi_periph_signal[ARDUINO_HOST].spid_out, false, false);
+}
+
+bool dmaBegin() {
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = SPI_MOSI;
+  bus.miso_io_num = SPI_MISO;
+  bus.sclk_io_num = SPI_CLK;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = DMA_CHUNK;
+  bus.flags = SPICOMMON_BUSFLAG_MASTER | SPICOMMON_BUSFLAG_GPIO_PINS;
+  if (spi_bus_initialize(DMA_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) return false;
+  
+  spi_device_interface_config_t dev = {};
+  dev.clock_speed_hz = SPI_SPEED;
+  dev.mode = 0;
+  dev.spics_io_num = -1;          // CS stays low across the whole burst
+  dev.queue_size = 2;
+  if (spi_bus_add_device(DMA_HOST, &dev, &dmaDev) != ESP_OK) return false;
+  
+  for (int i = 0; i < 2; i++) {
+    dmaBuf[i] = (uint8_t*)heap_caps_malloc(DMA_CHUNK, MALLOC_CAP_DMA);
+    if (!dmaBuf[i]) return false;
+  }
+  
+  // spi_bus_initialize routed CLK/MOSI to FSPI - hand them back
+  dmaReleasePins();
+  return true;
+}
+
+bool dmaBusy() {
+  return dmaJob.op != DMA_IDLE;
+}
+
+void dmaQueueNext() {
+  if (dmaJob.queued >= dmaJob.total) return;
+  uint8_t i = dmaJob.next;
+  uint32_t n = dmaJob.total - dmaJob.queued;
+  if (n > DMA_CHUNK) n = DMA_CHUNK;
+  
+  if (dmaJob.op == DMA_WRITE) {
+    if (dmaJob.src) memcpy(dmaBuf[i], dmaJob.src + dmaJob.queued, n);
+    else dmaJob.gen(dmaBuf[i], dmaJob.queued, n);
+  }
+  
+  spi_transaction_t* t = &dmaTrans[i];
+  memset(t, 0, sizeof(*t));
+  t->length = n * 8;
+  if (dmaJob.op == DMA_READ) {
+    t->rx_buffer = dmaBuf[i];
+    t->rxlength = n * 8;
+  } else {
+    t->tx_buffer = dmaBuf[i];
+  }
+  t->user = (void*)(uintptr_t)dmaJob.queued;
+  spi_device_queue_trans(dmaDev, t, portMAX_DELAY);
+  
+  dmaJob.queued += n;
+  dmaJob.inflight++;
+  dmaJob.next ^= 1;
+}
+
+void dmaComplete(spi_transaction_t* t) {
+  uint32_t n = t->length / 8;
+  if (dmaJob.op == DMA_READ && dmaJob.dst) {
+    memcpy(dmaJob.dst + (uintptr_t)t->user, t->rx_buffer, n);
+  }
+  dmaJob.inflight--;
+  dmaJob.done += n;
+  dmaQueueNext();
+  
+  if (dmaJob.done < dmaJob.total) return;
+  
+  digitalWrite(SPI_CS, HIGH);
+  dmaReleasePins();
+  dmaJob.elapsedUs = micros() - dmaJob.startUs;
+  if (dmaJob.label) {
+    unsigned long us = dmaJob.elapsedUs ? dmaJob.elapsedUs : 1;
+    Serial.printf("OK %s DONE in %lu ms (%.2f MB/s)\n",
+                  dmaJob.label, us / 1000, (float)dmaJob.total / us);
+  }
+  dmaJob.op = DMA_IDLE;
+}
+
+// Collect finished transactions without blocking - call from loop()
+void dmaService() {
+  spi_transaction_t* t;
+  while (dmaBusy() && dmaJob.inflight &&
+         spi_device_get_trans_result(dmaDev, &t, 0) == ESP_OK) {
+    dmaComplete(t);
+  }
+}
+
+// Block until the current job has finished
+void dmaWait() {
+  spi_transaction_t* t;
+  while (dmaBusy()) {
+    if (spi_device_get_trans_result(dmaDev, &t, portMAX_DELAY) == ESP_OK) {
+      dmaComplete(t);
+    }
+  }
+}
+
+// Start a burst job. label != nullptr prints "OK <label> DONE ..." at the end.
+// The job's source/destination are set only after the previous job is done,
+// so its remaining chunks never mix with the new job's buffers.
+bool dmaStart(DmaOp op, uint16_t address, uint32_t len, const char* label,
+              const uint8_t* src = nullptr, DmaGenerator gen = nullptr,
+              uint8_t* dst = nullptr, uint8_t value = 0) {
+  dmaWait();
+  if (!dmaDev || len == 0) return false;
+  
+  dmaJob.op = op;
+  dmaJob.label = label;
+  dmaJob.src = src;
+  dmaJob.gen = gen;
+  dmaJob.dst = dst;
+  dmaJob.value = value;
+  dmaJob.total = len;
+  dmaJob.queued = 0;
+  dmaJob.done = 0;
+  dmaJob.inflight = 0;
+  dmaJob.next = 0;
+  if (op == DMA_FILL) {
+    // Both buffers hold the fill byte, so no per-chunk work at all
+    memset(dmaBuf[0], dmaJob.value, DMA_CHUNK);
+    memset(dmaBuf[1], dmaJob.value, DMA_CHUNK);
+  }
+  
+  dmaAttachPins();
+  digitalWrite(SPI_CS, LOW);
+  spi_transaction_t header = {};
+  header.flags = SPI_TRANS_USE_TXDATA;
+  header.length = 24;
+  header.tx_data[0] = (op == DMA_READ ? WB_CMD_READ : WB_CMD_WRITE) | WB_CMD_BURST;
+  header.tx_data[1] = (address >> 8) & 0xFF;
+  header.tx_data[2] = address & 0xFF;
+  spi_device_polling_transmit(dmaDev, &header);
+  if (op == DMA_READ) delayMicroseconds(2);   // First Wishbone read
+  
+  dmaJob.startUs = micros();
+  dmaQueueNext();
+  dmaQueueNext();
+  return true;
+}
+
+bool dmaFill(uint16_t address, uint8_t value, uint32_t len, const char* label = nullptr) {
+  return dmaStart(DMA_FILL, address, len, label, nullptr, nullptr, nullptr, value);
+}
+
+// Blit from RAM. src must stay valid until the job completes.
+bool dmaWrite(uint16_t address, const uint8_t* src, uint32_t len, const char* label = nullptr) {
+  return dmaStart(DMA_WRITE, address, len, label, src);
+}
+
+bool dmaWriteGen(uint16_t address, DmaGenerator gen, uint32_t len, const char* label = nullptr) {
+  return dmaStart(DMA_WRITE, address, len, label, nullptr, gen);
+}
+
+// Bulk read into RAM. dst must stay valid until the job completes.
+bool dmaRead(uint16_t address, uint8_t* dst, uint32_t len, const char* label = nullptr) {
+  return dmaStart(DMA_READ, address, len, label, nullptr, nullptr, dst);
+}
+
 // ============================================================================
 // Simple 5x7 Font (ASCII 32-90)
 // ============================================================================
@@ -193,45 +487,13 @@ const uint8_t font5x7[][5] PROGMEM = {
   {0x61, 0x51, 0x49, 0x45, 0x43}, // Z
 };
 
-void drawChar(int16_t x, int16_t y, char c, uint8_t color) {
-  if (c < 32 || c > 90) c = 32;  // Default to space for unsupported chars
-  int idx = c - 32;
-  
-  fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
-  for (int col = 0; col < 5; col++) {
-    uint8_t line = pgm_read_byte(&font5x7[idx][col]);
-    for (int row = 0; row < 7; row++) {
-      if (line & (1 << row)) {
-        int16_t px = x + col;
-        int16_t py = y + row;
-        if (px >= 0 && px < 160 && py >= 0 && py < 120) {
-          uint16_t addr = ((py * 160 + px) << 2) & 0x7FFF;
-          digitalWrite(SPI_CS, LOW);
-          fpgaSPI->transfer(0x01);
-          fpgaSPI->transfer((addr >> 8) & 0xFF);
-          fpgaSPI->transfer(addr & 0xFF);
-          fpgaSPI->transfer(color);
-          digitalWrite(SPI_CS, HIGH);
-        }
-      }
-    }
-  }
-  fpgaSPI->endTransaction();
-}
-
-void drawString(int16_t x, int16_t y, const char* str, uint8_t color) {
-  while (*str) {
-    drawChar(x, y, *str, color);
-    x += 6;  // 5 pixels + 1 space
-    str++;
-  }
-}
-
 // ============================================================================
 // Wishbone SPI Functions
 // ============================================================================
 
 void wishboneWrite(uint16_t address, uint8_t data) {
+  if (address == TEXT_CHAR_PORT) textInvalidate();
+  dmaWait();
   fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
   digitalWrite(SPI_CS, LOW);
   fpgaSPI->transfer(0x01);                    // CMD_WRITE
@@ -244,6 +506,7 @@ void wishboneWrite(uint16_t address, uint8_t data) {
 
 uint8_t wishboneRead(uint16_t address) {
   uint8_t result = 0;
+  dmaWait();
   fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
   digitalWrite(SPI_CS, LOW);
   fpgaSPI->transfer(0x00);                    // CMD_READ
@@ -256,6 +519,313 @@ uint8_t wishboneRead(uint16_t address) {
   return result;
 }
 
+// Burst read: one header, then len bytes under a single CS assertion.
+// fixed = true keeps the address constant (FIFO / character ports).
+void wishboneReadBurst(uint16_t address, uint8_t* buf, size_t len, bool fixed = false) {
+  if (len == 0) return;
+  dmaWait();
+  fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
+  digitalWrite(SPI_CS, LOW);
+  fpgaSPI->transfer(WB_CMD_READ | WB_CMD_BURST | (fixed ? WB_CMD_FIXED : 0));
+  fpgaSPI->transfer((address >> 8) & 0xFF);
+  fpgaSPI->transfer(address & 0xFF);
+  delayMicroseconds(2);                       // First read; bridge prefetches the rest
+  memset(buf, 0x00, len);
+  fpgaSPI->transfer(buf, len);
+  digitalWrite(SPI_CS, HIGH);
+  fpgaSPI->endTransaction();
+}
+
+// Burst write: one header, then len bytes under a single CS assertion.
+// Leaves the text shadow alone - the text engine's own path.
+void wishboneWriteBurstRaw(uint16_t address, const uint8_t* buf, size_t len, bool fixed = false) {
+  if (len == 0) return;
+  dmaWait();
+  fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
+  digitalWrite(SPI_CS, LOW);
+  fpgaSPI->transfer(WB_CMD_WRITE | WB_CMD_BURST | (fixed ? WB_CMD_FIXED : 0));
+  fpgaSPI->transfer((address >> 8) & 0xFF);
+  fpgaSPI->transfer(address & 0xFF);
+  fpgaSPI->writeBytes(buf, len);
+  digitalWrite(SPI_CS, HIGH);
+  fpgaSPI->endTransaction();
+}
+
+void wishboneWriteBurst(uint16_t address, const uint8_t* buf, size_t len, bool fixed = false) {
+  // Anything else reaching the character port moves the screen under the shadow
+  if (address <= TEXT_CHAR_PORT && (fixed ? address == TEXT_CHAR_PORT
+                                          : address + len > TEXT_CHAR_PORT)) {
+    textInvalidate();
+  }
+  wishboneWriteBurstRaw(address, buf, len, fixed);
+}
+
+// ============================================================================
+// Framebuffer Helpers
+// ============================================================================
+
+// First pixel of the window segment being generated by testPatternGen
+uint32_t testPatternBase = 0;
+
+// Each pixel is a 4-byte slot; the bridge latches lane 0, so the colour is
+// repeated across the slot to keep the burst contiguous
+void testPatternGen(uint8_t* buf, uint32_t offset, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    uint32_t pixel = testPatternBase + ((offset + i) >> 2);
+    buf[i] = ((pixel % FB_WIDTH) >> 1) & 0xFF;
+  }
+}
+
+// Span buffers: the DMA job reads one while the next span is expanded into the other
+uint8_t fbSpanBuf[2][FB_WIDTH * 4];
+uint8_t fbSpanNext = 0;
+
+// Write n pixels starting at framebuffer pixel index as bursts, split at
+// window boundaries. n <= FB_WIDTH.
+void fbWriteSpan(uint32_t pixel, const uint8_t* colors, uint16_t n) {
+  const uint32_t perWindow = FB_WINDOW / 4;
+  while (n) {
+    uint16_t k = perWindow - (pixel % perWindow);
+    if (k > n) k = n;
+    uint8_t* buf = fbSpanBuf[fbSpanNext];
+    fbSpanNext ^= 1;
+    for (uint16_t i = 0; i < k; i++) {
+      memset(&buf[i * 4], colors[i], 4);
+    }
+    uint16_t addr = (pixel << 2) & 0x7FFF;
+    if (!dmaWrite(addr, buf, k * 4)) wishboneWriteBurst(addr, buf, k * 4);
+    pixel += k;
+    colors += k;
+    n -= k;
+  }
+}
+
+// Decoder for the B command. Pixels are produced in rectangle order;
+// changed pixels collect into a span that is written when a skip or the
+// end of a row breaks it.
+struct BlitState {
+  uint8_t x, y, w, h;
+  uint32_t pos;           // Next pixel, row-major within the rectangle
+  uint32_t total;         // w * h
+  uint8_t token;          // Current op, 0xFF while waiting for a token
+  uint16_t left;          // Pixels left in the current op
+  bool haveValue;         // BLIT_RUN colour received
+  uint8_t value;
+  uint16_t spanCol;       // Rectangle column of span[0]
+  uint16_t spanLen;
+  uint8_t span[FB_WIDTH];
+  uint32_t written;       // Pixels sent over SPI
+};
+
+BlitState blit;
+
+void blitFlush() {
+  if (blit.spanLen == 0) return;
+  uint32_t row = (blit.pos - 1) / blit.w;
+  fbWriteSpan((blit.y + row) * FB_WIDTH + blit.x + blit.spanCol, blit.span, blit.spanLen);
+  blit.written += blit.spanLen;
+  blit.spanLen = 0;
+}
+
+void blitPut(uint8_t color) {
+  uint16_t col = blit.pos % blit.w;
+  if (col == 0) blitFlush();
+  if (blit.spanLen == 0) blit.spanCol = col;
+  blit.span[blit.spanLen++] = color;
+  blit.pos++;
+}
+
+void blitSkip(uint32_t n) {
+  blitFlush();
+  blit.pos += n;
+}
+
+// Feed one stream byte. Returns false once the stream addresses pixels
+// past the end of the rectangle.
+bool blitFeed(uint8_t b) {
+  if (blit.token == 0xFF) {
+    blit.token = b & 0xC0;
+    blit.left = (b & 0x3F) + 1;
+    blit.haveValue = false;
+    if (blit.token == BLIT_SKIP64) blit.left *= 64;
+    if (blit.pos + blit.left > blit.total) return false;
+    if (blit.token == BLIT_SKIP || blit.token == BLIT_SKIP64) {
+      blitSkip(blit.left);
+      blit.token = 0xFF;
+    }
+    return true;
+  }
+  if (blit.token == BLIT_LITERAL) {
+    blitPut(b);
+    blit.left--;
+  } else {
+    // BLIT_RUN: one colour byte covers the whole count
+    while (blit.left) {
+      blitPut(b);
+      blit.left--;
+    }
+  }
+  if (blit.left == 0) blit.token = 0xFF;
+  return true;
+}
+
+// B XX YY WW HH LLLL: read LLLL stream bytes straight from serial and
+// decode them onto the rectangle
+void blitReceive(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t len) {
+  memset(&blit, 0, sizeof(blit));
+  blit.x = x;
+  blit.y = y;
+  blit.w = w;
+  blit.h = h;
+  blit.total = (uint32_t)w * h;
+  blit.token = 0xFF;
+  Serial.println("OK B READY");
+  
+  unsigned long startUs = micros();
+  unsigned long lastByte = millis();
+  uint16_t got = 0;
+  const char* err = nullptr;
+  while (got < len) {
+    if (!Serial.available()) {
+      dmaService();
+      if (millis() - lastByte > BLIT_TIMEOUT_MS) {
+        err = "TIMEOUT";
+        break;
+      }
+      continue;
+    }
+    lastByte = millis();
+    got++;
+    if (!blitFeed(Serial.read())) {
+      err = "OVERRUN";
+      break;
+    }
+  }
+  blitFlush();
+  dmaWait();
+  
+  // Drop whatever is left of a failed stream so it is not parsed as commands
+  if (err) {
+    while (got < len && millis() - lastByte <= BLIT_TIMEOUT_MS) {
+      if (Serial.available()) {
+        Serial.read();
+        got++;
+        lastByte = millis();
+      }
+    }
+    Serial.printf("ERR B %s after %u/%u bytes\n", err, got, len);
+    return;
+  }
+  unsigned long us = micros() - startUs;
+  Serial.printf("OK B %ux%u at %u,%u: %u bytes, %lu pixels written in %lu ms\n",
+                w, h, x, y, len, (unsigned long)blit.written, us / 1000);
+}
+
+// ============================================================================
+// Glyph Cache
+// ============================================================================
+// Each (char, fg, bg) is rasterized once into a 5x7 tile of colour bytes.
+// drawString assembles one framebuffer row at a time from the tiles and
+// writes it as a single span, so a label costs 7 bursts regardless of how
+// many pixels are lit, and the background is painted too.
+
+struct GlyphTile {
+  uint32_t lastUse;       // 0 = empty slot
+  char c;
+  uint8_t fg, bg;
+  uint8_t px[GLYPH_H][GLYPH_W];
+};
+
+GlyphTile glyphCache[GLYPH_SLOTS];
+uint32_t glyphClock = 0;
+uint32_t glyphHits = 0;
+uint32_t glyphMisses = 0;
+
+const GlyphTile* glyphGet(char c, uint8_t fg, uint8_t bg) {
+  if (c < 32 || c > 90) c = 32;  // Default to space for unsupported chars
+  glyphClock++;
+  GlyphTile* victim = &glyphCache[0];
+  for (int i = 0; i < GLYPH_SLOTS; i++) {
+    GlyphTile* t = &glyphCache[i];
+    if (t->lastUse && t->c == c && t->fg == fg && t->bg == bg) {
+      t->lastUse = glyphClock;
+      glyphHits++;
+      return t;
+    }
+    if (t->lastUse < victim->lastUse) victim = t;
+  }
+  
+  glyphMisses++;
+  victim->lastUse = glyphClock;
+  victim->c = c;
+  victim->fg = fg;
+  victim->bg = bg;
+  for (int col = 0; col < GLYPH_W; col++) {
+    uint8_t line = pgm_read_byte(&font5x7[c - 32][col]);
+    for (int row = 0; row < GLYPH_H; row++) {
+      victim->px[row][col] = (line & (1 << row)) ? fg : bg;
+    }
+  }
+  return victim;
+}
+
+// Draw str with its top-left corner at (x, y), clipped to the framebuffer
+void drawString(int16_t x, int16_t y, const char* str, uint8_t fg, uint8_t bg = 0x00) {
+  const GlyphTile* tiles[FB_WIDTH / GLYPH_ADVANCE + 2];
+  int n = 0;
+  
+  // Only glyphs that can reach the screen are looked up
+  for (int16_t gx = x; *str && gx < FB_WIDTH; str++, gx += GLYPH_ADVANCE) {
+    if (gx + GLYPH_ADVANCE <= 0) {
+      x += GLYPH_ADVANCE;
+      continue;
+    }
+    tiles[n++] = glyphGet(*str, fg, bg);
+  }
+  if (n == 0) return;
+  
+  // Columns x .. x + 6n - 2; the gap after the last glyph is not drawn
+  int16_t left = x < 0 ? 0 : x;
+  int16_t right = x + n * GLYPH_ADVANCE - 1;
+  if (right > FB_WIDTH) right = FB_WIDTH;
+  if (right <= left) return;
+  
+  uint8_t row[FB_WIDTH];
+  for (int r = 0; r < GLYPH_H; r++) {
+    int16_t py = y + r;
+    if (py < 0 || py >= FB_HEIGHT) continue;
+    for (int16_t px = left; px < right; px++) {
+      int16_t off = px - x;
+      const GlyphTile* t = tiles[off / GLYPH_ADVANCE];
+      uint8_t col = off % GLYPH_ADVANCE;
+      row[px - left] = col < GLYPH_W ? t->px[r][col] : bg;
+    }
+    fbWriteSpan(py * FB_WIDTH + left, row, right - left);
+  }
+}
+
+void drawChar(int16_t x, int16_t y, char c, uint8_t fg, uint8_t bg = 0x00) {
+  char str[2] = { c, 0 };
+  drawString(x, y, str, fg, bg);
+}
+
+// Blit the test pattern one 32KB window segment at a time
+bool drawTestPatternDma() {
+  if (!dmaDev) return false;
+  const uint32_t perWindow = FB_WINDOW / 4;
+  unsigned long startUs = micros();
+  for (testPatternBase = 0; testPatternBase < FB_PIXELS; testPatternBase += perWindow) {
+    uint32_t pixels = FB_PIXELS - testPatternBase;
+    if (pixels > perWindow) pixels = perWindow;
+    dmaWriteGen(0x0000, testPatternGen, pixels * 4);
+    dmaWait();
+  }
+  unsigned long us = micros() - startUs;
+  if (us == 0) us = 1;
+  Serial.printf("OK TEST DONE in %lu ms (%.2f MB/s)\n", us / 1000, (float)FB_PIXELS * 4 / us);
+  return true;
+}
+
 // ============================================================================
 // MCP Command Processing
 // ============================================================================
@@ -264,6 +834,415 @@ void mcpSendResponse(const char* response) {
   Serial.println(response);
 }
 
+// CRC-16/CCITT-FALSE, matches PapilioMCP.h and the MCP server
+uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Streaming dump: "X<seq> <hex>" per chunk, then "OK X AAAA LLLL CRC=CCCC".
+// Chunks are fetched with DMA, so the SPI read of the next chunk runs
+// while the current line is being sent.
+void mcpStreamDump(uint16_t addr, uint32_t total) {
+  static const char hex[] = "0123456789ABCDEF";
+  static uint8_t chunk[2][STREAM_CHUNK];
+  char line[STREAM_CHUNK * 2 + 8];
+  uint16_t crc = 0xFFFF;
+  uint16_t seq = 0;
+  uint8_t cur = 0;
+  
+  uint32_t n = total < STREAM_CHUNK ? total : STREAM_CHUNK;
+  if (!dmaRead(addr, chunk[cur], n)) wishboneReadBurst(addr, chunk[cur], n);
+  
+  for (uint32_t off = 0; off < total; seq++) {
+    dmaWait();
+    uint32_t nextOff = off + n;
+    uint32_t nextN = total - nextOff;
+    if (nextN > STREAM_CHUNK) nextN = STREAM_CHUNK;
+    if (nextN && !dmaRead(addr + nextOff, chunk[cur ^ 1], nextN)) {
+      wishboneReadBurst(addr + nextOff, chunk[cur ^ 1], nextN);
+    }
+    
+    crc = crc16(chunk[cur], n, crc);
+    int pos = snprintf(line, sizeof(line), "X%04X ", seq);
+    for (uint32_t i = 0; i < n; i++) {
+      line[pos++] = hex[chunk[cur][i] >> 4];
+      line[pos++] = hex[chunk[cur][i] & 0x0F];
+    }
+    line[pos++] = '\n';
+    Serial.write((const uint8_t*)line, pos);
+    
+    off = nextOff;
+    n = nextN;
+    cur ^= 1;
+  }
+  Serial.printf("OK X %04X %04X CRC=%04X\n", addr, (unsigned)total, crc);
+}
+
+// Poll until (read & mask) == value with a microsecond timeout and
+// intervalUs between reads. false on timeout; last/elapsed report back.
+bool wishbonePollUs(uint16_t address, uint8_t mask, uint8_t value, uint32_t timeoutUs,
+                    uint32_t intervalUs, uint8_t* last, uint32_t* elapsedUs) {
+  unsigned long start = micros();
+  uint32_t elapsed;
+  uint8_t v;
+  bool ok;
+  for (;;) {
+    v = wishboneRead(address);
+    elapsed = micros() - start;
+    ok = (v & mask) == value;
+    if (ok || elapsed >= timeoutUs) break;
+    if (intervalUs >= 1000) delay(intervalUs / 1000);
+    if (intervalUs % 1000) delayMicroseconds(intervalUs % 1000);
+  }
+  *last = v;
+  if (elapsedUs) *elapsedUs = elapsed;
+  return ok;
+}
+
+bool wishbonePoll(uint16_t address, uint8_t mask, uint8_t value,
+                  uint16_t timeoutMs, uint8_t* last) {
+  return wishbonePollUs(address, mask, value, (uint32_t)timeoutMs * 1000, 0, last, nullptr);
+}
+
+// Execute encoded batch ops, appending read/poll results to out.
+// Returns false on a poll timeout or a malformed op; done = ops completed.
+// The poll, batch and text engines are kept in step with PapilioMCP.h by
+// hand: this sketch does not use the library, and its SPI access has to
+// go through the DMA engine above.
+bool mcpRunBatch(const uint8_t* ops, size_t len, uint8_t* out, size_t outMax,
+                 size_t& outLen, uint8_t& done, const char*& err) {
+  size_t pos = 0;
+  outLen = 0;
+  done = 0;
+  
+  while (pos < len) {
+    const uint8_t* op = &ops[pos];
+    size_t left = len - pos;
+    uint16_t addr = (left >= 3) ? (uint16_t)((op[1] << 8) | op[2]) : 0;
+    
+    switch (op[0]) {
+      case BATCH_WRITE:
+      case BATCH_WRITE_FIXED:
+        if (left < 4 || left < 4u + op[3]) { err = "BAD LEN"; return false; }
+        wishboneWriteBurst(addr, &op[4], op[3], op[0] == BATCH_WRITE_FIXED);
+        pos += 4 + op[3];
+        break;
+        
+      case BATCH_READ:
+        if (left < 4 || outLen + op[3] > outMax) { err = "BAD LEN"; return false; }
+        wishboneReadBurst(addr, &out[outLen], op[3]);
+        outLen += op[3];
+        pos += 4;
+        break;
+        
+      case BATCH_POLL: {
+        if (left < 7 || outLen + 1 > outMax) { err = "BAD LEN"; return false; }
+        bool ok = wishbonePoll(addr, op[3], op[4], (op[5] << 8) | op[6], &out[outLen++]);
+        if (!ok) { err = "TIMEOUT"; return false; }
+        pos += 7;
+        break;
+      }
+      
+      case BATCH_DELAY:
+        if (left < 3) { err = "BAD LEN"; return false; }
+        delayMicroseconds(addr);
+        pos += 3;
+        break;
+        
+      case BATCH_FILL: {
+        if (left < 6) { err = "BAD LEN"; return false; }
+        uint8_t chunk[32];
+        memset(chunk, op[3], sizeof(chunk));
+        for (uint16_t n = (op[4] << 8) | op[5]; n; ) {
+          uint8_t k = n > sizeof(chunk) ? sizeof(chunk) : n;
+          wishboneWriteBurst(addr, chunk, k, true);
+          n -= k;
+        }
+        pos += 6;
+        break;
+      }
+      
+      default:
+        err = "BAD OP";
+        return false;
+    }
+    done++;
+  }
+  return true;
+}
+
+// Batch: Q op;op;... (see PapilioMCP.h for the op syntax)
+void mcpProcessBatch(const char* p) {
+  uint8_t ops[256];
+  size_t len = 0;
+  size_t results = 0;   // Reply bytes the ops will produce
+  uint8_t index = 0;
+  const char* err = nullptr;
+  
+  for (;;) {
+    while (*p == ' ' || *p == ';') p++;
+    if (!*p) break;
+    
+    char type = toupper(*p++);
+    char* end;
+    uint16_t addr = strtoul(p, &end, 16);
+    if (end == p && type != 'D') { err = "SYNTAX"; break; }
+    p = end;
+    
+    if (type == 'W' || type == 'F') {
+      if (*p++ != '=') { err = "SYNTAX"; break; }
+      size_t head = len;
+      uint8_t n = 0;
+      while (isxdigit(p[0]) && isxdigit(p[1]) && len + 4 + n < sizeof(ops)) {
+        char byteHex[3] = { p[0], p[1], 0 };
+        ops[head + 4 + n++] = strtoul(byteHex, NULL, 16);
+        p += 2;
+      }
+      if (isxdigit(p[0]) && isxdigit(p[1])) { err = "TOO LONG"; break; }
+      if (n == 0) { err = "SYNTAX"; break; }
+      if (*p == '*') {
+        uint16_t repeat = strtoul(p + 1, &end, 16);
+        if (type != 'F' || n != 1 || end == p + 1) { err = "SYNTAX"; break; }
+        p = end;
+        uint8_t value = ops[head + 4];
+        ops[len++] = BATCH_FILL;
+        ops[len++] = addr >> 8;
+        ops[len++] = addr & 0xFF;
+        ops[len++] = value;
+        ops[len++] = repeat >> 8;
+        ops[len++] = repeat & 0xFF;
+      } else {
+        ops[len++] = (type == 'W') ? BATCH_WRITE : BATCH_WRITE_FIXED;
+        ops[len++] = addr >> 8;
+        ops[len++] = addr & 0xFF;
+        ops[len++] = n;
+        len += n;
+      }
+    } else if (type == 'R') {
+      unsigned long n = 1;
+      if (*p == ':') {
+        n = strtoul(p + 1, &end, 16);
+        if (end == p + 1) { err = "SYNTAX"; break; }
+        p = end;
+      }
+      if (n > 0xFF) { err = "BAD COUNT"; break; }
+      results += n;
+      ops[len++] = BATCH_READ;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+      ops[len++] = n;
+    } else if (type == 'P') {
+      if (*p != '&') { err = "SYNTAX"; break; }
+      uint8_t mask = strtoul(p + 1, &end, 16);
+      p = end;
+      if (*p != '=') { err = "SYNTAX"; break; }
+      uint8_t value = strtoul(p + 1, &end, 16);
+      p = end;
+      uint16_t timeout = POLL_TIMEOUT_MS;
+      if (*p == '@') {
+        timeout = strtoul(p + 1, &end, 16);
+        p = end;
+      }
+      results++;
+      ops[len++] = BATCH_POLL;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+      ops[len++] = mask;
+      ops[len++] = value;
+      ops[len++] = timeout >> 8;
+      ops[len++] = timeout & 0xFF;
+    } else if (type == 'D') {
+      ops[len++] = BATCH_DELAY;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+    } else {
+      err = "SYNTAX";
+      break;
+    }
+    
+    if (*p && *p != ' ' && *p != ';') { err = "SYNTAX"; break; }
+    if (len > sizeof(ops) - 8 || results > M_MAX) { err = "TOO LONG"; break; }
+    index++;
+  }
+  
+  if (err) {
+    Serial.printf("ERR Q %02X %s\n", index, err);
+    return;
+  }
+  
+  uint8_t out[M_MAX];
+  size_t outLen;
+  uint8_t done;
+  if (mcpRunBatch(ops, len, out, sizeof(out), outLen, done, err)) {
+    Serial.printf("OK Q %02X:", done);
+  } else {
+    Serial.printf("ERR Q %02X %s:", done, err);
+  }
+  for (size_t i = 0; i < outLen; i++) {
+    Serial.printf(" %02X", out[i]);
+  }
+  Serial.println();
+}
+
+// ============================================================================
+// Text Engine
+// ============================================================================
+
+void textSetCursor(uint8_t x, uint8_t y, uint8_t attr) {
+  uint8_t regs[3] = { x, y, attr };
+  wishboneWriteBurstRaw(TEXT_CURSOR_X, regs, 3);
+}
+
+// Bring n cells of row y from column x up to date: one cursor/attr burst
+// plus one character-port burst per run of changed same-attr cells
+void textRow(uint8_t x, uint8_t y, const uint8_t* ch, const uint8_t* at, uint8_t n) {
+  uint16_t base = y * TEXT_COLS + x;
+  textCells += n;
+  
+  auto same = [&](uint8_t i) {
+    uint16_t cell = base + i;
+    return (textKnown[cell >> 3] & (1 << (cell & 7))) &&
+           textChar[cell] == ch[i] && textAttr[cell] == at[i];
+  };
+  
+  uint8_t i = 0;
+  while (i < n) {
+    if (same(i)) {
+      i++;
+      continue;
+    }
+    uint8_t start = i;
+    uint8_t end = i + 1;
+    for (uint8_t j = end; j < n && at[j] == at[start]; j++) {
+      if (!same(j)) end = j + 1;
+      else if (j - end >= TEXT_GAP) break;
+    }
+    
+    textSetCursor(x + start, y, at[start]);
+    wishboneWriteBurstRaw(TEXT_CHAR_PORT, &ch[start], end - start, true);
+    for (uint8_t k = start; k < end; k++) {
+      uint16_t cell = base + k;
+      textChar[cell] = ch[k];
+      textAttr[cell] = at[k];
+      textKnown[cell >> 3] |= 1 << (cell & 7);
+    }
+    textWritten += end - start;
+    textRuns++;
+    i = end;
+  }
+}
+
+void textWrite(uint8_t x, uint8_t y, const char* text, uint8_t attr) {
+  uint8_t ch[TEXT_COLS], at[TEXT_COLS];
+  memset(at, attr, sizeof(at));
+  size_t len = strlen(text);
+  
+  while (len && y < TEXT_ROWS) {
+    uint8_t n = TEXT_COLS - x;
+    if (len < n) n = len;
+    memcpy(ch, text, n);
+    textRow(x, y, ch, at, n);
+    text += n;
+    len -= n;
+    x += n;
+    if (x == TEXT_COLS && len) {
+      x = 0;
+      y++;
+    }
+  }
+  textSetCursor(x < TEXT_COLS ? x : TEXT_COLS - 1, y < TEXT_ROWS ? y : TEXT_ROWS - 1, attr);
+}
+
+// cells == nullptr fills with c/attr, otherwise w*h (char, attr) pairs
+void textRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t* cells,
+              uint8_t c = ' ', uint8_t attr = 0) {
+  uint8_t stride = w;
+  if (w > TEXT_COLS - x) w = TEXT_COLS - x;
+  if (h > TEXT_ROWS - y) h = TEXT_ROWS - y;
+  uint8_t ch[TEXT_COLS], at[TEXT_COLS];
+  memset(ch, c, sizeof(ch));
+  memset(at, attr, sizeof(at));
+  for (uint8_t r = 0; r < h; r++) {
+    if (cells) {
+      const uint8_t* row = &cells[r * stride * 2];
+      for (uint8_t i = 0; i < w; i++) {
+        ch[i] = row[i * 2];
+        at[i] = row[i * 2 + 1];
+      }
+    }
+    textRow(x, y + r, ch, at, w);
+  }
+}
+
+// E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA... | E I | E
+void mcpProcessText(const char* p) {
+  while (*p == ' ') p++;
+  char sub = toupper(*p);
+  if (sub) p++;
+  
+  uint32_t arg[6] = { 0 };
+  uint8_t argc = 0;
+  uint8_t want = sub == 'S' ? 3 : sub == 'F' ? 6 : sub == 'R' ? 4 : 0;
+  char* end;
+  while (argc < want) {
+    while (*p == ' ') p++;
+    arg[argc] = strtoul(p, &end, 16);
+    if (end == p || arg[argc] > 0xFF) break;
+    p = end;
+    argc++;
+  }
+  bool bad = want ? (argc < want || arg[0] >= TEXT_COLS || arg[1] >= TEXT_ROWS)
+                  : (sub != 'I' && sub != '\0');
+  if (bad) {
+    mcpSendResponse("ERR: E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA.. | E I");
+    return;
+  }
+  
+  uint32_t written = textWritten;
+  uint32_t cells = textCells;
+  switch (sub) {
+    case 'S':
+      if (*p == ' ') p++;
+      textWrite(arg[0], arg[1], p, arg[2]);
+      break;
+    case 'F':
+      textRect(arg[0], arg[1], arg[2], arg[3], nullptr, arg[4], arg[5]);
+      break;
+    case 'R': {
+      uint8_t cellBuf[128];
+      size_t n = 0;
+      while (*p == ' ') p++;
+      while (isxdigit(p[0]) && isxdigit(p[1]) && n < sizeof(cellBuf)) {
+        char byteHex[3] = { p[0], p[1], 0 };
+        cellBuf[n++] = strtoul(byteHex, NULL, 16);
+        p += 2;
+      }
+      if (!arg[2] || !arg[3] || n != arg[2] * arg[3] * 2) {
+        mcpSendResponse("ERR: E R needs WW*HH cells of CCAA");
+        return;
+      }
+      textRect(arg[0], arg[1], arg[2], arg[3], cellBuf);
+      break;
+    }
+    case 'I':
+      textInvalidate();
+      mcpSendResponse("OK E INVALIDATED");
+      return;
+    default:
+      Serial.printf("OK E cells=%lu written=%lu runs=%lu\n", (unsigned long)textCells,
+                    (unsigned long)textWritten, (unsigned long)textRuns);
+      return;
+  }
+  Serial.printf("OK E %c cells=%lu written=%lu\n", sub,
+                (unsigned long)(textCells - cells), (unsigned long)(textWritten - written));
+}
+
 void mcpProcessCommand(String cmd) {
   cmd.trim();
   if (cmd.length() == 0) return;
@@ -310,13 +1289,14 @@ void mcpProcessCommand(String cmd) {
       // Multi-read command: M AAAA NN
       if (cmd.length() >= 9) {
         uint16_t addr = strtol(cmd.substring(2, 6).c_str(), NULL, 16);
-        uint8_t count = strtol(cmd.substring(7, 9).c_str(), NULL, 16);
-        if (count > 64) count = 64;
+        uint16_t count = strtol(cmd.substring(7, 11).c_str(), NULL, 16);
+        if (count > M_MAX) count = M_MAX;
         
+        uint8_t data[M_MAX];
+        wishboneReadBurst(addr, data, count);
         Serial.printf("OK M %04X:", addr);
         for (int i = 0; i < count; i++) {
-          uint8_t data = wishboneRead(addr + i);
-          Serial.printf(" %02X", data);
+          Serial.printf(" %02X", data[i]);
         }
         Serial.println();
       } else {
@@ -325,20 +1305,78 @@ void mcpProcessCommand(String cmd) {
       break;
     }
     
+    case 'Q':
+    case 'q': {
+      // Batch: Q op;op;...
+      mcpProcessBatch(cmd.c_str() + 1);
+      break;
+    }
+    
+    case 'E':
+    case 'e': {
+      // Text engine: E S|F|R|I ...
+      mcpProcessText(cmd.c_str() + 1);
+      break;
+    }
+    
+    case 'A':
+    case 'a': {
+      // Await: A AAAA MM VV [TTTTTTTT [IIII]]
+      char* p = (char*)cmd.c_str() + 1;
+      char* end;
+      uint32_t args[5] = { 0, 0, 0, AWAIT_TIMEOUT_US, 0 };
+      int n = 0;
+      while (n < 5) {
+        uint32_t v = strtoul(p, &end, 16);
+        if (end == p) break;
+        args[n++] = v;
+        p = end;
+      }
+      if (n >= 3) {
+        uint8_t last;
+        uint32_t elapsed;
+        bool ok = wishbonePollUs(args[0], args[1], args[2], args[3], args[4], &last, &elapsed);
+        Serial.printf("%s A %04X=%02X %s%luus\n", ok ? "OK" : "ERR", (unsigned)args[0], last,
+                      ok ? "in " : "TIMEOUT after ", (unsigned long)elapsed);
+      } else {
+        mcpSendResponse("ERR: A AAAA MM VV [TTTTTTTT [IIII]]");
+      }
+      break;
+    }
+    
+    case 'X':
+    case 'x': {
+      // Streaming dump: X AAAA LLLL
+      if (cmd.length() >= 11) {
+        uint16_t addr = strtol(cmd.substring(2, 6).c_str(), NULL, 16);
+        uint16_t total = strtol(cmd.substring(7, 11).c_str(), NULL, 16);
+        mcpStreamDump(addr, total);
+      } else {
+        mcpSendResponse("ERR: X AAAA LLLL");
+      }
+      break;
+    }
+    
     case 'D':
     case 'd': {
       // Dump debug registers
       mcpSendResponse("=== DEBUG DUMP ===");
       Serial.printf("JTAG Bridge: %s\n", jtag_enabled ? "ENABLED" : "disabled");
       Serial.printf("USB Connected: %s\n", usb_serial_jtag_ll_txfifo_writable() ? "YES" : "NO");
-      mcpSendResponse("--- RGB LED (0x8100-0x8103) ---");
-      for (uint16_t i = 0x8100; i < 0x8104; i++) {
-        uint8_t data = wishboneRead(i);
-        Serial.printf("  [%04X] = %02X\n", i, data);
+      // One burst per range, 16 bytes per line
+      for (const RegRange& r : registerMap) {
+        Serial.printf("--- %s (0x%04X-0x%04X) ---\n", r.name, r.start, r.start + r.len - 1);
+        uint8_t data[16];
+        for (uint16_t i = 0; i < r.len; i += sizeof(data)) {
+          uint16_t n = r.len - i > (int)sizeof(data) ? (int)sizeof(data) : r.len - i;
+          wishboneReadBurst(r.start + i, data, n);
+          Serial.printf("  [%04X] =", r.start + i);
+          for (uint16_t j = 0; j < n; j++) Serial.printf(" %02X", data[j]);
+          Serial.println();
+        }
       }
-      mcpSendResponse("--- Video Mode ---");
-      uint8_t mode = wishboneRead(0x8000);
-      Serial.printf("  Video mode: %d\n", mode & 0x07);
+      Serial.printf("Glyph cache: %lu hits, %lu misses (%d slots)\n",
+                    (unsigned long)glyphHits, (unsigned long)glyphMisses, GLYPH_SLOTS);
       mcpSendResponse("=== END DUMP ===");
       break;
     }
@@ -350,18 +1388,16 @@ void mcpProcessCommand(String cmd) {
         uint8_t color = strtol(cmd.substring(2, 4).c_str(), NULL, 16);
         Serial.printf("Filling framebuffer with 0x%02X...\n", color);
         
+        // Every pixel slot in the 32KB window gets the colour; the reply is
+        // printed by dmaService() once the last buffer has gone out
+        if (dmaFill(0x0000, color, FB_WINDOW, "FILL")) break;
+        
         unsigned long startTime = millis();
-        fpgaSPI->beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
-        for (uint16_t pixel = 0; pixel < 19200; pixel++) {
-          uint16_t addr = (pixel << 2) & 0x7FFF;
-          digitalWrite(SPI_CS, LOW);
-          fpgaSPI->transfer(0x01);
-          fpgaSPI->transfer((addr >> 8) & 0xFF);
-          fpgaSPI->transfer(addr & 0xFF);
-          fpgaSPI->transfer(color);
-          digitalWrite(SPI_CS, HIGH);
+        uint8_t row[FB_WIDTH];
+        memset(row, color, sizeof(row));
+        for (uint16_t y = 0; y < FB_HEIGHT; y++) {
+          fbWriteSpan(y * FB_WIDTH, row, FB_WIDTH);
         }
-        fpgaSPI->endTransaction();
         unsigned long elapsed = millis() - startTime;
         
         Serial.printf("OK FILL DONE in %lu ms\n", elapsed);
@@ -396,14 +1432,20 @@ void mcpProcessCommand(String cmd) {
     
     case 'S':
     case 's': {
-      // String drawing: S XX YY CC text...
+      // String drawing: S XX YY CC[BB] text...
       if (cmd.length() >= 12) {
         uint16_t x = strtol(cmd.substring(2, 4).c_str(), NULL, 16);
         uint16_t y = strtol(cmd.substring(5, 7).c_str(), NULL, 16);
         uint8_t color = strtol(cmd.substring(8, 10).c_str(), NULL, 16);
-        String text = cmd.substring(11);
+        uint8_t bg = 0x00;
+        int textStart = 11;
+        if (cmd.length() >= 14 && cmd.charAt(10) != ' ') {
+          bg = strtol(cmd.substring(10, 12).c_str(), NULL, 16);
+          textStart = 13;
+        }
+        String text = cmd.substring(textStart);
         text.toUpperCase();
-        drawString(x, y, text.c_str(), color);
+        drawString(x, y, text.c_str(), color, bg);
         char response[64];
         snprintf(response, sizeof(response), "OK S \"%s\" at %d,%d", text.c_str(), x, y);
         mcpSendResponse(response);
@@ -413,17 +1455,39 @@ void mcpProcessCommand(String cmd) {
       break;
     }
     
+    case 'B':
+    case 'b': {
+      // Blit: B XX YY WW HH LLLL, then LLLL raw stream bytes
+      uint32_t args[5];
+      int n = 0;
+      char* p = (char*)cmd.c_str() + 1;
+      char* end;
+      while (n < 5) {
+        args[n] = strtoul(p, &end, 16);
+        if (end == p) break;
+        p = end;
+        n++;
+      }
+      if (n == 5 && args[0] < FB_WIDTH && args[1] < FB_HEIGHT && args[2] && args[3] &&
+          args[0] + args[2] <= FB_WIDTH && args[1] + args[3] <= FB_HEIGHT && args[4] <= 0xFFFF) {
+        blitReceive(args[0], args[1], args[2], args[3], args[4]);
+      } else {
+        mcpSendResponse("ERR: B XX YY WW HH LLLL (rectangle inside 160x120)");
+      }
+      break;
+    }
+    
     case 'T':
     case 't': {
       // Test pattern
       mcpSendResponse("DRAWING TEST PATTERN...");
-      for (uint16_t y = 0; y < 120; y++) {
-        for (uint16_t x = 0; x < 160; x++) {
-          uint8_t color = (x >> 1) & 0xFF;
-          uint16_t pixel = y * 160 + x;
-          uint16_t addr = (pixel << 2) & 0x7FFF;
-          wishboneWrite(addr, color);
-        }
+      if (drawTestPatternDma()) break;
+      uint8_t row[FB_WIDTH];
+      for (uint16_t x = 0; x < FB_WIDTH; x++) {
+        row[x] = (x >> 1) & 0xFF;
+      }
+      for (uint16_t y = 0; y < FB_HEIGHT; y++) {
+        fbWriteSpan(y * FB_WIDTH, row, FB_WIDTH);   // One burst per row
         if ((y % 20) == 0) {
           Serial.printf("  Row %d/120\n", y);
         }
@@ -458,10 +1522,15 @@ void mcpProcessCommand(String cmd) {
       mcpSendResponse("W AAAA DD     - Write DD to addr AAAA");
       mcpSendResponse("R AAAA        - Read from addr AAAA");
       mcpSendResponse("M AAAA NN     - Read NN bytes from AAAA");
+      mcpSendResponse("X AAAA LLLL   - Stream LLLL bytes from AAAA");
+      mcpSendResponse("Q op;op;...   - Batch: WAAAA=DD FAAAA=DD[*NNNN] RAAAA[:NN] PAAAA&MM=VV[@TTTT] DNNNN");
+      mcpSendResponse("A AAAA MM VV [T [I]] - Wait for (AAAA & MM) == VV (us)");
+      mcpSendResponse("E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA.. | E I");
       mcpSendResponse("D             - Dump debug registers");
       mcpSendResponse("F CC          - Fill framebuffer with CC");
       mcpSendResponse("P XXXX YYYY CC - Put pixel");
-      mcpSendResponse("S XX YY CC text - Draw text (uppercase)");
+      mcpSendResponse("S XX YY CC[BB] text - Draw text (uppercase) on background BB");
+      mcpSendResponse("B XX YY WW HH LLLL - Blit RLE/delta rectangle, LLLL raw bytes follow");
       mcpSendResponse("T             - Draw test pattern");
       mcpSendResponse("J [1|0]       - Enable/disable JTAG bridge");
       mcpSendResponse("G             - GPIO debug (loopback test)");
@@ -473,6 +1542,7 @@ void mcpProcessCommand(String cmd) {
     case 'G':
     case 'g': {
       // GPIO loopback test
+      dmaWait();
       Serial.println("=== GPIO LOOPBACK TEST ===");
       Serial.printf("MOSI=GPIO%d  MISO=GPIO%d\n", SPI_MOSI, SPI_MISO);
       
@@ -542,6 +1612,12 @@ void setup() {
   fpgaSPI = new SPIClass(HSPI);
   fpgaSPI->begin(SPI_CLK, SPI_MISO, SPI_MOSI, SPI_CS);
   
+  if (dmaBegin()) {
+    Serial.println("SPI DMA engine ready (fill/blit/bulk read)");
+  } else {
+    Serial.println("SPI DMA engine unavailable - using byte transfers");
+  }
+  
   Serial.println("SPI initialized for Wishbone communication");
   Serial.println();
   Serial.println("Ready! Type H for help.");
@@ -550,6 +1626,9 @@ void setup() {
 }
 
 void loop() {
+  // Keep any running DMA job fed
+  dmaService();
+  
   // Process MCP commands from USB Serial
   while (Serial.available()) {
     char c = Serial.read();
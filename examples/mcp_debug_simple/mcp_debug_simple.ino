@@ -15,6 +15,29 @@
 
 // Note: PAPILIO_MCP_ENABLED is defined via build_flags in platformio.ini
 // Do not define it here to avoid redefinition warning
+
+// Every optional feature the MCP server has tools for (they default off)
+#ifndef MCP_ENABLE_TELEMETRY
+#define MCP_ENABLE_TELEMETRY 1
+#endif
+#ifndef MCP_ENABLE_EVENTS
+#define MCP_ENABLE_EVENTS    1
+#endif
+#ifndef MCP_ENABLE_WATCH
+#define MCP_ENABLE_WATCH     1
+#endif
+#ifndef MCP_ENABLE_TEXT
+#define MCP_ENABLE_TEXT      1
+#endif
+#ifndef MCP_ENABLE_LA
+#define MCP_ENABLE_LA        1
+#endif
+#ifndef MCP_ENABLE_SNAPSHOT
+#define MCP_ENABLE_SNAPSHOT  1
+#endif
+#ifndef MCP_ENABLE_JTAG_PROG
+#define MCP_ENABLE_JTAG_PROG 1
+#endif
 #include <PapilioMCP.h>
 
 void setup() {
@@ -28,6 +51,10 @@ void setup() {
   // Initialize MCP debug interface
   PapilioMCP.begin();
   
+  // RGB LED colour registers only change through the bridge, so reads can be
+  // served from RAM. 0x8103 (status) is left volatile.
+  PapilioMCP.cacheRange(0x8100, 3, MCP_CACHE_WRITE_THROUGH);
+  
   Serial.println("Type H for help, or use MCP server for AI control.\n");
 }
 
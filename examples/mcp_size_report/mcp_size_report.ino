@@ -0,0 +1,45 @@
+/*
+  Papilio Arcade - MCP Size Report Sketch
+  =======================================
+
+  A small sketch that uses PapilioMCP the way an application does, built
+  several times by the host script to measure what the library costs:
+
+    python server/mcp_size_report.py --fqbn esp32:esp32:esp32s3 --output size.json
+
+  Build variants (the script passes these as compiler flags):
+    -DSIZE_BASELINE            No PapilioMCP at all: the reference size
+    (no flags)                 Header included, MCP disabled: must match
+                               the baseline byte for byte
+    -DPAPILIO_MCP_ENABLED      Optional features at their defaults
+    -DMCP_ENABLE_<X>=1         Feature built in; the full build sets all
+                               of them and drops one at a time to get its cost
+
+  The sketch does the same application work in every variant, so the
+  differences between builds are the library alone.
+*/
+
+#include <Arduino.h>
+#ifndef SIZE_BASELINE
+#include <PapilioMCP.h>
+#endif
+
+static uint8_t level = 0;
+
+void setup() {
+  Serial.begin(115200);
+#ifndef SIZE_BASELINE
+  PapilioMCP.begin();
+#endif
+}
+
+void loop() {
+#ifndef SIZE_BASELINE
+  PapilioMCP.update();
+  PapilioMCP.wishboneWrite(0x8100, level);
+  MCP_BREAKPOINT("loop");
+  PapilioMCP.waitWhilePaused();
+#endif
+  level++;
+  delay(10);
+}
@@ -76,6 +76,18 @@ class LogicAnalyzerTool:
         """Write logic analyzer register"""
         self.ctrl.wishbone_write(self.BASE_ADDR + reg_offset, value)
         
+    def _read_block(self, reg_offset: int, count: int) -> List[int]:
+        """Read consecutive logic analyzer bytes with burst transfers"""
+        return self.ctrl.wishbone_read_block(self.BASE_ADDR + reg_offset, count)
+        
+    def _read_stream(self, reg_offset: int, count: int) -> List[int]:
+        """Read a large range (sample memory) with the streaming X dump"""
+        return self.ctrl.wishbone_read_stream(self.BASE_ADDR + reg_offset, count)
+        
+    def _write_block(self, reg_offset: int, data: bytes):
+        """Write consecutive logic analyzer registers with burst transfers"""
+        self.ctrl.wishbone_write_block(self.BASE_ADDR + reg_offset, data)
+        
     def reset(self) -> Dict:
         """Reset the logic analyzer"""
         self._write_reg(self.REG_CMD, self.CMD_RESET)
@@ -112,17 +124,10 @@ class LogicAnalyzerTool:
         # Store configured sample count
         self.configured_samples = samples
         
-        # Write trigger mask (32-bit)
-        self._write_reg(self.REG_TRIGGER_MASK_0, (trigger_mask >> 0) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_MASK_1, (trigger_mask >> 8) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_MASK_2, (trigger_mask >> 16) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_MASK_3, (trigger_mask >> 24) & 0xFF)
-        
-        # Write trigger value (32-bit)
-        self._write_reg(self.REG_TRIGGER_VAL_0, (trigger_value >> 0) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_VAL_1, (trigger_value >> 8) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_VAL_2, (trigger_value >> 16) & 0xFF)
-        self._write_reg(self.REG_TRIGGER_VAL_3, (trigger_value >> 24) & 0xFF)
+        # Write trigger mask and value (2 x 32-bit, little-endian) in one burst
+        self._write_block(self.REG_TRIGGER_MASK_0,
+                          (trigger_mask & 0xFFFFFFFF).to_bytes(4, "little") +
+                          (trigger_value & 0xFFFFFFFF).to_bytes(4, "little"))
         
         # Write post-trigger count (16-bit)
         self._write_reg(self.REG_DELAY_COUNT_L, post_trigger & 0xFF)
@@ -162,31 +167,36 @@ class LogicAnalyzerTool:
             [15:8]  = wb_adr_o[7:0]
             [7:0]   = debug signals (rgb_led, spi, clk, rst, audio)
         """
-        start_time = time.time()
-        
-        # Wait for DONE state (bit 2 = TRIGGERED)
-        while time.time() - start_time < timeout:
-            status_byte = self._read_reg(self.REG_STATUS)
-            if status_byte & 0x04:  # TRIGGERED bit
-                break
-            time.sleep(0.01)
-        else:
+        # Wait for DONE state (bit 2 = TRIGGERED) on the device itself: one
+        # reply when the capture completes instead of a host round trip per read
+        result = self.ctrl.wishbone_poll(self.BASE_ADDR + self.REG_STATUS, 0x04, 0x04, timeout)
+        if not result["ok"]:
             return None  # Timeout
+        self.last_trigger_us = result["elapsed_us"]
         
-        # Read 32-bit samples (4 bytes per sample)
-        # Sample memory is byte-addressable: each 32-bit sample occupies 4 consecutive bytes
-        samples = []
+        return self.read_samples(num_samples)
+        
+    def read_samples(self, num_samples: Optional[int] = None) -> List[int]:
+        """Read 32-bit samples from capture memory.
+        
+        Firmware with the L command compresses the capture on the device and
+        sends only value changes; otherwise the memory comes as one streaming
+        dump and is rebuilt here.
+        """
         max_samples = num_samples if num_samples else getattr(self, 'configured_samples', 128)
+        self.last_transfer = None
+        if self.BASE_ADDR == 0x8300:
+            samples = self.ctrl.logic_analyzer_read(max_samples)
+            if samples is not None:
+                self.last_transfer = self.ctrl.la_transfer
+                return samples
         
-        for i in range(max_samples):
-            # Calculate base address for this sample
-            sample_offset = i * 4
-            byte0 = self._read_reg(self.REG_DATA_START + sample_offset + 0)  # [7:0]
-            byte1 = self._read_reg(self.REG_DATA_START + sample_offset + 1)  # [15:8]
-            byte2 = self._read_reg(self.REG_DATA_START + sample_offset + 2)  # [23:16]
-            byte3 = self._read_reg(self.REG_DATA_START + sample_offset + 3)  # [31:24]
-            
-            # Combine into 32-bit sample
+        # Sample memory is byte-addressable: each 32-bit sample occupies 4 consecutive bytes
+        samples = []
+        raw = self._read_stream(self.REG_DATA_START, max_samples * 4)
+        for i in range(len(raw) // 4):
+            # Combine bytes [7:0], [15:8], [23:16], [31:24] into a 32-bit sample
+            byte0, byte1, byte2, byte3 = raw[i * 4:i * 4 + 4]
             sample_32bit = (byte3 << 24) | (byte2 << 16) | (byte1 << 8) | byte0
             samples.append(sample_32bit)
             
@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+"""
+Papilio MCP Benchmark
+=====================
+Measures the serial/Wishbone path of a board running PapilioMCP firmware
+(examples/mcp_benchmark, or any PapilioMCP.h / full debug firmware build)
+and writes the results as JSON.
+
+Measured:
+- single read/write round-trip latency, ASCII and binary
+- M dump, X stream and binary block read throughput
+- fill (batch FILL op, text engine E F) and framebuffer blit throughput
+- commands per second for ASCII, ASCII pipelined (#II tags), ASCII batch (Q),
+  binary and binary batch
+
+With firmware built with MCP_ENABLE_STATS=1 every result also carries the
+device-side cycle counts of the commands it ran (Z command), and the report
+records the CPU and SPI clocks.
+
+--budget takes a JSON file of limits on report paths (the format of
+mcp_size_report.py), e.g. {"results.latency.binary.read.p95_us": 300};
+the script exits with status 1 when one is exceeded.
+
+Usage:
+    python mcp_benchmark.py --port COM4 [--scratch 1000] [--lanes 4] [--iterations 200]
+                            [--label "spi 20MHz"] [--output bench.json]
+                            [--budget budget.json]
+"""
+
+import argparse
+import json
+import platform
+import statistics
+import sys
+import time
+
+from papilio_mcp_server import PapilioController, FB_WIDTH, FB_HEIGHT
+from mcp_size_report import check_budget, load_budget
+
+REPORT_VERSION = 1
+BLOCK_SIZE = 4096        # Bytes per throughput run
+FILL_COUNT = 0x1000      # Bytes written by one FILL op
+CPS_COMMANDS = 200       # Register reads per commands-per-second run
+
+
+def summarize(samples_s: list) -> dict:
+    """Latency summary in microseconds."""
+    us = sorted(s * 1e6 for s in samples_s)
+    return {
+        "n": len(us),
+        "mean_us": round(statistics.mean(us), 1),
+        "median_us": round(statistics.median(us), 1),
+        "p95_us": round(us[min(len(us) - 1, int(len(us) * 0.95))], 1),
+        "min_us": round(us[0], 1),
+        "max_us": round(us[-1], 1),
+    }
+
+
+def throughput(nbytes: int, seconds: float) -> dict:
+    return {"bytes": nbytes, "seconds": round(seconds, 4),
+            "bytes_per_s": round(nbytes / seconds) if seconds > 0 else None}
+
+
+class Benchmark:
+    def __init__(self, controller: PapilioController, scratch: int, iterations: int,
+                 lanes: int = 1):
+        self.c = controller
+        self.scratch = scratch
+        self.lanes = lanes                # Bytes per RAM slot; only lane 0 is stored
+        self.iterations = iterations
+        self.binary = controller.binary   # What the firmware supports
+        self.stats = controller.get_stats(reset=True) is not None
+
+    def mode(self, binary: bool):
+        """Route the controller's calls through one protocol."""
+        self.c.binary = binary and self.binary
+
+    def run(self, fn) -> dict:
+        """Run fn (returns a result dict), adding device stats for that run."""
+        if self.stats:
+            self.c.get_stats(reset=True)
+        result = fn()
+        if self.stats and result is not None:
+            device = self.c.get_stats()
+            # The Z request that read the stats is not part of the run
+            device["commands"].pop("Z", None)
+            result["device"] = {"commands": device["commands"], "opcodes": device["opcodes"],
+                                "spi_sketch": device["spi_sketch"],
+                                "spi_debug": device["spi_debug"]}
+        return result
+
+    # --- single register round trips
+
+    def latency(self, binary: bool) -> dict:
+        self.mode(binary)
+        reads, writes = [], []
+        for i in range(self.iterations):
+            t = time.perf_counter()
+            self.c.wishbone_write(self.scratch, i & 0xFF)
+            writes.append(time.perf_counter() - t)
+            t = time.perf_counter()
+            value = self.c.wishbone_read(self.scratch)
+            reads.append(time.perf_counter() - t)
+            if value != i & 0xFF:
+                return {"error": f"read back {value:02X}, expected {i & 0xFF:02X}"}
+        return {"read": summarize(reads), "write": summarize(writes)}
+
+    # --- bulk reads and writes
+
+    def dump(self, method: str) -> dict:
+        # One value per slot, repeated across its lanes; only lane 0 is compared
+        pattern = bytes((i // self.lanes * 7 + 3) & 0xFF for i in range(BLOCK_SIZE))
+        self.mode(True)
+        if not self.c.wishbone_write_block(self.scratch, pattern):
+            return {"error": "pattern write failed"}
+        self.mode(method == "binary")
+        t = time.perf_counter()
+        if method == "stream":
+            data = self.c.wishbone_read_stream(self.scratch, BLOCK_SIZE)
+        else:
+            data = self.c.wishbone_read_block(self.scratch, BLOCK_SIZE)
+        elapsed = time.perf_counter() - t
+        if bytes(data)[::self.lanes] != pattern[::self.lanes]:
+            return {"error": f"{len(data)} bytes read back, mismatch"}
+        return throughput(BLOCK_SIZE, elapsed)
+
+    def write_block(self) -> dict:
+        self.mode(True)
+        data = bytes(i & 0xFF for i in range(BLOCK_SIZE))
+        t = time.perf_counter()
+        ok = self.c.wishbone_write_block(self.scratch, data)
+        elapsed = time.perf_counter() - t
+        return throughput(BLOCK_SIZE, elapsed) if ok else {"error": "write failed"}
+
+    # --- fills and blits
+
+    def fill(self, binary: bool) -> dict:
+        """One fixed-address FILL op: every byte is a Wishbone write."""
+        self.mode(binary)
+        t = time.perf_counter()
+        result = self.c.wishbone_batch([("FILL", self.scratch, 0x55, FILL_COUNT)])
+        elapsed = time.perf_counter() - t
+        return throughput(FILL_COUNT, elapsed) if result is not None else {"error": "batch failed"}
+
+    def text_fill(self) -> dict:
+        self.mode(False)
+        t = time.perf_counter()
+        ok = self.c.text_fill(0, 0, 80, 26, "#", 0x1F)
+        elapsed = time.perf_counter() - t
+        if not ok or not self.c.text_engine:
+            return None
+        self.c.text_fill(0, 0, 80, 26, " ", 0x0F)
+        return {"cells": 80 * 26, "seconds": round(elapsed, 4),
+                "cells_per_s": round(80 * 26 / elapsed)}
+
+    def blit(self) -> dict:
+        """Full-frame blits; None on firmware without the B command."""
+        self.mode(False)
+        if self.c._send_blit(0, 0, 1, 1, self.c.encode_blit(bytes(1))) is None:
+            return None
+        results = {}
+        frames = {
+            "noise": bytes((i * 2654435761 >> 13) & 0xFF for i in range(FB_WIDTH * FB_HEIGHT)),
+            "bars": bytes((x // 20) * 0x24 for _ in range(FB_HEIGHT) for x in range(FB_WIDTH)),
+        }
+        for name, frame in frames.items():
+            self.c.fb_shadow = None   # Every run is a full, non-delta upload
+            t = time.perf_counter()
+            result = self.c.framebuffer_blit(frame)
+            elapsed = time.perf_counter() - t
+            if not result["ok"]:
+                return {"error": f"{name} blit failed"}
+            results[name] = {"pixels": result["pixels"], "stream_bytes": result["bytes"],
+                             "seconds": round(elapsed, 4),
+                             "pixels_per_s": round(result["pixels"] / elapsed)}
+        return results
+
+    # --- commands per second
+
+    def commands_per_second(self, mode: str) -> dict:
+        self.mode(mode.startswith("binary"))
+        t = time.perf_counter()
+        if mode in ("ascii_batch", "binary_batch"):
+            result = self.c.wishbone_batch([("R", self.scratch, 1)] * CPS_COMMANDS)
+            ok = result is not None and len(result) == CPS_COMMANDS
+        elif mode == "ascii_pipelined":
+            replies = self.c.send_commands([f"R {self.scratch:04X}"] * CPS_COMMANDS)
+            ok = all(r.startswith("OK R") for r in replies)
+        else:
+            for _ in range(CPS_COMMANDS):
+                self.c.wishbone_read(self.scratch)   # One round trip each
+            ok = True
+        elapsed = time.perf_counter() - t
+        if not ok:
+            return {"error": "batch failed"}
+        return {"commands": CPS_COMMANDS, "seconds": round(elapsed, 4),
+                "commands_per_s": round(CPS_COMMANDS / elapsed)}
+
+    def all(self) -> dict:
+        protocols = ["ascii"] + (["binary"] if self.binary else [])
+        results = {
+            "latency": {p: self.run(lambda p=p: self.latency(p == "binary")) for p in protocols},
+            "read_throughput": {m: self.run(lambda m=m: self.dump(m))
+                                for m in ["ascii", "stream"] + (["binary"] if self.binary else [])},
+            "fill": {p: self.run(lambda p=p: self.fill(p == "binary")) for p in protocols},
+            "commands_per_second": {m: self.run(lambda m=m: self.commands_per_second(m))
+                                    for m in ["ascii"] +
+                                    (["ascii_pipelined"] if self.c.tagged else []) + ["ascii_batch"] +
+                                    (["binary", "binary_batch"] if self.binary else [])},
+        }
+        if self.binary:
+            results["write_throughput"] = {"binary": self.run(self.write_block)}
+        text = self.run(self.text_fill)
+        if text is not None:
+            results["text_fill"] = text
+        blit = self.run(self.blit)
+        if blit is not None:
+            results["blit"] = blit
+        self.mode(True)
+        return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Papilio MCP serial/Wishbone benchmark")
+    parser.add_argument("--port", help="Serial port (e.g., COM4)", default=None)
+    parser.add_argument("--baud", type=int, help="Baud rate", default=115200)
+    parser.add_argument("--protocol", choices=["auto", "ascii"], default="auto",
+                        help="ascii = skip the binary protocol runs")
+    parser.add_argument("--scratch", default="1000",
+                        help="Hex address of 4 KB of RAM the benchmark may overwrite")
+    parser.add_argument("--lanes", type=int, default=4,
+                        help="Bytes per scratch RAM slot (4 = framebuffer, 1 = byte RAM)")
+    parser.add_argument("--iterations", type=int, default=200,
+                        help="Round trips per latency measurement")
+    parser.add_argument("--label", default="", help="Free text stored in the report (build variant)")
+    parser.add_argument("--output", help="Write the JSON report here instead of stdout")
+    parser.add_argument("--budget", help="JSON file of latency/throughput limits to enforce")
+    args = parser.parse_args()
+    budget = load_budget(args.budget) if args.budget else None
+
+    controller = PapilioController(args.port, args.baud, args.protocol)
+    if not controller.connect():
+        sys.stderr.write("Could not connect to the board\n")
+        return 1
+
+    bench = Benchmark(controller, int(args.scratch, 16), args.iterations, max(args.lanes, 1))
+    firmware = {"binary": bench.binary, "tags": controller.tagged, "stats": bench.stats}
+    if bench.stats:
+        stats = controller.get_stats()
+        firmware["cpu_mhz"] = stats["cpu_mhz"]
+        firmware["spi_hz"] = stats["spi_hz"]
+
+    started = time.time()
+    results = bench.all()
+    firmware["text_engine"] = bool(controller.text_engine)
+    report = {
+        "version": REPORT_VERSION,
+        "label": args.label,
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime(started)),
+        "duration_s": round(time.time() - started, 1),
+        "host": {"platform": platform.platform(), "python": platform.python_version(),
+                 "port": controller.serial.port, "baud": args.baud},
+        "config": {"scratch": f"0x{bench.scratch:04X}", "lanes": bench.lanes,
+                   "iterations": args.iterations,
+                   "block_size": BLOCK_SIZE, "fill_count": FILL_COUNT,
+                   "cps_commands": CPS_COMMANDS},
+        "firmware": firmware,
+        "results": results,
+    }
+    controller.disconnect()
+    failures = check_budget(report, budget) if budget else []
+    if budget:
+        report["failures"] = failures
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+        sys.stderr.write(f"Report written to {args.output}\n")
+    else:
+        print(text)
+    for failure in failures:
+        sys.stderr.write(f"FAIL {failure}\n")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Papilio MCP Size Report
+=======================
+Builds examples/mcp_size_report with arduino-cli in several configurations
+and writes the flash (text) and RAM (data) sizes as JSON:
+
+- baseline:  the sketch without PapilioMCP.h
+- disabled:  the header included, PAPILIO_MCP_ENABLED not defined
+- default:   PAPILIO_MCP_ENABLED alone (optional features at their defaults)
+- full:      every optional feature switched on
+- no_<x>:    full with one MCP_ENABLE_<X> switch off, so cost of x = full - no_<x>
+- minimal:   full with every optional feature off
+- stats:     full with MCP_ENABLE_STATS=1
+
+The disabled build must be byte-for-byte the baseline; the script exits
+with status 1 when it is not, or when a --budget limit is exceeded.
+
+A budget is a JSON object of dotted report paths to limits. A number is a
+maximum, or give {"min": ..} and/or {"max": ..}:
+
+    {"costs.full.flash": 65536, "costs.full.ram": 8192}
+
+mcp_benchmark.py takes the same --budget format for its latency results.
+
+Usage:
+    python mcp_size_report.py --fqbn esp32:esp32:esp32s3 [--output size.json]
+                              [--budget budget.json] [--only full disabled]
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+REPORT_VERSION = 1
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SKETCH = os.path.join(REPO, "examples", "mcp_size_report")
+
+# Optional features, each with its MCP_ENABLE_<X> switch (only CACHE defaults on)
+FEATURES = ["CACHE", "TELEMETRY", "EVENTS", "WATCH", "TEXT", "LA", "SNAPSHOT", "JTAG_PROG"]
+
+
+def variants() -> dict:
+    """Variant name -> compiler flags."""
+    default = ["-DPAPILIO_MCP_ENABLED"]
+    
+    def switches(off=()) -> list:
+        # One -D per switch, so no variant redefines a macro
+        return default + [f"-DMCP_ENABLE_{f}={0 if f in off else 1}" for f in FEATURES]
+    
+    full = switches()
+    result = {
+        "baseline": ["-DSIZE_BASELINE"],
+        "disabled": [],
+        "default": default,
+        "full": full,
+    }
+    for feature in FEATURES:
+        result[f"no_{feature.lower()}"] = switches([feature])
+    result["minimal"] = switches(FEATURES)
+    result["stats"] = full + ["-DMCP_ENABLE_STATS=1"]
+    return result
+
+
+def section_sizes(output: dict) -> dict:
+    """text/data sizes from arduino-cli's JSON (builder_result in newer releases)."""
+    sections = output.get("builder_result", output).get("executable_sections_size") or []
+    sizes = {s["name"]: s["size"] for s in sections}
+    if "text" not in sizes:
+        return None
+    return {"flash": sizes["text"], "ram": sizes.get("data", 0)}
+
+
+def build(cli: str, fqbn: str, flags: list, build_path: str) -> dict:
+    # The header sits flat in src/, so that folder is the library root
+    cmd = [cli, "compile", "--fqbn", fqbn, "--library", os.path.join(REPO, "src"),
+           "--build-path", build_path, "--format", "json",
+           "--build-property", "compiler.cpp.extra_flags=" + " ".join(flags), SKETCH]
+    proc = subprocess.run(cmd, capture_output=True, text=True)
+    try:
+        output = json.loads(proc.stdout)
+    except ValueError:
+        output = {}
+    sizes = section_sizes(output) if proc.returncode == 0 else None
+    if sizes is None:
+        error = output.get("compiler_err") or proc.stderr or proc.stdout
+        return {"flags": flags, "error": error.strip().splitlines()[-1:] or ["build failed"]}
+    return {"flags": flags, **sizes}
+
+
+def delta(a: dict, b: dict) -> dict:
+    """Size of a over b; None when either build failed."""
+    if a is None or b is None or "error" in a or "error" in b:
+        return None
+    return {"flash": a["flash"] - b["flash"], "ram": a["ram"] - b["ram"]}
+
+
+def costs(builds: dict) -> dict:
+    base = builds.get("baseline")
+    full = builds.get("full")
+    result = {}
+    for name in ("disabled", "default", "full", "minimal"):
+        if name in builds:
+            result[name] = delta(builds[name], base)
+    if "stats" in builds:
+        result["stats"] = delta(builds["stats"], full)
+    features = {f.lower(): delta(full, builds.get(f"no_{f.lower()}"))
+                for f in FEATURES if f"no_{f.lower()}" in builds}
+    if features:
+        result["features"] = features
+    return result
+
+
+def lookup(report: dict, path: str):
+    value = report
+    for key in path.split("."):
+        if not isinstance(value, dict) or key not in value:
+            return None
+        value = value[key]
+    return value
+
+
+def check_budget(report: dict, budget: dict) -> list:
+    """Budget violations in report, as readable strings (empty list = pass)."""
+    failures = []
+    for path, limit in budget.items():
+        if not isinstance(limit, dict):
+            limit = {"max": limit}
+        value = lookup(report, path)
+        if not isinstance(value, (int, float)):
+            failures.append(f"{path}: no value in report")
+            continue
+        if "max" in limit and value > limit["max"]:
+            failures.append(f"{path} = {value} > max {limit['max']}")
+        if "min" in limit and value < limit["min"]:
+            failures.append(f"{path} = {value} < min {limit['min']}")
+    return failures
+
+
+def load_budget(path: str) -> dict:
+    with open(path) as f:
+        return json.load(f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Papilio MCP flash/RAM size report")
+    parser.add_argument("--fqbn", default="esp32:esp32:esp32s3", help="Board to build for")
+    parser.add_argument("--cli", default="arduino-cli", help="arduino-cli executable")
+    parser.add_argument("--only", nargs="+", metavar="VARIANT",
+                        help="Build these variants only (baseline is always built)")
+    parser.add_argument("--budget", help="JSON file of size limits to enforce")
+    parser.add_argument("--output", help="Write the JSON report here instead of stdout")
+    args = parser.parse_args()
+
+    todo = variants()
+    if args.only:
+        unknown = [v for v in args.only if v not in todo]
+        if unknown:
+            sys.stderr.write(f"Unknown variants: {', '.join(unknown)}\n")
+            return 1
+        todo = {k: v for k, v in todo.items() if k == "baseline" or k in args.only}
+
+    started = time.time()
+    builds = {}
+    with tempfile.TemporaryDirectory(prefix="mcp_size_") as tmp:
+        for name, flags in todo.items():
+            sys.stderr.write(f"Building {name}...\n")
+            builds[name] = build(args.cli, args.fqbn, flags, os.path.join(tmp, name))
+
+    report = {
+        "version": REPORT_VERSION,
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime(started)),
+        "duration_s": round(time.time() - started, 1),
+        "fqbn": args.fqbn,
+        "builds": builds,
+        "costs": costs(builds),
+    }
+
+    failures = [f"{name}: {b['error'][0]}" for name, b in builds.items() if "error" in b]
+    zero = report["costs"].get("disabled")
+    if zero is not None and zero != {"flash": 0, "ram": 0}:
+        failures.append(f"disabled build is not zero-cost: {zero}")
+    if args.budget:
+        failures += check_budget(report, load_budget(args.budget))
+    report["failures"] = failures
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+        sys.stderr.write(f"Report written to {args.output}\n")
+    else:
+        print(text)
+    for failure in failures:
+        sys.stderr.write(f"FAIL {failure}\n")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
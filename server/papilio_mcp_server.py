@@ -9,11 +9,11 @@ Features:
 - RGB LED control (set colors, get status)
 - Wishbone bus read/write access
 - Framebuffer operations
-- JTAG bridge control
+- JTAG bridge control and FPGA programming over the serial link
 - Screenshot capture from webcam
 
 Usage:
-    python papilio_mcp_server.py [--port COM4] [--baud 115200]
+    python papilio_mcp_server.py [--port COM4] [--baud 115200] [--protocol auto]
 """
 
 import sys
@@ -25,7 +25,11 @@ from typing import Optional
 import argparse
 import base64
 import os
+import re
 import time
+import threading
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
 from logic_analyzer_tool import LogicAnalyzerTool
 
 # Try to import OpenCV for webcam support
@@ -38,13 +42,495 @@ except ImportError:
 # MCP Protocol version
 MCP_VERSION = "2024-11-05"
 
+# Binary framed protocol (see PapilioMCP.h)
+BIN_SYNC = 0xA5
+BIN_OP_PING = 0x00
+BIN_OP_READ = 0x01
+BIN_OP_WRITE = 0x02
+BIN_OP_READ_FIXED = 0x03
+BIN_OP_WRITE_FIXED = 0x04
+BIN_OP_BATCH = 0x05
+BIN_OP_POLL = 0x06
+BIN_OP_SUBSCRIBE = 0x07
+BIN_OP_JTAG = 0x08
+BIN_OP_JTAG_DATA = 0x09
+BIN_OP_EVENTS = 0x0A
+BIN_ST_OK = 0x00
+BIN_ST_TELEMETRY = 0x80   # Unsolicited sample record, ADDR = sequence number
+BIN_ST_EVENT = 0x81       # Unsolicited event, ADDR = sequence number, COUNT = kind
+BIN_ST_TIMEOUT = 0x04
+
+# Batch op encoding inside a BATCH frame (MCP_BATCH_* in PapilioMCP.h)
+BATCH_WRITE = 0x01
+BATCH_WRITE_FIXED = 0x02
+BATCH_READ = 0x03
+BATCH_POLL = 0x04
+BATCH_DELAY = 0x05
+BATCH_FILL = 0x06
+BATCH_LINE_MAX = 200    # Characters per ASCII Q line (firmware buffers 256)
+BATCH_RESULT_MAX = 250  # Result bytes per batch round trip
+BIN_MAX_PAYLOAD = 250    # Default; the PING reply gives the firmware's own
+
+# Text screen (80x26 cells behind the character port)
+TEXT_COLS = 80
+TEXT_ROWS = 26
+TEXT_CURSOR_X = 0x0021  # CURSOR_Y and ATTR follow at +1, +2
+TEXT_CHAR_PORT = 0x0024
+
+# Framebuffer: 160x120 RGB332, one 4-byte slot per pixel in a 32 KB window
+FB_WIDTH = 160
+FB_HEIGHT = 120
+FB_WINDOW = 0x8000
+
+# Blit stream tokens (B command, full firmware): count = (token & 0x3F) + 1
+BLIT_LITERAL = 0x00     # count colour bytes follow
+BLIT_RUN = 0x40         # next byte repeated count times
+BLIT_SKIP = 0x80        # count pixels unchanged
+BLIT_SKIP64 = 0xC0      # count * 64 pixels unchanged
+BLIT_MAX = 0xFFFF       # Stream bytes per B command
+
+# Streaming dump (X command)
+STREAM_MAX = 0xFFFF     # Bytes per X command (16-bit length)
+
+# Register map: the D dump names each range as "--- NAME (0xSSSS-0xEEEE) ---"
+REGISTER_RANGE = re.compile(r"^--- (\w+) \(0x([0-9A-Fa-f]{4})-0x([0-9A-Fa-f]{4})\) ---$")
+VIDEO_MODE_DEFAULT = 0x0000  # Modular gateware, used when the dump has no VIDEO_MODE
+
+# Instrumentation (Z command, firmware built with MCP_ENABLE_STATS=1)
+STATS_LOG2_MIN = 10     # Histogram bucket i counts 2^(i+10)..2^(i+11) cycles
+
+# One line of the B site list: "B 01 name EN hits=3 after=0 if 8100&FF==07"
+BREAKPOINT_SITE = re.compile(r"^B ([0-9A-F]{2}) (\S+) (EN|OFF) hits=(\d+) after=(\d+)"
+                             r"(?: if ([0-9A-F]{4})&([0-9A-F]{2})==([0-9A-F]{2}))?$")
+
+# Register watchpoints (V command): "V 01 0000 FF ANY P hits=2 last=03"
+WATCH_ENTRY = re.compile(r"^V ([0-9A-F]{2}) ([0-9A-F]{4}) ([0-9A-F]{2}) (?:ANY|=([0-9A-F]{2}))( P)?"
+                         r" hits=(\d+) last=([0-9A-F]{2})$")
+WATCH_STATUS = re.compile(r"^OK V (\d+) @ (\d+)us samples=(\d+) dropped=(\d+)$")
+
+# Register snapshots (N command)
+SNAPSHOT_SLOT = re.compile(r"^N (\d+) (?:VALID CRC=([0-9A-F]{4})|EMPTY)$")
+SNAPSHOT_RANGE = re.compile(r"^N RANGE (\S+) ([0-9A-F]{4}) ([0-9A-F]{4})$")
+SNAPSHOT_INFO = re.compile(r"^OK N (\d+) SLOTS ([0-9A-F]{4}) BYTES LAYOUT=([0-9A-F]{4})$")
+SNAPSHOT_UPLOAD = 64     # Bytes per N W line
+SNAPSHOT_VERSION = 1     # Snapshot file format
+
+# Camera stream (WebcamCapture.start_stream)
+CAMERA_RING = 4             # Newest frames kept by the capture thread
+CAMERA_FRESH_SKIP = 1       # Frames dropped after a fresh request (exposure overlap)
+CAMERA_FRAME_TIMEOUT = 1.0  # Seconds to wait for a stream frame
+CAMERA_READ_FAILURES = 30   # Failed reads in a row that end the stream
+CAMERA_DIFF_THRESHOLD = 24  # Grey-level change that counts (above sensor noise)
+CAMERA_DIFF_MIN_AREA = 16   # Changed boxes smaller than this (pixels) are noise
+
+# Telemetry subscription (SUBSCRIBE frame)
+TELEMETRY_MAX_ADDRS = 16
+TELEMETRY_MIN_PERIOD_US = 100
+TELEMETRY_DEPTH = 1000  # Samples kept on the host by default
+
+# Tagged, pipelined ASCII commands ("#II cmd")
+PIPELINE_WINDOW = 8      # Tagged commands in flight at once
+TAG_MAX = 0xFFF          # Tags cycle through 1..TAG_MAX
+REPLY_TIMEOUT = 5.0      # Seconds to wait for a tagged reply's end line
+NOTIFICATION_DEPTH = 100 # Unsolicited breakpoint lines kept
+SERIAL_RX_BUFFER = 1 << 16  # Driver receive buffer where settable (Windows)
+
+# Event frames (EVENTS frame): COUNT of the request is a mask, bit kind-1
+EVENT_BREAK = 0x01       # SITE BP[2] HITS[4]
+EVENT_CONTINUE = 0x02    # SITE BP[2]
+EVENT_PAUSE = 0x03
+EVENT_RESUME = 0x04
+EVENT_JTAG = 0x05        # STATE
+EVENT_WATCH = 0x06       # ADDR[2] OLD NEW
+EVENT_ALL = 0x3F
+EVENT_NAMES = {EVENT_BREAK: "breakpoint", EVENT_CONTINUE: "continue", EVENT_PAUSE: "pause",
+               EVENT_RESUME: "resume", EVENT_JTAG: "jtag", EVENT_WATCH: "watch"}
+EVENT_KINDS = {name: kind for kind, name in EVENT_NAMES.items()}
+STATE_PAUSED = 0x01
+STATE_BREAKPOINT = 0x02
+STATE_BP_ENABLED = 0x04
+JTAG_STATES = {0: "off", 1: "bridge", 2: "programming"}
+EVENT_WAIT_MAX = 300.0   # Seconds a wait_for_event call may block
+
+# JTAG programming (JTAG/JTAG_DATA frames): actions are the JTAG frame's COUNT
+JTAG_RELEASE = 0x00
+JTAG_ACQUIRE = 0x01      # Returns the IDCODE, little-endian
+JTAG_IR = 0x02
+JTAG_DR = 0x03
+JTAG_IDLE = 0x04
+JTAG_FIRST = 0x01        # JTAG_DATA flags
+JTAG_LAST = 0x02
+JTAG_RUN_MIN = 3         # Packed runs: control 0x80 + (n - 3), then the byte
+JTAG_RUN_MAX = 130
+JTAG_LITERAL_MAX = 128   # Packed literals: control n - 1, then n bytes
+JTAG_WINDOW = 2          # JTAG_DATA chunks in flight (fits the device RX buffer)
+JTAG_CHUNK_TIMEOUT = 2.0
+
+# Gowin SRAM configuration over JTAG (the sequence openFPGALoader uses)
+GOWIN_IR_BITS = 8
+GOWIN_NOOP = 0x02
+GOWIN_ERASE_SRAM = 0x05
+GOWIN_XFER_DONE = 0x09
+GOWIN_INIT_ADDR = 0x12
+GOWIN_CONFIG_ENABLE = 0x15
+GOWIN_XFER_WRITE = 0x17
+GOWIN_CONFIG_DISABLE = 0x3A
+GOWIN_STATUS = 0x41
+GOWIN_STATUS_CRC_ERROR = 1 << 0
+GOWIN_STATUS_DONE = 1 << 13
+GOWIN_ERASE_S = 0.01     # TN653: 4 ms or more after ERASE_SRAM
+
+
+def crc16(data: bytes, crc: int = 0xFFFF) -> int:
+    """CRC-16/CCITT-FALSE (poly 0x1021) as used by the X dump trailer."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def crc8(data: bytes, crc: int = 0x00) -> int:
+    """CRC-8 (poly 0x07, init 0x00) as used by the binary frames."""
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class PendingReply:
+    """A tagged command in flight; the reader thread fills in its lines."""
+    
+    def __init__(self, tag: str):
+        self.tag = tag
+        self.lines = []
+        self.done = threading.Event()
+    
+    def result(self, timeout: float = 2.0) -> str:
+        """Reply lines without the tag, "No response" on timeout."""
+        self.done.wait(timeout)
+        return "\n".join(self.lines) if self.lines else "No response"
+
+
+class SerialReader:
+    """Owns the serial port while connected.
+    
+    A background thread reads everything the board sends:
+    - lines tagged "#II" go to the PendingReply with that tag, so replies to
+      pipelined commands never pass through the shared input buffer
+    - telemetry frames go into a ring of the latest samples while a
+      subscription runs
+    - unsolicited notifications (breakpoints) are kept in a log that
+      reset_input_buffer() does not clear; with event frames enabled the
+      log is filled from the frames and the text messages are skipped
+    - everything else (untagged lines, response frames) is queued for the
+      lock-step readers
+    It offers the subset of the pyserial API the controller uses, so those
+    readers work unchanged.
+    """
+    
+    NOTIFICATION = re.compile(rb"^\[MCP\] (BREAKPOINT|Continuing|WATCH)")
+    
+    def __init__(self, port: serial.Serial):
+        self.raw = port
+        self.timeout = port.timeout
+        self.notifications = deque(maxlen=NOTIFICATION_DEPTH)
+        self.events = deque(maxlen=NOTIFICATION_DEPTH)   # (number, event)
+        self.event_count = 0          # Events received
+        self.event_read = 0           # Events wait_event has gone past
+        self.on_event = None          # Called with each event, on the reader thread
+        self._events = False
+        self.addresses = []
+        self.samples = deque(maxlen=TELEMETRY_DEPTH)
+        self.received = 0
+        self.lost = 0
+        self._telemetry = False
+        self._next_seq = None
+        self._rx = bytearray()
+        self._line = bytearray()      # Text line being assembled
+        self._pending = bytearray()   # Partial frame being assembled
+        self._replies = {}            # tag -> PendingReply
+        self._cv = threading.Condition()
+        self._running = True
+        port.timeout = 0.02
+        self._thread = threading.Thread(target=self._run, name="serial-reader", daemon=True)
+        self._thread.start()
+    
+    @property
+    def is_open(self) -> bool:
+        return self.raw.is_open
+    
+    @property
+    def port(self) -> str:
+        return self.raw.port
+    
+    @property
+    def in_waiting(self) -> int:
+        with self._cv:
+            return len(self._rx)
+    
+    def _run(self):
+        while self._running:
+            try:
+                data = self.raw.read(max(1, self.raw.in_waiting))
+            except Exception:
+                break
+            if data:
+                self._feed(data)
+    
+    def _feed(self, data: bytes):
+        """Split a read into frames and lines, a run at a time rather than per byte."""
+        out = bytearray()
+        pos, end = 0, len(data)
+        while pos < end:
+            if self._pending:
+                size = self._pending[1] + 3 if len(self._pending) >= 2 else 2
+                take = data[pos:pos + size - len(self._pending)]
+                self._pending.extend(take)
+                pos += len(take)
+                if len(self._pending) >= 2 and len(self._pending) == self._pending[1] + 3:
+                    frame = bytes(self._pending)
+                    self._pending.clear()
+                    self._frame(frame, out)
+                continue
+            sync = data.find(BIN_SYNC, pos)
+            stop = end if sync < 0 else sync
+            while pos < stop:
+                nl = data.find(b"\n", pos, stop)
+                if nl < 0:
+                    self._line.extend(data[pos:stop])
+                    break
+                self._line.extend(data[pos:nl + 1])
+                pos = nl + 1
+                line = bytes(self._line)
+                self._line.clear()
+                if not self._route(line):
+                    out.extend(line)
+            pos = stop
+            if sync >= 0:
+                self._pending.append(BIN_SYNC)
+                pos += 1
+        if out:
+            with self._cv:
+                self._rx.extend(out)
+                self._cv.notify_all()
+    
+    def _frame(self, frame: bytes, out: bytearray):
+        if frame[2] == BIN_ST_TELEMETRY and crc8(frame[1:-1]) == frame[-1]:
+            if self._telemetry:
+                self._record(frame)
+        elif frame[2] == BIN_ST_EVENT and crc8(frame[1:-1]) == frame[-1]:
+            self._event(frame)
+        else:
+            out.extend(frame)   # A response frame for _read_frame
+    
+    def _route(self, line: bytes) -> bool:
+        """Hand a tagged line to its reply. False if it is not tagged."""
+        text = line.strip()
+        if not self._events and self.NOTIFICATION.match(text):
+            self.notifications.append((time.time(), text.decode("utf-8", errors="ignore")))
+        if not text.startswith(b"#"):
+            return False
+        tag, _, rest = text.partition(b" ")
+        with self._cv:
+            reply = self._replies.get(tag.decode("ascii", errors="ignore"))
+            if reply is None:
+                return False
+            if rest:
+                reply.lines.append(rest.decode("utf-8", errors="ignore"))
+            else:
+                del self._replies[reply.tag]
+                reply.done.set()
+        return True
+    
+    def _record(self, frame: bytes):
+        seq = (frame[3] << 8) | frame[4]
+        count = frame[5]
+        payload = frame[6:-1]
+        if self._next_seq is not None:
+            self.lost += (seq - self._next_seq) & 0xFFFF
+        self._next_seq = (seq + 1) & 0xFFFF
+        self.received += 1
+        values = payload[4:4 + count]
+        self.samples.append({
+            "seq": seq,
+            "time_us": int.from_bytes(payload[:4], "big"),
+            "values": {addr: values[i] for i, addr in enumerate(self.addresses[:count])},
+        })
+    
+    @staticmethod
+    def decode_event(frame: bytes) -> dict:
+        """One event frame as a dict with its kind's fields and a text line."""
+        kind = frame[5]
+        payload = frame[6:-1]
+        data = payload[4:]
+        event = {
+            "seq": (frame[3] << 8) | frame[4],
+            "event": EVENT_NAMES.get(kind, f"0x{kind:02X}"),
+            "time_us": int.from_bytes(payload[:4], "big"),
+        }
+        if kind in (EVENT_BREAK, EVENT_CONTINUE) and len(data) >= 3:
+            event["site"] = data[0]
+            event["breakpoint"] = (data[1] << 8) | data[2]
+            if kind == EVENT_BREAK and len(data) >= 7:
+                event["hits"] = int.from_bytes(data[3:7], "big")
+                event["text"] = (f"BREAKPOINT #{event['breakpoint']} (site {data[0]:02X}, "
+                                 f"hit {event['hits']})")
+            else:
+                event["text"] = f"Continuing from breakpoint #{event['breakpoint']}"
+        elif kind == EVENT_JTAG and data:
+            event["state"] = JTAG_STATES.get(data[0], str(data[0]))
+            event["text"] = f"JTAG {event['state']}"
+        elif kind == EVENT_WATCH and len(data) >= 4:
+            event.update(address=(data[0] << 8) | data[1], old=data[2], new=data[3])
+            event["text"] = f"WATCH 0x{event['address']:04X} {data[2]:02X} -> {data[3]:02X}"
+        else:
+            event["text"] = {EVENT_PAUSE: "Sketch PAUSED", EVENT_RESUME: "Sketch RESUMED"}.get(
+                kind, f"Event {event['event']}")
+        return event
+    
+    def _event(self, frame: bytes):
+        event = self.decode_event(frame)
+        self.notifications.append((time.time(), event["text"]))
+        with self._cv:
+            self.event_count += 1
+            self.events.append((self.event_count, event))
+            self._cv.notify_all()
+        if self.on_event:
+            self.on_event(event)
+    
+    def start_events(self):
+        """Take notifications from event frames instead of the text lines."""
+        self._events = True
+    
+    def wait_event(self, kinds: set, timeout: float) -> Optional[dict]:
+        """First event of one of kinds (names, any when empty) not waited past yet.
+        
+        Events that arrived since the previous wait count, so nothing sent
+        between two calls is missed; the ones skipped over are consumed.
+        """
+        deadline = time.time() + timeout
+        with self._cv:
+            while True:
+                for number, event in self.events:
+                    if number <= self.event_read:
+                        continue
+                    self.event_read = number
+                    if not kinds or event["event"] in kinds:
+                        return event
+                left = deadline - time.time()
+                if left <= 0 or not self._running:
+                    return None
+                self._cv.wait(left)
+    
+    def start_telemetry(self, addresses: list, depth: int):
+        self.addresses = list(addresses)
+        self.samples = deque(maxlen=depth)
+        self.received = 0
+        self.lost = 0
+        self._next_seq = None
+        self._telemetry = True
+    
+    def stop_telemetry(self):
+        self._telemetry = False
+    
+    def expect(self, tag: str) -> PendingReply:
+        """Register a reply before its command is written."""
+        reply = PendingReply(tag)
+        with self._cv:
+            self._replies[tag] = reply
+        return reply
+    
+    def forget(self, reply: PendingReply):
+        with self._cv:
+            self._replies.pop(reply.tag, None)
+    
+    def read(self, size: int = 1) -> bytes:
+        deadline = time.time() + (self.timeout or 0)
+        with self._cv:
+            while len(self._rx) < size and self._cv.wait(max(0, deadline - time.time())):
+                pass
+            data = bytes(self._rx[:size])
+            del self._rx[:size]
+            return data
+    
+    def readline(self) -> bytes:
+        deadline = time.time() + (self.timeout or 0)
+        with self._cv:
+            while b"\n" not in self._rx and self._cv.wait(max(0, deadline - time.time())):
+                pass
+            end = self._rx.find(b"\n") + 1 or len(self._rx)
+            data = bytes(self._rx[:end])
+            del self._rx[:end]
+            return data
+    
+    def skip_to(self, byte: int, timeout: float) -> bool:
+        """Drop queued input up to the next byte; False if none came in time."""
+        deadline = time.time() + timeout
+        with self._cv:
+            while True:
+                at = self._rx.find(byte)
+                if at >= 0:
+                    del self._rx[:at]
+                    return True
+                self._rx.clear()
+                left = deadline - time.time()
+                if left <= 0 or not self._running:
+                    return False
+                self._cv.wait(left)
+    
+    def write(self, data: bytes) -> int:
+        return self.raw.write(data)
+    
+    def flush(self):
+        self.raw.flush()
+    
+    def reset_input_buffer(self):
+        """Drop queued untagged output; tagged replies and the log are kept."""
+        with self._cv:
+            self._rx.clear()
+    
+    def close(self):
+        self._running = False
+        self._thread.join()
+        self.raw.timeout = self.timeout
+        self.raw.close()
+
+
 class PapilioController:
     """Controls the Papilio Arcade board via serial commands."""
     
-    def __init__(self, port: str = None, baud: int = 115200):
+    def __init__(self, port: str = None, baud: int = 115200, protocol: str = "auto"):
         self.port = port
         self.baud = baud
         self.serial: Optional[serial.Serial] = None
+        # "auto" probes for the binary protocol on connect, "ascii" never uses it
+        self.protocol = protocol
+        self.binary = False
+        # Payload bytes per frame the firmware accepts (from the PING reply)
+        self.bin_payload = BIN_MAX_PAYLOAD
+        # Firmware text engine (E command): None until the first attempt
+        self.text_engine: Optional[bool] = None
+        # Last frame sent with framebuffer_blit, for delta coding (None = unknown)
+        self.fb_shadow: Optional[bytearray] = None
+        # B is the blit command (full firmware) and not breakpoints
+        # (PapilioMCP.h): None until the help listing has been checked
+        self.blit: Optional[bool] = None
+        self.telemetry: Optional[SerialReader] = None
+        # Firmware answers "#II" tagged commands (probed on connect)
+        self.tagged = False
+        self.window = PIPELINE_WINDOW
+        self._tag = 0
+        # Register ranges from the firmware's D dump: name -> (start, length)
+        self.registers: Optional[dict] = None
+        self.logic_analyzer: Optional[LogicAnalyzerTool] = None
+        # Firmware pushes event frames (EVENTS frame, probed on connect);
+        # state follows them: paused, breakpoint, breakpoints_enabled, jtag
+        self.events = False
+        self.state: dict = {}
+        # Called with (controller, event) for every event frame
+        self.event_sink = None
         
     def find_port(self) -> Optional[str]:
         """Auto-detect the Papilio board COM port."""
@@ -65,9 +551,15 @@ class PapilioController:
             return False
             
         try:
-            self.serial = serial.Serial(port, self.baud, timeout=0.5)
+            raw = serial.Serial(port, self.baud, timeout=0.5)
+            if hasattr(raw, "set_buffer_size"):
+                raw.set_buffer_size(rx_size=SERIAL_RX_BUFFER)   # Room for USB-speed bursts
             # Clear any pending data
-            self.serial.reset_input_buffer()
+            raw.reset_input_buffer()
+            self.serial = SerialReader(raw)
+            self.binary = self.protocol != "ascii" and self.probe_binary()
+            self.tagged = self.probe_tags()
+            self.events = self.binary and self.enable_events()
             return True
         except Exception as e:
             self.serial = None
@@ -78,11 +570,196 @@ class PapilioController:
         if self.serial:
             self.serial.close()
             self.serial = None
+        self.telemetry = None
+        self.binary = False
+        self.tagged = False
+        self.events = False
+        self.state = {}
+        self.text_engine = None
+        self.fb_shadow = None
+        self.blit = None
+        self.registers = None
+    
+    def probe_binary(self) -> bool:
+        """Check whether the firmware speaks the binary protocol.
+        
+        Firmware without it treats the PING frame as a garbage text line, so
+        a newline is sent after it and any text reply is discarded.
+        """
+        try:
+            self._write_frame(BIN_OP_PING)
+            self.serial.write(b"\n")
+            self.serial.flush()
+            reply = self._read_frame(timeout=0.3)
+            time.sleep(0.05)
+            self.serial.reset_input_buffer()
+            if reply is None or reply[0] != BIN_ST_OK:
+                return False
+            # Info: VERSION MAX_PAYLOAD
+            self.bin_payload = reply[3][1] if len(reply[3]) >= 2 and reply[3][1] else BIN_MAX_PAYLOAD
+            return True
+        except Exception:
+            return False
+    
+    def probe_tags(self) -> bool:
+        """Check whether the firmware answers tagged commands.
+        
+        A bare tag is an empty command: tag-aware firmware replies with just
+        the end line, older firmware with an error that is discarded.
+        """
+        reply = self.request("")
+        if reply is None:
+            return False
+        ok = reply.done.wait(0.3)
+        self.serial.forget(reply)
+        time.sleep(0.05)
+        self.serial.reset_input_buffer()
+        return ok
+    
+    def enable_events(self, mask: int = EVENT_ALL) -> bool:
+        """Have the firmware push event frames; False if it has none.
+        
+        The reply carries the current state, so pause_status() needs no round
+        trip from then on.
+        """
+        self.serial.on_event = self._on_event
+        reply = self.send_frame(BIN_OP_EVENTS, 0, mask)
+        if reply is None or reply[0] != BIN_ST_OK or len(reply[3]) < 4:
+            self.serial.on_event = None
+            return False
+        flags, jtag = reply[3][0], reply[3][1]
+        self.state = {
+            "paused": bool(flags & STATE_PAUSED),
+            "breakpoint": ((reply[3][2] << 8) | reply[3][3]) if flags & STATE_BREAKPOINT else None,
+            "breakpoints_enabled": bool(flags & STATE_BP_ENABLED),
+            "jtag": JTAG_STATES.get(jtag, str(jtag)),
+        }
+        self.serial.start_events()
+        return True
+    
+    def _on_event(self, event: dict):
+        """Keep state in step with the board (reader thread)."""
+        kind = event["event"]
+        if kind == "breakpoint":
+            self.state.update(paused=True, breakpoint=event["breakpoint"], site=event["site"])
+        elif kind in ("continue", "resume"):
+            self.state.update(paused=False, breakpoint=None, site=None)
+        elif kind == "pause":
+            self.state["paused"] = True
+        elif kind == "jtag":
+            self.state["jtag"] = event["state"]
+        if self.event_sink:
+            self.event_sink(self, event)
+    
+    def pause_status(self) -> str:
+        """Sketch state from the events, or from the P command without them."""
+        if not self.events:
+            return self.send_command("P")
+        if self.state.get("breakpoint") is not None:
+            text = f"At breakpoint #{self.state['breakpoint']}"
+            if self.state.get("site") is not None:
+                text += f" (site {self.state['site']:02X})"
+        else:
+            text = "PAUSED" if self.state.get("paused") else "running"
+        return f"{text}, JTAG {self.state.get('jtag', 'off')}"
+    
+    def wait_event(self, kinds: Optional[list] = None, timeout: float = 10.0) -> Optional[dict]:
+        """Next event of one of kinds (any when empty), blocking up to timeout.
+        
+        None on timeout, or when the firmware sends no events.
+        """
+        if not self.events:
+            return None
+        return self.serial.wait_event(set(kinds or []), min(timeout, EVENT_WAIT_MAX))
+    
+    def request(self, cmd: str) -> Optional[PendingReply]:
+        """Send cmd with a fresh tag and return its PendingReply at once."""
+        if not self.connect():
+            return None
+        self._tag = self._tag % TAG_MAX + 1
+        tag = f"#{self._tag:X}"
+        reply = self.serial.expect(tag)
+        self.serial.write(f"{tag} {cmd}\n".encode() if cmd else f"{tag}\n".encode())
+        self.serial.flush()
+        return reply
+    
+    def send_commands(self, cmds: list, timeout: float = REPLY_TIMEOUT) -> list:
+        """Send several commands pipelined and return their replies in order.
+        
+        Up to self.window tagged commands are in flight at once, so the
+        serial round trip is paid about once per window, not per command.
+        Firmware without tags gets them one at a time.
+        """
+        if not self.connect():
+            return ["ERROR: Not connected to board"] * len(cmds)
+        if not self.tagged:
+            return [self.send_command(cmd) for cmd in cmds]
+        replies = []
+        in_flight = deque()
+        for cmd in cmds:
+            if len(in_flight) >= self.window:
+                replies.append(self._finish(in_flight.popleft(), timeout))
+            in_flight.append(self.request(cmd))
+        while in_flight:
+            replies.append(self._finish(in_flight.popleft(), timeout))
+        return replies
+    
+    def _finish(self, reply: PendingReply, timeout: float) -> str:
+        result = reply.result(timeout)
+        self.serial.forget(reply)
+        return result
+    
+    def notifications(self, clear: bool = True) -> list:
+        """Unsolicited breakpoint lines as (time, text), oldest first."""
+        if not self.serial:
+            return []
+        items = list(self.serial.notifications)
+        if clear:
+            self.serial.notifications.clear()
+        return items
+    
+    def _write_frame(self, op: int, address: int = 0, count: int = 0, payload: bytes = b""):
+        body = bytes([len(payload) + 4, op, (address >> 8) & 0xFF, address & 0xFF, count & 0xFF]) + payload
+        self.serial.write(bytes([BIN_SYNC]) + body + bytes([crc8(body)]))
+    
+    def _read_frame(self, timeout: float = 0.5):
+        """Read one response frame, skipping any text output before it.
+        
+        Returns (status, address, count, data) or None on timeout/bad CRC.
+        """
+        if not self.serial.skip_to(BIN_SYNC, timeout):
+            return None
+        header = self.serial.read(2)   # SYNC LEN
+        if len(header) < 2 or header[1] < 4:
+            return None
+        rest = self.serial.read(header[1] + 1)
+        if len(rest) != header[1] + 1:
+            return None
+        if crc8(header[1:] + rest[:-1]) != rest[-1]:
+            return None
+        return (rest[0], (rest[1] << 8) | rest[2], rest[3], rest[4:-1])
+    
+    def send_frame(self, op: int, address: int = 0, count: int = 0, payload: bytes = b"",
+                   timeout: float = 0.5):
+        """Send a binary frame and return (status, address, count, data) or None."""
+        if not self.connect():
+            return None
+        try:
+            self._write_frame(op, address, count, payload)
+            self.serial.flush()
+            return self._read_frame(timeout)
+        except Exception:
+            return None
     
     def send_command(self, cmd: str) -> str:
         """Send a command and read the response."""
         if not self.connect():
             return "ERROR: Not connected to board"
+        if self.tagged:
+            try:
+                return self._finish(self.request(cmd), REPLY_TIMEOUT)
+            except Exception as e:
+                return f"ERROR: {str(e)}"
         
         try:
             # Clear input buffer
@@ -115,35 +792,27 @@ class PapilioController:
         # RGB LED is at Wishbone address 0x8100-0x8103
         # Note: WS2812B uses GRB order
         # Address map: 0x8100=Green, 0x8101=Red, 0x8102=Blue, 0x8103=Status
-        results = []
-        results.append(self.send_command(f"W 8100 {green:02X}"))  # Green
-        results.append(self.send_command(f"W 8101 {red:02X}"))    # Red  
-        results.append(self.send_command(f"W 8102 {blue:02X}"))   # Blue
-        return "\n".join(results)
+        ok = self.wishbone_batch([("W", 0x8100, bytes([green, red, blue]))]) is not None
+        return f"OK W 8100-8102={green:02X} {red:02X} {blue:02X}" if ok else "ERR: write failed"
     
     def get_rgb_led(self) -> dict:
         """Get current RGB LED values."""
-        g = self.send_command("R 8100")  # Green
-        r = self.send_command("R 8101")  # Red
-        b = self.send_command("R 8102")  # Blue
-        
-        # Parse responses like "OK R 0000=FF"
-        def parse_value(resp):
-            try:
-                if "=" in resp:
-                    return int(resp.split("=")[1].strip(), 16)
-            except:
-                pass
-            return 0
-        
+        # One burst read of 0x8100-0x8102 (GRB order)
+        values = self.wishbone_read_block(0x8100, 3)
+        g, r, b = (values + [0, 0, 0])[:3]
         return {
-            "red": parse_value(r),
-            "green": parse_value(g),
-            "blue": parse_value(b)
+            "red": r,
+            "green": g,
+            "blue": b
         }
     
     def wishbone_read(self, address: int) -> int:
         """Read from Wishbone bus address."""
+        if self.connect() and self.binary:
+            reply = self.send_frame(BIN_OP_READ, address, 1)
+            if reply and reply[0] == BIN_ST_OK and reply[3]:
+                return reply[3][0]
+            return 0
         resp = self.send_command(f"R {address:04X}")
         try:
             if "=" in resp:
@@ -152,13 +821,900 @@ class PapilioController:
             pass
         return 0
     
+    def memory_written(self, address: Optional[int] = None):
+        """Note a write that did not go through framebuffer_blit.
+        
+        A write below FB_WINDOW, or one whose target is unknown (None: raw
+        commands, snapshot restores, FPGA programming), means fb_shadow no
+        longer matches the board, so the next blit cannot delta-code.
+        """
+        if address is None or address < FB_WINDOW:
+            self.fb_shadow = None
+    
     def wishbone_write(self, address: int, data: int) -> str:
         """Write to Wishbone bus address."""
+        self.memory_written(address)
+        if self.connect() and self.binary:
+            reply = self.send_frame(BIN_OP_WRITE, address, 1, bytes([data & 0xFF]))
+            if reply and reply[0] == BIN_ST_OK:
+                return f"OK W {address:04X}={data & 0xFF:02X}"
+            return f"ERR W {address:04X} (status {reply[0] if reply else 'timeout'})"
         return self.send_command(f"W {address:04X} {data:02X}")
     
+    def wishbone_read_block(self, address: int, count: int, fixed: bool = False) -> list:
+        """Read count bytes starting at address using burst transfers.
+        
+        fixed=True reads the same address count times (FIFO ports).
+        """
+        if self.connect() and self.binary:
+            op = BIN_OP_READ_FIXED if fixed else BIN_OP_READ
+            result = []
+            while count > 0:
+                n = min(count, self.bin_payload)
+                reply = self.send_frame(op, address, n)
+                if not reply or reply[0] != BIN_ST_OK:
+                    break
+                result.extend(reply[3])
+                if not fixed:
+                    address += n
+                count -= n
+            return result
+        if fixed:
+            replies = self.send_commands([f"R {address:04X}"] * count)
+            return [int(r.rsplit("=", 1)[1], 16) if "OK R" in r else 0 for r in replies]
+        # ASCII fallback: the M command returns up to 64 bytes per line
+        # (256 on current firmware, 64 keeps older builds working); tagged
+        # firmware gets all the lines pipelined
+        chunks = [(address + off, min(64, count - off)) for off in range(0, count, 64)]
+        result = []
+        for resp in self.send_commands([f"M {a:04X} {n:02X}" for a, n in chunks]):
+            line = next((l for l in resp.splitlines() if l.startswith("OK M")), None)
+            if line is None:
+                break
+            result.extend(int(b, 16) for b in line.split(":", 1)[1].split())
+        return result
+    
+    def wishbone_read_stream(self, address: int, count: int) -> list:
+        """Read a large block with the streaming X command.
+        
+        Chunks carry sequence numbers and the trailer carries a CRC-16, so a
+        dropped or corrupted line is detected instead of silently shifting
+        data. Falls back to wishbone_read_block on firmware without X.
+        """
+        if not self.connect():
+            return []
+        result = []
+        while count > 0:
+            n = min(count, STREAM_MAX)
+            chunk = self._read_stream_chunk(address, n)
+            if chunk is None:
+                return result + self.wishbone_read_block(address, count)
+            result.extend(chunk)
+            address = (address + n) & 0xFFFF
+            count -= n
+        return result
+    
+    def _read_stream_chunk(self, address: int, count: int) -> Optional[list]:
+        """One X AAAA LLLL transaction. None if X is unsupported or failed."""
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write(f"X {address:04X} {count:04X}\n".encode())
+            self.serial.flush()
+            
+            data = bytearray()
+            seq = 0
+            idle = 0
+            while idle < 2:
+                line = self.serial.readline().decode('ascii', errors='ignore').strip()
+                if not line:
+                    idle += 1
+                    continue
+                idle = 0
+                if line.startswith("OK X"):
+                    crc = int(line.rsplit("CRC=", 1)[1], 16)
+                    if len(data) != count or crc != crc16(data):
+                        return None
+                    return list(data)
+                if line.startswith("ERR") or "Unknown" in line:
+                    return None
+                if line.startswith("X") and " " in line:
+                    tag, hexdata = line[1:].split(" ", 1)
+                    if int(tag, 16) != seq:
+                        return None
+                    data.extend(bytes.fromhex(hexdata))
+                    seq = (seq + 1) & 0xFFFF
+            return None
+        except (ValueError, IndexError):
+            return None
+        except Exception:
+            return None
+    
+    def logic_analyzer_read(self, count: int) -> Optional[list]:
+        """Read count 32-bit samples of a finished capture with the L command.
+        
+        The firmware burst-reads the capture memory and sends one record per
+        run of identical samples, plus a CRC-16 over the raw samples. Returns
+        None on firmware without L, when the capture is not DONE, or when the
+        transfer fails; self.la_transfer holds the size of the last readout.
+        """
+        if not self.connect():
+            return None
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write(f"L {count:04X}\n".encode())
+            self.serial.flush()
+            
+            samples = []
+            value = 0
+            seq = 0
+            received = 0
+            idle = 0
+            while idle < 2:
+                line = self.serial.readline().decode('ascii', errors='ignore').strip()
+                if not line:
+                    idle += 1
+                    continue
+                idle = 0
+                received += len(line) + 1
+                if line.startswith("OK L"):
+                    _, _, n, records, crc = line.split()
+                    raw = b"".join(v.to_bytes(4, "little") for v in samples)
+                    if (len(samples) != count or int(n, 16) != count or
+                            int(crc.split("=", 1)[1], 16) != crc16(raw)):
+                        return None
+                    self.la_transfer = {"bytes": received, "records": int(records, 16),
+                                        "raw_bytes": count * 4}
+                    return samples
+                if line.startswith("ERR") or "Unknown" in line:
+                    return None
+                if line.startswith("L") and not line.startswith("L "):
+                    tag, *tokens = line.split()
+                    if int(tag[1:], 16) != seq:
+                        return None
+                    for token in tokens:
+                        record, _, run = token.partition("*")
+                        mask = int(record[0], 16)
+                        pos = 1
+                        for b in (3, 2, 1, 0):
+                            if mask & (1 << b):
+                                byte = int(record[pos:pos + 2], 16)
+                                value = (value & ~(0xFF << (8 * b))) | (byte << (8 * b))
+                                pos += 2
+                        samples.extend([value] * (int(run, 16) if run else 1))
+                    seq = (seq + 1) & 0xFFFF
+            return None
+        except (ValueError, IndexError):
+            return None
+        except Exception:
+            return None
+    
+    def wishbone_poll(self, address: int, mask: int, value: int,
+                      timeout: float = 1.0, interval_us: int = 0) -> dict:
+        """Wait on the device until (read(address) & mask) == value.
+        
+        The loop runs in the firmware (binary POLL frame or the A command), so
+        the host sees one reply instead of a round trip per read. Returns
+        {"ok", "value", "elapsed_us"}.
+        """
+        timeout_us = max(0, min(int(timeout * 1e6), 0xFFFFFFFF))
+        interval_us = max(0, min(int(interval_us), 0xFFFF))
+        if self.connect() and self.binary:
+            payload = bytes([mask & 0xFF, value & 0xFF]) + timeout_us.to_bytes(4, "big") + \
+                interval_us.to_bytes(2, "big")
+            reply = self.send_frame(BIN_OP_POLL, address, 0, payload, timeout + 0.5)
+            if reply and reply[0] in (BIN_ST_OK, BIN_ST_TIMEOUT) and len(reply[3]) == 5:
+                return {"ok": reply[0] == BIN_ST_OK, "value": reply[3][0],
+                        "elapsed_us": int.from_bytes(reply[3][1:], "big")}
+        elif self.connect():
+            reply = self._send_await(address, mask, value, timeout_us, interval_us, timeout + 1.0)
+            if reply is not None:
+                return reply
+        # Firmware without A: poll from the host
+        start = time.time()
+        while True:
+            current = self.wishbone_read(address)
+            elapsed = time.time() - start
+            if (current & mask) == value or elapsed >= timeout:
+                return {"ok": (current & mask) == value, "value": current,
+                        "elapsed_us": int(elapsed * 1e6)}
+            time.sleep(max(interval_us / 1e6, 0.001))
+    
+    def _send_await(self, address, mask, value, timeout_us, interval_us, wait) -> Optional[dict]:
+        """One A command. None if the firmware does not know it."""
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write(f"A {address:04X} {mask & 0xFF:02X} {value & 0xFF:02X} "
+                              f"{timeout_us:X} {interval_us:X}\n".encode())
+            self.serial.flush()
+            deadline = time.time() + wait
+            while time.time() < deadline:
+                line = self.serial.readline().decode('utf-8', errors='ignore').strip()
+                if line.startswith(("OK A ", "ERR A ")):
+                    # "OK A 8300=04 in 123us" / "ERR A 8300=01 TIMEOUT after 1000000us"
+                    current = int(line.split("=", 1)[1][:2], 16)
+                    elapsed = int(line.rsplit(" ", 1)[1].rstrip("us"))
+                    return {"ok": line.startswith("OK"), "value": current, "elapsed_us": elapsed}
+                if line.startswith("ERR"):
+                    return None
+            return None
+        except (ValueError, IndexError):
+            return None
+        except Exception:
+            return None
+    
+    def text_draw(self, x: int, y: int, text: str, attr: int = 0x0F) -> bool:
+        """Write text at (x, y) through the firmware text engine.
+        
+        The firmware keeps a shadow of the screen and only sends cells that
+        changed. Without the engine the text goes out as one batch.
+        """
+        data = bytes(ord(ch) & 0xFF for ch in text)
+        # The E line carries the text raw; bytes the line parser would eat
+        # (control characters, trailing spaces) go through the batch path
+        if self._text_engine_ok() and all(0x20 <= b < 0x7F for b in data) and not text.endswith(" "):
+            if self._send_text(f"E S {x:02X} {y:02X} {attr & 0xFF:02X} {text}"):
+                return True
+        return self.wishbone_batch([
+            ("W", TEXT_CURSOR_X, bytes([x & 0x7F, y & 0x1F, attr & 0xFF])),
+            ("F", TEXT_CHAR_PORT, data),
+        ]) is not None
+    
+    def text_fill(self, x: int, y: int, width: int, height: int,
+                  char: str = " ", attr: int = 0x0F) -> bool:
+        """Fill a rectangle of the text screen with one character and attribute."""
+        code = ord(char[:1] or " ") & 0xFF
+        if self._text_engine_ok():
+            if self._send_text(f"E F {x:02X} {y:02X} {width:02X} {height:02X} "
+                               f"{code:02X} {attr & 0xFF:02X}"):
+                return True
+        width = max(0, min(width, TEXT_COLS - x))
+        ops = []
+        for row in range(y, min(y + height, TEXT_ROWS)):
+            ops.append(("W", TEXT_CURSOR_X, bytes([x, row, attr & 0xFF])))
+            ops.append(("FILL", TEXT_CHAR_PORT, code, width))
+        return self.wishbone_batch(ops) is not None
+    
+    def _text_engine_ok(self) -> bool:
+        return self.connect() and self.text_engine is not False
+    
+    def _send_text(self, line: str) -> bool:
+        """Send one E command. False (and fall back) if it did not run."""
+        self.memory_written(TEXT_CHAR_PORT)
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write((line + "\n").encode())
+            self.serial.flush()
+            deadline = time.time() + 1.0
+            while time.time() < deadline:
+                reply = self.serial.readline().decode('utf-8', errors='ignore').strip()
+                if reply.startswith("OK E"):
+                    self.text_engine = True
+                    return True
+                if reply.startswith("ERR") and not reply.startswith("ERR: E"):
+                    self.text_engine = False   # Firmware without the E command
+                    return False
+                if reply.startswith("ERR"):
+                    return False
+            return False
+        except Exception:
+            return False
+    
+    def telemetry_start(self, addresses: list, period_us: int,
+                        depth: int = TELEMETRY_DEPTH) -> Optional[str]:
+        """Have the board sample addresses every period_us and stream them.
+        
+        Samples collect in a ring of the latest depth records (see
+        telemetry_read). Returns None on success or an error message.
+        """
+        if not addresses or len(addresses) > TELEMETRY_MAX_ADDRS:
+            return f"1-{TELEMETRY_MAX_ADDRS} addresses required"
+        if period_us < TELEMETRY_MIN_PERIOD_US:
+            return f"period must be at least {TELEMETRY_MIN_PERIOD_US} us"
+        if not self.connect():
+            return "Not connected to board"
+        self.telemetry_stop()
+        
+        payload = int(period_us).to_bytes(4, "big") + b"".join(
+            (a & 0xFFFF).to_bytes(2, "big") for a in addresses)
+        self.serial.start_telemetry(addresses, depth)
+        self.telemetry = self.serial
+        try:
+            # Sent as a frame even in ASCII mode: on firmware without the
+            # binary protocol it is a garbage line, so no command can fire
+            self.serial.reset_input_buffer()
+            self._write_frame(BIN_OP_SUBSCRIBE, 0, len(addresses), payload)
+            self.serial.write(b"\n")
+            self.serial.flush()
+            reply = self._read_frame(timeout=0.5)
+        except Exception:
+            reply = None
+        if reply is None or reply[0] != BIN_ST_OK:
+            self.serial.stop_telemetry()
+            self.telemetry = None
+            return "Firmware does not support telemetry (PapilioMCP.h with the binary protocol needed)"
+        return None
+    
+    def telemetry_stop(self) -> Optional[dict]:
+        """End the subscription. Returns the final telemetry_status()."""
+        if not self.telemetry:
+            return None
+        try:
+            self._write_frame(BIN_OP_SUBSCRIBE)
+            self.serial.flush()
+            self._read_frame(timeout=0.5)
+            time.sleep(0.05)   # Let the records sent before the stop come in
+        except Exception:
+            pass
+        status = self.telemetry_status()
+        self.serial.stop_telemetry()
+        self.telemetry = None
+        return status
+    
+    def telemetry_status(self) -> Optional[dict]:
+        if not self.telemetry:
+            return None
+        return {"addresses": self.telemetry.addresses, "received": self.telemetry.received,
+                "lost": self.telemetry.lost, "buffered": len(self.telemetry.samples)}
+    
+    def telemetry_read(self, count: Optional[int] = None) -> list:
+        """The latest count samples (all buffered ones if None), oldest first."""
+        if not self.telemetry:
+            return []
+        samples = list(self.telemetry.samples)
+        return samples[-count:] if count else samples
+    
+    def wishbone_batch(self, ops: list) -> Optional[list]:
+        """Run a list of Wishbone ops back-to-back on the device.
+        
+        Ops are tuples:
+            ("W", addr, data)                  write bytes, incrementing address
+            ("F", addr, data)                  write bytes to one address (FIFO)
+            ("FILL", addr, value, count)       write value count times to addr
+            ("R", addr, n)                     read n bytes
+            ("P", addr, mask, value, timeout)  poll until (rd & mask) == value (ms)
+            ("D", us)                          delay in microseconds
+        
+        Returns the read and poll result bytes in order, or None if an op
+        failed (poll timeout, no reply). Ops are packed into as few frames or
+        Q lines as fit; firmware without batch support gets one command per op.
+        """
+        if not self.connect():
+            return None
+        ops = list(self._split_batch_ops(ops))
+        for op in ops:
+            if op[0] in ("W", "F", "FILL"):
+                self.memory_written(op[1])
+        if self.binary:
+            return self._run_batch(ops, self._encode_batch_op, self.bin_payload, self._send_batch_frame,
+                                   min(BATCH_RESULT_MAX, self.bin_payload))
+        result = self._run_batch(ops, self._format_batch_op, BATCH_LINE_MAX, self._send_batch_line,
+                                 BATCH_RESULT_MAX)
+        if result is False:
+            return self._emulate_batch(ops)
+        return result
+    
+    @staticmethod
+    def _split_batch_ops(ops):
+        """Break large writes, reads and fills into pieces that fit one op."""
+        for op in ops:
+            kind = op[0]
+            if kind in ("W", "F"):
+                addr, data = op[1], bytes(op[2])
+                for off in range(0, len(data), 96):
+                    yield (kind, addr if kind == "F" else addr + off, data[off:off + 96])
+            elif kind == "R":
+                addr, n = op[1], op[2]
+                for off in range(0, n, 128):
+                    yield ("R", addr + off, min(128, n - off))
+            elif kind == "FILL":
+                addr, value, count = op[1:]
+                while count > 0:
+                    yield ("FILL", addr, value, min(count, 0xFFFF))
+                    count -= 0xFFFF
+            else:
+                yield op
+    
+    @staticmethod
+    def _batch_result_len(op) -> int:
+        return op[2] if op[0] == "R" else 1 if op[0] == "P" else 0
+    
+    def _run_batch(self, ops, encode, max_len, send, result_max):
+        """Pack encoded ops into round trips of at most max_len bytes/chars
+        and result_max result bytes."""
+        result = []
+        group, size, expect, timeout = [], 0, 0, 0.5
+        for op in ops:
+            enc = encode(op)
+            n = self._batch_result_len(op)
+            if group and (size + len(enc) > max_len or expect + n > result_max):
+                reply = send(group, timeout)
+                if reply is None or reply is False:
+                    return reply
+                result.extend(reply)
+                group, size, expect, timeout = [], 0, 0, 0.5
+            group.append(enc)
+            size += len(enc)
+            expect += n
+            if op[0] == "P":
+                timeout += op[4] / 1000.0
+        if group:
+            reply = send(group, timeout)
+            if reply is None or reply is False:
+                return reply
+            result.extend(reply)
+        return result
+    
+    @staticmethod
+    def _encode_batch_op(op) -> bytes:
+        kind = op[0]
+        if kind == "D":
+            return bytes([BATCH_DELAY, (op[1] >> 8) & 0xFF, op[1] & 0xFF])
+        hdr = [(op[1] >> 8) & 0xFF, op[1] & 0xFF]
+        if kind in ("W", "F"):
+            code = BATCH_WRITE if kind == "W" else BATCH_WRITE_FIXED
+            return bytes([code] + hdr + [len(op[2])]) + bytes(op[2])
+        if kind == "R":
+            return bytes([BATCH_READ] + hdr + [op[2]])
+        if kind == "P":
+            return bytes([BATCH_POLL] + hdr + [op[2] & 0xFF, op[3] & 0xFF, (op[4] >> 8) & 0xFF, op[4] & 0xFF])
+        if kind == "FILL":
+            return bytes([BATCH_FILL] + hdr + [op[2] & 0xFF, (op[3] >> 8) & 0xFF, op[3] & 0xFF])
+        raise ValueError(f"Unknown batch op {kind}")
+    
+    @staticmethod
+    def _format_batch_op(op) -> str:
+        kind = op[0]
+        if kind == "D":
+            return f"D{op[1]:04X};"
+        if kind in ("W", "F"):
+            return f"{kind}{op[1]:04X}={bytes(op[2]).hex().upper()};"
+        if kind == "R":
+            return f"R{op[1]:04X}:{op[2]:02X};"
+        if kind == "P":
+            return f"P{op[1]:04X}&{op[2]:02X}={op[3]:02X}@{op[4]:04X};"
+        if kind == "FILL":
+            return f"F{op[1]:04X}={op[2]:02X}*{op[3]:04X};"
+        raise ValueError(f"Unknown batch op {kind}")
+    
+    def _send_batch_frame(self, group, timeout):
+        reply = self.send_frame(BIN_OP_BATCH, 0, 0, b"".join(group), timeout)
+        if not reply or reply[0] != BIN_ST_OK:
+            return None
+        return list(reply[3])
+    
+    def _send_batch_line(self, group, timeout):
+        """Send one Q line. False means the firmware has no Q command."""
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write(("Q " + "".join(group) + "\n").encode())
+            self.serial.flush()
+            deadline = time.time() + timeout + 1.0
+            while time.time() < deadline:
+                line = self.serial.readline().decode('utf-8', errors='ignore').strip()
+                if line.startswith("OK Q"):
+                    return [int(b, 16) for b in line.split(":", 1)[1].split()]
+                if line.startswith("ERR Q"):
+                    return None
+                if line.startswith("ERR"):
+                    return False
+            return None
+        except Exception:
+            return None
+    
+    def _emulate_batch(self, ops) -> Optional[list]:
+        """Run batch ops one command at a time (firmware without Q)."""
+        result = []
+        for op in ops:
+            kind = op[0]
+            if kind in ("W", "F"):
+                self.wishbone_write_block(op[1], op[2], fixed=(kind == "F"))
+            elif kind == "FILL":
+                self.wishbone_write_block(op[1], bytes([op[2]]) * op[3], fixed=True)
+            elif kind == "R":
+                result.extend(self.wishbone_read_block(op[1], op[2]))
+            elif kind == "P":
+                deadline = time.time() + op[4] / 1000.0
+                while True:
+                    value = self.wishbone_read(op[1])
+                    if (value & op[2]) == op[3]:
+                        break
+                    if time.time() >= deadline:
+                        return None
+                result.append(value)
+            elif kind == "D":
+                time.sleep(op[1] / 1e6)
+        return result
+    
+    def wishbone_write_block(self, address: int, data: bytes, fixed: bool = False) -> bool:
+        """Write bytes starting at address using burst transfers.
+        
+        fixed=True writes every byte to the same address (character/FIFO ports).
+        """
+        data = bytes(data)
+        self.memory_written(address)
+        if self.connect() and self.binary:
+            op = BIN_OP_WRITE_FIXED if fixed else BIN_OP_WRITE
+            for off in range(0, len(data), self.bin_payload):
+                chunk = data[off:off + self.bin_payload]
+                target = address if fixed else address + off
+                reply = self.send_frame(op, target, len(chunk), chunk)
+                if not reply or reply[0] != BIN_ST_OK:
+                    return False
+            return True
+        replies = self.send_commands([f"W {address if fixed else address + i:04X} {b:02X}"
+                                      for i, b in enumerate(data)])
+        return all("OK W" in r for r in replies)
+    
+    def framebuffer_blit(self, pixels: bytes, x: int = 0, y: int = 0,
+                         width: int = FB_WIDTH, height: int = FB_HEIGHT) -> dict:
+        """Upload a width x height block of RGB332 pixels (row-major) at (x, y).
+        
+        The block is RLE coded, and pixels unchanged since the last blit are
+        skipped, so the firmware decodes it with burst writes and the upload
+        costs one command. The delta base is only known after a full-frame
+        blit and is dropped by any other framebuffer write from this
+        controller. Firmware without the blit command gets per-row block
+        writes.
+        Returns {"ok", "bytes", "pixels"}.
+        """
+        pixels = bytes(pixels)
+        if len(pixels) != width * height or x + width > FB_WIDTH or y + height > FB_HEIGHT:
+            raise ValueError("pixels must be width*height bytes inside 160x120")
+        old = None
+        if self.fb_shadow is not None:
+            old = bytes(self.fb_shadow[(y + r) * FB_WIDTH + x + c]
+                        for r in range(height) for c in range(width))
+        stream = self.encode_blit(pixels, old)
+        
+        result = None
+        if len(stream) <= BLIT_MAX and self._blit_ok():
+            result = self._send_blit(x, y, width, height, stream)
+            if result is None:
+                self.blit = False
+        if result is None:
+            # No B command: write each row's pixel slots directly
+            per_window = FB_WINDOW // 4
+            for r in range(height):
+                pixel = (y + r) * FB_WIDTH + x
+                row = pixels[r * width:(r + 1) * width]
+                c = 0
+                while c < width:
+                    # Split where the row crosses into the next 32 KB window
+                    n = min(width - c, per_window - pixel % per_window)
+                    data = bytes(v for v in row[c:c + n] for _ in range(4))
+                    self.wishbone_write_block((pixel << 2) & 0x7FFF, data)
+                    pixel += n
+                    c += n
+            result = {"ok": True, "bytes": width * height * 4, "pixels": width * height}
+        
+        # Only a full frame makes the whole shadow known
+        if not result["ok"]:
+            self.fb_shadow = None
+        elif self.fb_shadow is None and (width, height) == (FB_WIDTH, FB_HEIGHT):
+            self.fb_shadow = bytearray(pixels)
+        elif self.fb_shadow is not None:
+            for r in range(height):
+                start = (y + r) * FB_WIDTH + x
+                self.fb_shadow[start:start + width] = pixels[r * width:(r + 1) * width]
+        return result
+    
+    @staticmethod
+    def encode_blit(pixels: bytes, old: Optional[bytes] = None) -> bytes:
+        """RLE coding for the B command. Pixels equal to old are skipped."""
+        out = bytearray()
+        literal = bytearray()
+        
+        def flush_literal():
+            for off in range(0, len(literal), 64):
+                chunk = literal[off:off + 64]
+                out.append(BLIT_LITERAL | (len(chunk) - 1))
+                out.extend(chunk)
+            literal.clear()
+        
+        i, n = 0, len(pixels)
+        while i < n:
+            # Unchanged pixels: skip them
+            j = i
+            while old is not None and j < n and pixels[j] == old[j]:
+                j += 1
+            if j - i >= 2 or (j == n and j > i):
+                flush_literal()
+                count = j - i
+                while count >= 64:
+                    k = min(count // 64, 64)
+                    out.append(BLIT_SKIP64 | (k - 1))
+                    count -= k * 64
+                if count:
+                    out.append(BLIT_SKIP | (count - 1))
+                i = j
+                continue
+            # Repeated colour: a run
+            j = i + 1
+            while j < n and j - i < 64 and pixels[j] == pixels[i]:
+                j += 1
+            if j - i >= 3:
+                flush_literal()
+                out.append(BLIT_RUN | (j - i - 1))
+                out.append(pixels[i])
+                i = j
+                continue
+            literal.append(pixels[i])
+            i += 1
+        flush_literal()
+        return bytes(out)
+    
+    def _blit_ok(self) -> bool:
+        """Whether the firmware's B is the blit, checked once per connection.
+        
+        PapilioMCP.h uses B for breakpoints, so B is never sent on a guess:
+        the H listing has to name the blit form.
+        """
+        if self.blit is None and self.connect():
+            listing = self.send_command("H")
+            self.blit = any(line.startswith("B XX YY WW HH") for line in listing.splitlines())
+        return bool(self.blit) and self.connect()
+    
+    def _send_blit(self, x, y, width, height, stream) -> Optional[dict]:
+        """One B command. None if the firmware does not know it."""
+        try:
+            self.serial.reset_input_buffer()
+            self.serial.write(f"B {x:02X} {y:02X} {width:02X} {height:02X} {len(stream):04X}\n".encode())
+            self.serial.flush()
+            deadline = time.time() + 2.0
+            while time.time() < deadline:
+                line = self.serial.readline().decode('utf-8', errors='ignore').strip()
+                if line == "OK B READY":
+                    break
+                if line.startswith("ERR"):
+                    return None
+            else:
+                return None
+            self.serial.write(stream)
+            self.serial.flush()
+            deadline = time.time() + 2.0 + len(stream) / 10000.0
+            while time.time() < deadline:
+                line = self.serial.readline().decode('utf-8', errors='ignore').strip()
+                # "OK B 160x120 at 0,0: 600 bytes, 19200 pixels written in 80 ms"
+                if line.startswith("OK B "):
+                    written = int(line.split(", ", 1)[1].split()[0])
+                    return {"ok": True, "bytes": len(stream), "pixels": written}
+                if line.startswith("ERR B"):
+                    return {"ok": False, "bytes": len(stream), "pixels": 0}
+            return {"ok": False, "bytes": len(stream), "pixels": 0}
+        except (ValueError, IndexError):
+            return {"ok": False, "bytes": len(stream), "pixels": 0}
+        except Exception:
+            return None
+    
     def get_debug_dump(self) -> str:
         """Get debug register dump."""
-        return self.send_command("D")
+        dump = self.send_command("D")
+        ranges = {}
+        for line in dump.splitlines():
+            m = REGISTER_RANGE.match(line.strip())
+            if m:
+                start = int(m.group(2), 16)
+                ranges[m.group(1)] = (start, int(m.group(3), 16) - start + 1)
+        if ranges:
+            self.registers = ranges
+        return dump
+    
+    def register_address(self, name: str, default: int) -> int:
+        """Start address of a named register range, as reported by D.
+        
+        The dump is read once per connection; firmware that does not name
+        its ranges leaves default in place.
+        """
+        if self.registers is None:
+            self.get_debug_dump()
+            if self.registers is None:
+                self.registers = {}
+        return self.registers.get(name, (default, 1))[0]
+    
+    def get_stats(self, reset: bool = False) -> Optional[dict]:
+        """Read the firmware's instrumentation counters (Z command).
+        
+        Returns None if the firmware was built without them. Cycle counts are
+        converted to microseconds with the CPU clock the firmware reports.
+        """
+        reply = self.send_command("Z")
+        lines = reply.splitlines()
+        done = next((l for l in lines if l.startswith("OK Z")), None)
+        if done is None:
+            return None
+        fields = dict(f.split("=", 1) for f in done.split()[2:])
+        mhz = int(fields["CPU"]) or 1
+        stats = {"cpu_mhz": mhz, "spi_hz": int(fields.get("SPI", 0)),
+                 "elapsed_ms": int(fields["T"]),
+                 "commands": {}, "opcodes": {}}
+        for line in lines:
+            words = line.split()
+            if len(words) < 2 or words[0] != "Z":
+                continue
+            kv = dict(w.split("=", 1) for w in words if "=" in w)
+            if words[1] == "SERIAL":
+                stats["serial_in"] = int(kv["IN"])
+                stats["serial_out"] = int(kv["OUT"])
+                stats["serial_dropped"] = int(kv.get("DROP", 0))
+            elif words[1] == "SPI":
+                for cls in ("SKETCH", "DEBUG"):
+                    count, size = kv[cls].split("/")
+                    stats["spi_" + cls.lower()] = {"transactions": int(count), "bytes": int(size)}
+            elif words[1] in ("CMD", "OP"):
+                hist = [int(h) for h in kv["H"].split(",")]
+                entry = {
+                    "count": int(kv["N"]),
+                    "mean_us": int(kv["MEAN"]) / mhz,
+                    "max_us": int(kv["MAX"]) / mhz,
+                    # Upper edge of each bucket in microseconds
+                    "histogram": [((1 << (i + STATS_LOG2_MIN + 1)) / mhz, n)
+                                  for i, n in enumerate(hist)],
+                }
+                key = "commands" if words[1] == "CMD" else "opcodes"
+                stats[key][words[2]] = entry
+        if reset:
+            self.send_command("Z R")
+        return stats
+    
+    def list_breakpoints(self) -> Optional[dict]:
+        """Breakpoint sites the sketch has registered (B command).
+        
+        Returns None on firmware without per-site breakpoints.
+        """
+        reply = self.send_command("B")
+        lines = reply.splitlines()
+        done = next((l for l in lines if l.startswith("OK B")), None)
+        if done is None:
+            return None
+        words = done.split()
+        result = {"enabled": words[2].rstrip(",") == "ENABLED",
+                  "hits": int(words[4]), "sites": []}
+        for line in lines:
+            m = BREAKPOINT_SITE.match(line.strip())
+            if m:
+                site = {"id": int(m.group(1), 16), "name": m.group(2),
+                        "enabled": m.group(3) == "EN",
+                        "hits": int(m.group(4)), "after": int(m.group(5)),
+                        "condition": None}
+                if m.group(6):
+                    site["condition"] = {"address": int(m.group(6), 16),
+                                         "mask": int(m.group(7), 16),
+                                         "value": int(m.group(8), 16)}
+                result["sites"].append(site)
+        return result
+    
+    def configure_breakpoint(self, site: int, enabled: Optional[bool] = None,
+                             after: Optional[int] = None, condition: Optional[tuple] = None,
+                             clear_condition: bool = False, reset_hits: bool = False) -> str:
+        """Change one breakpoint site; condition is (address, mask, value)."""
+        commands = []
+        if enabled is not None:
+            commands.append(f"B {site:02X} {1 if enabled else 0}")
+        if after is not None:
+            commands.append(f"B {site:02X} N {after:08X}")
+        if clear_condition:
+            commands.append(f"B {site:02X} C")
+        if condition is not None:
+            address, mask, value = condition
+            commands.append(f"B {site:02X} C {address:04X} {mask:02X} {value:02X}")
+        if reset_hits:
+            commands.append(f"B {site:02X} R")
+        reply = "No change"
+        for cmd in commands:
+            reply = self.send_command(cmd)
+            if not reply.splitlines()[-1].startswith("OK"):
+                break
+        return reply
+    
+    def list_watchpoints(self) -> Optional[dict]:
+        """Watchpoint table (V command), or None on firmware without it."""
+        lines = [l.strip() for l in self.send_command("V").splitlines()]
+        status = next((WATCH_STATUS.match(l) for l in lines if WATCH_STATUS.match(l)), None)
+        if status is None:
+            return None
+        watches = []
+        for line in lines:
+            m = WATCH_ENTRY.match(line)
+            if m:
+                watches.append({"id": int(m.group(1), 16), "address": int(m.group(2), 16),
+                                "mask": int(m.group(3), 16),
+                                "value": int(m.group(4), 16) if m.group(4) else None,
+                                "pause": bool(m.group(5)), "hits": int(m.group(6)),
+                                "last": int(m.group(7), 16)})
+        return {"period_us": int(status.group(2)), "samples": int(status.group(3)),
+                "dropped": int(status.group(4)), "watches": watches}
+    
+    def set_watchpoint(self, address: int, mask: int = 0xFF, value: Optional[int] = None,
+                       pause: bool = False, period_us: Optional[int] = None) -> str:
+        """Add a watchpoint: any change of (address & mask), or becoming value."""
+        if period_us is not None:
+            reply = self.send_command(f"V T {period_us:08X}")
+            if not reply.splitlines()[-1].startswith("OK"):
+                return reply
+        cmd = f"V {address:04X} {mask:02X}"
+        if value is not None:
+            cmd += f" {value & mask:02X}"
+        return self.send_command(cmd + (" P" if pause else ""))
+    
+    def clear_watchpoint(self, watch_id: Optional[int] = None) -> str:
+        """Remove one watchpoint, or all of them when watch_id is None."""
+        return self.send_command("V 0" if watch_id is None else f"V - {watch_id:02X}")
+    
+    def list_snapshots(self) -> Optional[dict]:
+        """Snapshot slots and ranges (N), or None without snapshot support."""
+        lines = self.send_command("N").splitlines()
+        info = next((SNAPSHOT_INFO.match(l) for l in lines if SNAPSHOT_INFO.match(l)), None)
+        if info is None:
+            return None
+        slots = [SNAPSHOT_SLOT.match(l) for l in lines if SNAPSHOT_SLOT.match(l)]
+        ranges = [SNAPSHOT_RANGE.match(l) for l in lines if SNAPSHOT_RANGE.match(l)]
+        return {
+            "slots": [{"slot": int(m.group(1)), "valid": m.group(2) is not None,
+                       "crc": m.group(2)} for m in slots],
+            "ranges": [{"name": m.group(1), "start": int(m.group(2), 16),
+                        "length": int(m.group(3), 16)} for m in ranges],
+            "bytes": int(info.group(2), 16),
+            "layout": info.group(3),
+        }
+    
+    def save_snapshot(self, slot: int = 0, path: Optional[str] = None,
+                      persist: bool = False) -> str:
+        """Capture the snapshot ranges into a device slot.
+        
+        persist also copies the slot to NVS; path also writes the blob to a
+        JSON file that restore_snapshot can upload to any board with the
+        same ranges.
+        """
+        reply = self.send_command(f"N S {slot:X}")
+        if not reply.splitlines()[-1].startswith("OK N S"):
+            return reply
+        if persist:
+            persisted = self.send_command(f"N P {slot:X}")
+            if not persisted.splitlines()[-1].startswith("OK"):
+                return persisted
+            reply += "\n" + persisted
+        if path:
+            info = self.list_snapshots()
+            dump = self.send_command(f"N D {slot:X}").splitlines()
+            data = "".join(l.split()[2] for l in dump if re.match(r"^N [0-9A-F]{4} [0-9A-F]+$", l))
+            crc = dump[-1].rsplit("CRC=", 1)[-1]
+            if len(data) != info["bytes"] * 2 or f"{crc16(bytes.fromhex(data)):04X}" != crc:
+                return f"ERROR: snapshot dump incomplete\n{dump[-1]}"
+            with open(path, "w") as f:
+                json.dump({"version": SNAPSHOT_VERSION, "layout": info["layout"],
+                           "ranges": info["ranges"], "data": data, "crc": crc}, f, indent=2)
+            reply += f"\nSaved to {path}"
+        return reply
+    
+    def restore_snapshot(self, slot: int = 0, path: Optional[str] = None,
+                         load: bool = False) -> str:
+        """Burst-write a snapshot back with one N R.
+        
+        path uploads a saved file into the slot first; load reads the slot
+        from NVS first.
+        """
+        if path:
+            with open(path) as f:
+                saved = json.load(f)
+            info = self.list_snapshots()
+            if info is None:
+                return "ERROR: firmware has no register snapshots"
+            if saved["layout"] != info["layout"]:
+                return (f"ERROR: {path} was saved for another range list "
+                        f"(layout {saved['layout']}, board {info['layout']})")
+            data = bytes.fromhex(saved["data"])
+            replies = self.send_commands([
+                f"N W {slot:X} {off:04X} {data[off:off + SNAPSHOT_UPLOAD].hex().upper()}"
+                for off in range(0, len(data), SNAPSHOT_UPLOAD)])
+            last = replies[-1].splitlines()[-1] if replies else ""
+            if not last.startswith("OK N W") or not last.endswith(f"CRC={saved['crc']}"):
+                return f"ERROR: snapshot upload failed\n{last}"
+        elif load:
+            loaded = self.send_command(f"N L {slot:X}")
+            if not loaded.splitlines()[-1].startswith("OK"):
+                return loaded
+        self.memory_written()
+        return self.send_command(f"N R {slot:X}")
     
     def get_jtag_status(self) -> str:
         """Get JTAG bridge status."""
@@ -167,6 +1723,147 @@ class PapilioController:
     def set_jtag_enabled(self, enabled: bool) -> str:
         """Enable/disable JTAG bridge."""
         return self.send_command(f"J {'1' if enabled else '0'}")
+    
+    def jtag(self, action: int, address: int = 0, payload: bytes = b"") -> Optional[bytes]:
+        """One JTAG frame action; the reply data, or None on error."""
+        reply = self.send_frame(BIN_OP_JTAG, address, action, payload, timeout=1.0)
+        if reply is None or reply[0] != BIN_ST_OK:
+            return None
+        return reply[3]
+    
+    def jtag_ir(self, instruction: int, bits: int = GOWIN_IR_BITS) -> Optional[int]:
+        """Shift an instruction; returns the captured IR bits."""
+        data = self.jtag(JTAG_IR, instruction, bytes([bits]))
+        return None if data is None else int.from_bytes(data, "little")
+    
+    def jtag_dr(self, value: int, bits: int = 32) -> Optional[int]:
+        """Shift a data register (up to 32 bits); returns TDO."""
+        data = self.jtag(JTAG_DR, 0, bytes([bits]) + value.to_bytes((bits + 7) // 8, "little"))
+        return None if data is None else int.from_bytes(data, "little")
+    
+    @staticmethod
+    def load_bitstream(path: str) -> bytes:
+        """Bitstream bytes in shift order: the first bit is bit 0 of byte 0.
+        
+        .fs files (Gowin text, one row of 0/1 per line) keep their bit order;
+        binary files are MSB first per byte, so every byte is reversed.
+        """
+        if path.lower().endswith(".fs"):
+            with open(path) as f:
+                bits = "".join(line.strip() for line in f
+                               if line.strip() and not line.startswith("//"))
+            bits += "1" * (-len(bits) % 8)
+            return bytes(int(bits[i:i + 8][::-1], 2) for i in range(0, len(bits), 8))
+        with open(path, "rb") as f:
+            data = f.read()
+        return data.translate(bytes(int(f"{b:08b}"[::-1], 2) for b in range(256)))
+    
+    @staticmethod
+    def pack_bitstream(data: bytes, payload: int = BIN_MAX_PAYLOAD) -> list:
+        """JTAG_DATA payloads of at most payload bytes: PackBits runs and
+        literals, whole tokens per frame."""
+        tokens = []
+        literal_max = min(JTAG_LITERAL_MAX, payload - 1)
+        
+        def literal(start, end):
+            for i in range(start, end, literal_max):
+                chunk = data[i:min(end, i + literal_max)]
+                tokens.append(bytes([len(chunk) - 1]) + chunk)
+        
+        pos = 0
+        for match in re.finditer(rb"(.)\1{%d,}" % (JTAG_RUN_MIN - 1), data, re.S):
+            start, end = match.span()
+            literal(pos, start)
+            while end - start >= JTAG_RUN_MIN:
+                n = min(end - start, JTAG_RUN_MAX)
+                tokens.append(bytes([0x80 + n - JTAG_RUN_MIN, data[start]]))
+                start += n
+            pos = start   # A remainder shorter than a run goes out as literal
+        literal(pos, len(data))
+        
+        chunks = [b""]
+        for token in tokens:
+            if len(chunks[-1]) + len(token) > payload:
+                chunks.append(b"")
+            chunks[-1] += token
+        return chunks if chunks[0] else []
+    
+    def _jtag_stream(self, chunks: list, total: int, progress=None) -> Optional[tuple]:
+        """Stream one Shift-DR scan, JTAG_WINDOW chunks in flight.
+        
+        Returns the device's (bytes, crc) after the last chunk, or None.
+        """
+        sent = acked = 0
+        reply = None
+        while acked < len(chunks):
+            while sent < len(chunks) and sent - acked < JTAG_WINDOW:
+                flags = (JTAG_FIRST if sent == 0 else 0) | (JTAG_LAST if sent == len(chunks) - 1 else 0)
+                self._write_frame(BIN_OP_JTAG_DATA, sent & 0xFFFF, flags, chunks[sent])
+                sent += 1
+            self.serial.flush()
+            reply = self._read_frame(JTAG_CHUNK_TIMEOUT)
+            if reply is None or reply[0] != BIN_ST_OK or reply[1] != acked & 0xFFFF:
+                return None
+            acked += 1
+            if progress:
+                progress(int.from_bytes(reply[3][:4], "big"), total)
+        return int.from_bytes(reply[3][:4], "big"), int.from_bytes(reply[3][4:6], "big")
+    
+    def program_fpga(self, path: str, progress=None) -> dict:
+        """Load a bitstream into FPGA SRAM through the firmware's JTAG frames.
+        
+        Runs the Gowin SRAM sequence (erase, config enable, XFER_WRITE stream,
+        config disable) and checks the DONE status bit. The serial port stays
+        open and the USB bridge is never switched.
+        """
+        data = self.load_bitstream(path)
+        chunks = self.pack_bitstream(data, self.bin_payload)
+        packed = sum(len(c) for c in chunks)
+        if not self.connect() or not self.binary:
+            return {"ok": False, "error": "Needs the binary protocol (PapilioMCP.h firmware)"}
+        self.memory_written()   # A new configuration starts with its own memory
+        
+        started = time.perf_counter()
+        idcode = self.jtag(JTAG_ACQUIRE)
+        if idcode is None:
+            return {"ok": False, "error": "Firmware has no JTAG programming (MCP_ENABLE_JTAG_PROG)"}
+        result = {"ok": False, "idcode": f"0x{int.from_bytes(idcode, 'little'):08X}",
+                  "bytes": len(data), "packed_bytes": packed, "chunks": len(chunks)}
+        try:
+            for ir in (GOWIN_CONFIG_ENABLE, GOWIN_ERASE_SRAM, GOWIN_NOOP):
+                self.jtag_ir(ir)
+            time.sleep(GOWIN_ERASE_S)
+            for ir in (GOWIN_XFER_DONE, GOWIN_NOOP, GOWIN_CONFIG_DISABLE, GOWIN_NOOP,
+                       GOWIN_CONFIG_ENABLE, GOWIN_INIT_ADDR, GOWIN_XFER_WRITE):
+                self.jtag_ir(ir)
+            
+            streamed = time.perf_counter()
+            device = self._jtag_stream(chunks, len(data), progress)
+            elapsed = time.perf_counter() - streamed
+            if device is None:
+                result["error"] = "Bitstream chunk not acknowledged"
+                return result
+            if device != (len(data), crc16(data)):
+                result["error"] = f"Device received {device[0]} bytes, CRC {device[1]:04X}"
+                return result
+            
+            self.jtag_ir(GOWIN_CONFIG_DISABLE)
+            self.jtag_ir(GOWIN_NOOP)
+            self.jtag_ir(GOWIN_STATUS)
+            status = self.jtag_dr(0)
+            result.update({
+                "status": None if status is None else f"0x{status:08X}",
+                "stream_seconds": round(elapsed, 3),
+                "bytes_per_s": round(len(data) / elapsed) if elapsed > 0 else None,
+                "ok": status is not None and bool(status & GOWIN_STATUS_DONE)
+                      and not status & GOWIN_STATUS_CRC_ERROR,
+            })
+            if not result["ok"]:
+                result["error"] = "DONE not set after configuration"
+            return result
+        finally:
+            self.jtag(JTAG_RELEASE)
+            result["seconds"] = round(time.perf_counter() - started, 3)
 
 
 class WebcamCapture:
@@ -182,6 +1879,12 @@ class WebcamCapture:
         self.resolution = (1920, 1080)  # Default to 1080p
         self._cap = None  # Persistent camera connection
         self._cap_initialized = False
+        # Capture thread (start_stream): newest frames as (time, frame)
+        self._stream = None
+        self._stream_stop = None
+        self._frames = deque(maxlen=CAMERA_RING)
+        self._frame_ready = threading.Condition()
+        self._last_frame = None  # Reference for changes_only
     
     def _get_camera(self):
         """Get or create persistent camera connection for faster captures."""
@@ -200,11 +1903,94 @@ class WebcamCapture:
     
     def release_camera(self):
         """Release the persistent camera connection."""
+        self.stop_stream()
         if self._cap is not None:
             self._cap.release()
             self._cap = None
             self._cap_initialized = False
     
+    @property
+    def streaming(self) -> bool:
+        return self._stream is not None and self._stream.is_alive()
+    
+    def start_stream(self) -> bool:
+        """Read frames continuously in a background thread.
+        
+        Captures then take the newest frame from the ring instead of paying
+        for grab/read (and warm-up) on every call.
+        """
+        if not OPENCV_AVAILABLE:
+            return False
+        if self.streaming:
+            return True
+        cap = self._get_camera()
+        if not cap.isOpened():
+            return False
+        self._frames.clear()
+        self._stream_stop = threading.Event()
+        self._stream = threading.Thread(target=self._stream_loop, args=(cap, self._stream_stop),
+                                        name="camera-stream", daemon=True)
+        self._stream.start()
+        return True
+    
+    def stop_stream(self):
+        if self._stream is not None:
+            self._stream_stop.set()
+            self._stream.join(timeout=2.0)
+            self._stream = None
+    
+    def _stream_loop(self, cap, stop: threading.Event):
+        failures = 0
+        while not stop.is_set():
+            ok, frame = cap.read()
+            if not ok:
+                failures += 1
+                if failures >= CAMERA_READ_FAILURES:
+                    break
+                time.sleep(0.01)
+                continue
+            failures = 0
+            with self._frame_ready:
+                self._frames.append((time.time(), frame))
+                self._frame_ready.notify_all()
+    
+    def stream_status(self) -> dict:
+        with self._frame_ready:
+            times = [t for t, _ in self._frames]
+        fps = (len(times) - 1) / (times[-1] - times[0]) if len(times) > 1 and times[-1] > times[0] else None
+        return {"streaming": self.streaming, "fps": round(fps, 1) if fps else None,
+                "age_ms": round((time.time() - times[-1]) * 1000) if times else None}
+    
+    def frame_after(self, since: Optional[float] = None,
+                    timeout: float = CAMERA_FRAME_TIMEOUT) -> Optional[tuple]:
+        """(time, frame) from the stream, or None on timeout.
+        
+        Without since, the newest frame. With since, a frame read after it with
+        CAMERA_FRESH_SKIP more frames dropped, since the first one may have been
+        exposed before since (e.g. before a register write took effect).
+        """
+        with self._frame_ready:
+            if since is None:
+                if not self._frame_ready.wait_for(lambda: self._frames, timeout):
+                    return None
+                return self._frames[-1]
+            later = lambda: [f for f in self._frames if f[0] > since]
+            if not self._frame_ready.wait_for(lambda: len(later()) > CAMERA_FRESH_SKIP, timeout):
+                return None
+            return later()[CAMERA_FRESH_SKIP]
+    
+    @staticmethod
+    def changed_regions(frame, previous) -> list:
+        """Boxes (x, y, w, h) where frame differs from previous."""
+        if previous is None or previous.shape != frame.shape:
+            return [(0, 0, frame.shape[1], frame.shape[0])]
+        diff = cv2.cvtColor(cv2.absdiff(frame, previous), cv2.COLOR_BGR2GRAY)
+        _, mask = cv2.threshold(diff, CAMERA_DIFF_THRESHOLD, 255, cv2.THRESH_BINARY)
+        mask = cv2.dilate(mask, None, iterations=2)
+        contours = cv2.findContours(mask, cv2.RETR_EXTERNAL, cv2.CHAIN_APPROX_SIMPLE)[-2]
+        boxes = [cv2.boundingRect(c) for c in contours]
+        return [b for b in boxes if b[2] * b[3] >= CAMERA_DIFF_MIN_AREA]
+    
     def list_cameras(self) -> list:
         """List available camera indices."""
         if not OPENCV_AVAILABLE:
@@ -221,7 +2007,9 @@ class WebcamCapture:
         return available
     
     def capture(self, save_to_file: bool = True, filename: str = None,
-                format: str = "jpeg", quality: int = 80, warmup_frames: int = 2) -> dict:
+                format: str = "jpeg", quality: int = 80, warmup_frames: int = 2,
+                scale_percent: int = 100, changes_only: bool = False,
+                fresh: bool = False) -> dict:
         """Capture a frame from the webcam.
         
         Args:
@@ -230,6 +2018,10 @@ class WebcamCapture:
             format: Image format - "jpeg" (smaller/faster) or "png" (lossless)
             quality: JPEG quality 1-100 (higher = better quality, larger file)
             warmup_frames: Number of warmup frames (0 for fastest, 2-5 for better exposure)
+            scale_percent: Downscale the returned image (the file keeps full size)
+            changes_only: Return only the box around what changed since the
+                          previous capture (nothing when nothing changed)
+            fresh: With the stream running, wait for a frame taken after this call
         
         Returns:
             dict with keys:
@@ -237,6 +2029,7 @@ class WebcamCapture:
             - message: str
             - image_base64: str (image as base64, if successful)
             - filepath: str (if saved to file)
+            - region, regions: changed box(es) when changes_only is set
         """
         if not OPENCV_AVAILABLE:
             return {
@@ -244,64 +2037,101 @@ class WebcamCapture:
                 "message": "OpenCV not installed. Run: pip install opencv-python"
             }
         
-        cap = self._get_camera()
-        if not cap.isOpened():
-            return {
-                "success": False,
-                "message": f"Could not open camera {self.camera_index}"
-            }
-        
-        # Warmup frames - only on first capture after camera opens (for auto-exposure)
-        # After that, just grab one frame to flush the buffer
-        if not self._cap_initialized:
-            for _ in range(max(warmup_frames, 3)):
-                cap.grab()  # grab() is faster than read() for discarding frames
-            self._cap_initialized = True
+        if self.streaming:
+            item = self.frame_after(time.time() if fresh else None)
+            if item is None:
+                return {
+                    "success": False,
+                    "message": "No frame from the camera stream"
+                }
+            captured_at, frame = item
         else:
-            # Just flush buffer to get latest frame
-            cap.grab()
-        
-        ret, frame = cap.read()
-        
-        if not ret:
-            self._cap_initialized = False
-            return {
-                "success": False,
-                "message": "Failed to capture frame from camera"
-            }
+            cap = self._get_camera()
+            if not cap.isOpened():
+                return {
+                    "success": False,
+                    "message": f"Could not open camera {self.camera_index}"
+                }
+            
+            # Warmup frames - only on first capture after camera opens (for auto-exposure)
+            # After that, just grab one frame to flush the buffer
+            if not self._cap_initialized:
+                for _ in range(max(warmup_frames, 3)):
+                    cap.grab()  # grab() is faster than read() for discarding frames
+                self._cap_initialized = True
+            else:
+                # Just flush buffer to get latest frame
+                cap.grab()
+            
+            ret, frame = cap.read()
+            captured_at = time.time()
+            
+            if not ret:
+                self._cap_initialized = False
+                return {
+                    "success": False,
+                    "message": "Failed to capture frame from camera"
+                }
         
-        # Apply crop if configured
+        # Apply crop if configured (a view into the frame, nothing is copied)
         if self.crop_region:
             x, y, w, h = self.crop_region
             frame = frame[y:y+h, x:x+w]
         
+        # Only the box around the changes, compared with the previous capture
+        out = frame
+        regions = None
+        if changes_only:
+            regions = self.changed_regions(frame, self._last_frame)
+            if not regions:
+                self._last_frame = frame
+                return {
+                    "success": True,
+                    "message": "No change since the previous capture",
+                    "regions": [],
+                    "captured_at": captured_at
+                }
+            x0 = min(r[0] for r in regions)
+            y0 = min(r[1] for r in regions)
+            x1 = max(r[0] + r[2] for r in regions)
+            y1 = max(r[1] + r[3] for r in regions)
+            out = frame[y0:y1, x0:x1]
+        self._last_frame = frame
+        if scale_percent != 100:
+            size = (max(1, out.shape[1] * scale_percent // 100), max(1, out.shape[0] * scale_percent // 100))
+            out = cv2.resize(out, size, interpolation=cv2.INTER_AREA)
+        
         # Encode based on format
         format = format.lower()
         if format == "jpeg" or format == "jpg":
             encode_params = [cv2.IMWRITE_JPEG_QUALITY, quality]
-            _, buffer = cv2.imencode('.jpg', frame, encode_params)
             mime_type = "image/jpeg"
             ext = ".jpg"
         else:
             # PNG with compression (0-9, higher = smaller but slower)
             encode_params = [cv2.IMWRITE_PNG_COMPRESSION, 6]
-            _, buffer = cv2.imencode('.png', frame, encode_params)
             mime_type = "image/png"
             ext = ".png"
+        _, buffer = cv2.imencode(ext, out, encode_params)
         
         image_base64 = base64.b64encode(buffer).decode('utf-8')
         
         result = {
             "success": True,
-            "message": f"Captured {frame.shape[1]}x{frame.shape[0]} {format.upper()} ({len(buffer)/1024:.1f}KB)",
+            "message": f"Captured {out.shape[1]}x{out.shape[0]} {format.upper()} ({len(buffer)/1024:.1f}KB)",
             "image_base64": image_base64,
             "mime_type": mime_type,
-            "width": frame.shape[1],
-            "height": frame.shape[0],
-            "size_bytes": len(buffer)
+            "width": out.shape[1],
+            "height": out.shape[0],
+            "size_bytes": len(buffer),
+            "captured_at": captured_at
         }
+        if regions is not None:
+            result["region"] = {"x": x0, "y": y0, "width": x1 - x0, "height": y1 - y0}
+            result["regions"] = [{"x": x, "y": y, "width": w, "height": h} for x, y, w, h in regions]
+            result["message"] += f", {len(regions)} changed region(s) at {x0},{y0}"
         
-        # Save to file if requested
+        # Save to file if requested (the full frame, encoded once)
         if save_to_file:
             os.makedirs(self.save_dir, exist_ok=True)
             if filename is None:
@@ -309,7 +2139,10 @@ class WebcamCapture:
             elif not filename.endswith(ext):
                 filename = filename.rsplit('.', 1)[0] + ext
             filepath = os.path.join(self.save_dir, filename)
-            cv2.imwrite(filepath, frame, encode_params)
+            if out is not frame:
+                _, buffer = cv2.imencode(ext, frame, encode_params)
+            with open(filepath, "wb") as f:
+                f.write(buffer.tobytes())
             result["filepath"] = filepath
         
         return result
@@ -388,10 +2221,162 @@ class WebcamCapture:
         return {"success": False, "message": "Calibration cancelled"}
 
 
+class BoardPool:
+    """The boards this server drives, each with its own worker thread.
+    
+    Boards are named by port; lookups also take the USB serial number.
+    Every call for a board runs on that board's worker, so a controller is
+    only used from one thread while different boards work in parallel.
+    The active board serves tool calls that name no board. Workers may
+    drop their own board at the same time (disconnect_board on "all"), so
+    the board list and the worker table change only under _lock.
+    """
+    
+    def __init__(self, first: PapilioController):
+        self.boards = [first]
+        self.active = first
+        self._workers = {}
+        self._lock = threading.Lock()
+    
+    @staticmethod
+    def name(board: PapilioController) -> str:
+        if board.serial:
+            return board.serial.port
+        return board.port or "auto"
+    
+    @staticmethod
+    def serial_number(board: PapilioController) -> Optional[str]:
+        port = BoardPool.name(board)
+        return next((p.serial_number for p in serial.tools.list_ports.comports()
+                     if p.device == port), None)
+    
+    def find(self, key: str) -> Optional[PapilioController]:
+        """Board by port or USB serial number."""
+        boards = self.snapshot()
+        for board in boards:
+            if self.name(board) == key:
+                return board
+        ports = {p.serial_number: p.device for p in serial.tools.list_ports.comports()
+                 if p.serial_number}
+        return next((b for b in boards if self.name(b) == ports.get(key)), None)
+    
+    def add(self, port: str) -> PapilioController:
+        """The board on port, created if new; an unused auto board takes the port."""
+        board = self.find(port)
+        if board:
+            return board
+        with self._lock:
+            idle = next((b for b in self.boards if not b.port and not b.serial), None)
+            if idle:
+                idle.port = port
+                return idle
+            board = PapilioController(port, self.active.baud, self.active.protocol)
+            board.event_sink = self.active.event_sink
+            self.boards.append(board)
+            return board
+    
+    def remove(self, board: PapilioController):
+        """Disconnect a board and drop it (the last board stays, unconnected).
+        
+        Called from the board's own worker, so it disconnects directly.
+        """
+        board.disconnect()
+        with self._lock:
+            if len(self.boards) < 2 or board not in self.boards:
+                return
+            self.boards.remove(board)
+            worker = self._workers.pop(id(board), None)
+            if self.active is board:
+                self.active = self.boards[0]
+        if worker:
+            worker.shutdown(wait=False)
+    
+    def snapshot(self, connected: bool = False) -> list:
+        """Copy of the board list (only boards with an open port if connected)."""
+        with self._lock:
+            return [b for b in self.boards if b.serial or not connected]
+    
+    def _worker(self, board: PapilioController) -> ThreadPoolExecutor:
+        with self._lock:
+            worker = self._workers.get(id(board))
+            if worker is None:
+                worker = ThreadPoolExecutor(max_workers=1, thread_name_prefix=f"board-{self.name(board)}")
+                self._workers[id(board)] = worker
+            return worker
+    
+    def run(self, board: PapilioController, fn, *args):
+        """Run fn(*args) on the board's worker and wait for it."""
+        return self._worker(board).submit(fn, *args).result()
+    
+    def run_all(self, fn, boards: Optional[list] = None) -> list:
+        """Run fn(board) on every board at once; [(board, result)] in pool order."""
+        boards = self.snapshot() if boards is None else list(boards)
+        futures = [self._worker(b).submit(fn, b) for b in boards]
+        return [(b, f.result()) for b, f in zip(boards, futures)]
+    
+    def scan(self) -> list:
+        """Connect to every board-like port in parallel."""
+        for p in serial.tools.list_ports.comports():
+            if "USB" in p.description or "Serial" in p.description:
+                self.add(p.device)
+        return self.run_all(lambda b: b.connect())
+    
+    def describe(self, board: PapilioController) -> str:
+        line = self.name(board)
+        number = self.serial_number(board)
+        if number:
+            line += f" (SN {number})"
+        if board.serial:
+            features = [f for f, on in (("binary", board.binary), ("tags", board.tagged),
+                                        ("events", board.events),
+                                        ("telemetry", board.telemetry is not None)) if on]
+            line += ": connected" + (f", {' '.join(features)}" if features else "")
+        else:
+            line += ": not connected"
+        return ("* " if board is self.active else "  ") + line
+
+
+# MCP output: replies from the request loop, notifications from reader threads
+stdout_lock = threading.Lock()
+LOG_LEVELS = ["debug", "info", "notice", "warning", "error", "critical", "alert", "emergency"]
+mcp_session = {"initialized": False, "log_level": "info"}
+
+
+def write_message(message: dict):
+    with stdout_lock:
+        sys.stdout.write(json.dumps(message) + "\n")
+        sys.stdout.flush()
+
+
+def publish_event(board: PapilioController, event: dict):
+    """Push a board event to the client as an MCP log notification."""
+    level = "notice" if event["event"] in ("breakpoint", "watch") else "info"
+    if not mcp_session["initialized"] or \
+            LOG_LEVELS.index(level) < LOG_LEVELS.index(mcp_session["log_level"]):
+        return
+    write_message({
+        "jsonrpc": "2.0",
+        "method": "notifications/message",
+        "params": {"level": level, "logger": "papilio",
+                   "data": dict(event, board=BoardPool.name(board))}
+    })
+
+
 # Global instances
 controller = PapilioController()
+controller.event_sink = publish_event
+boards = BoardPool(controller)
 webcam = WebcamCapture()
-logic_analyzer = None  # Will be initialized when needed
+
+# Tools that do not talk to a board get no "board" argument
+HOST_TOOLS = {"list_serial_ports", "list_boards", "scan_boards", "select_board", "connect_board",
+              "capture_screenshot", "list_cameras", "set_camera", "set_camera_stream", "set_screenshot_crop",
+              "clear_screenshot_crop"}
+BOARD_ARGUMENT = {
+    "type": "string",
+    "description": "Board to use: port or USB serial number, 'all' to run on every "
+                   "connected board in parallel (default: the active board)"
+}
 
 
 def handle_initialize(request_id, params):
@@ -402,7 +2387,8 @@ def handle_initialize(request_id, params):
         "result": {
             "protocolVersion": MCP_VERSION,
             "capabilities": {
-                "tools": {}
+                "tools": {},
+                "logging": {}
             },
             "serverInfo": {
                 "name": "papilio-mcp-server",
@@ -557,7 +2543,7 @@ def handle_tools_list(request_id):
         },
         {
             "name": "logic_analyzer_export_vcd",
-            "description": "Export the last captured data to VCD format for viewing in GTKWave. Must call logic_analyzer_capture first.",
+            "description": "Export captured data to VCD format for viewing in GTKWave. Uses the last logic_analyzer_capture, or streams the sample memory from a triggered analyzer when there is none.",
             "inputSchema": {
                 "type": "object",
                 "properties": {
@@ -611,74 +2597,307 @@ def handle_tools_list(request_id):
             }
         },
         {
-            "name": "pause_sketch",
-            "description": "Pause or resume the main Arduino sketch loop. When paused, only MCP commands are processed.",
+            "name": "program_fpga",
+            "description": "Program the FPGA (SRAM) with a bitstream file (.fs or .bin) over the existing serial link: the firmware shifts it out on the JTAG pins, so no bridge switch, disconnect or openFPGALoader run is needed. Reports IDCODE, progress and throughput.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "path": {
+                        "type": "string",
+                        "description": "Bitstream file path"
+                    }
+                },
+                "required": ["path"]
+            }
+        },
+        {
+            "name": "get_stats",
+            "description": "Read the firmware instrumentation: serial bytes in/out, SPI transactions and bytes, and per-command latency histograms. Needs firmware built with MCP_ENABLE_STATS=1.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "reset": {
+                        "type": "boolean",
+                        "description": "Clear the counters after reading them",
+                        "default": False
+                    }
+                }
+            }
+        },
+        {
+            "name": "pause_sketch",
+            "description": "Pause or resume the main Arduino sketch loop. When paused, only MCP commands are processed.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "paused": {
+                        "type": "boolean",
+                        "description": "True to pause the sketch, False to resume"
+                    }
+                },
+                "required": ["paused"]
+            }
+        },
+        {
+            "name": "get_pause_status",
+            "description": "Get the current pause status of the sketch. With event frames (PapilioMCP.h firmware) it is answered from the pushed state without a board round trip.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "continue_from_breakpoint",
+            "description": "Continue execution from a breakpoint. Use this when the sketch is stopped at a breakpoint.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "wait_for_event",
+            "description": "Block until the board pushes an event (breakpoint hit, continue, pause, resume, JTAG state change, watched register change) instead of polling. Returns the first matching event not yet returned by an earlier call, so nothing between two calls is missed. Events are also sent as MCP log notifications (logger 'papilio').",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "events": {
+                        "type": "array",
+                        "items": {"type": "string", "enum": list(EVENT_KINDS)},
+                        "description": "Event kinds to wait for (default: any)"
+                    },
+                    "timeout": {
+                        "type": "number",
+                        "description": f"Seconds to wait (default 10, at most {EVENT_WAIT_MAX:g})",
+                        "default": 10
+                    }
+                }
+            }
+        },
+        {
+            "name": "set_breakpoints_enabled",
+            "description": "Enable or disable all breakpoints globally. When disabled, breakpoint() calls in the sketch are skipped.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "enabled": {
+                        "type": "boolean",
+                        "description": "True to enable breakpoints, False to disable (skip all breakpoints)"
+                    }
+                },
+                "required": ["enabled"]
+            }
+        },
+        {
+            "name": "save_snapshot",
+            "description": "Capture the firmware's snapshot ranges (MCP_SNAPSHOT_MAP: video mode, text attributes, LED, LA config, ...) into a device RAM slot with burst reads. Optionally persist it to NVS or save it to a host file.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "slot": {
+                        "type": "integer",
+                        "description": "Snapshot slot (default 0)"
+                    },
+                    "persist": {
+                        "type": "boolean",
+                        "description": "Also store the slot in NVS so it survives a reset"
+                    },
+                    "path": {
+                        "type": "string",
+                        "description": "Also write the snapshot to this JSON file"
+                    }
+                }
+            }
+        },
+        {
+            "name": "restore_snapshot",
+            "description": "Restore a register snapshot with one command (burst writes on the device). Use instead of replaying wishbone_write calls to set up a test.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "slot": {
+                        "type": "integer",
+                        "description": "Snapshot slot (default 0)"
+                    },
+                    "load": {
+                        "type": "boolean",
+                        "description": "Read the slot from NVS first"
+                    },
+                    "path": {
+                        "type": "string",
+                        "description": "Upload this saved snapshot file into the slot first"
+                    }
+                }
+            }
+        },
+        {
+            "name": "list_snapshots",
+            "description": "List the snapshot slots and the address ranges a snapshot covers.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "get_notifications",
+            "description": "Return the unsolicited breakpoint messages the board sent since the last call (hit and continue lines, with host timestamps).",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "list_breakpoints",
+            "description": "List the MCP_BREAKPOINT sites the sketch has run so far, with their ID, enable, hit count, hit threshold and register condition.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "configure_breakpoint",
+            "description": "Configure one breakpoint site (ID from list_breakpoints): enable/disable it, only break after a number of hits, or only break while a Wishbone register matches (value & mask) == expected.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "site": {
+                        "type": "integer",
+                        "description": "Site ID from list_breakpoints"
+                    },
+                    "enabled": {
+                        "type": "boolean",
+                        "description": "Enable or disable this site"
+                    },
+                    "break_after": {
+                        "type": "integer",
+                        "description": "Number of hits that pass before the site breaks (0 = every hit)"
+                    },
+                    "condition_address": {
+                        "type": "string",
+                        "description": "Hex Wishbone address the condition reads (e.g., '8100'); empty string clears the condition"
+                    },
+                    "condition_mask": {
+                        "type": "string",
+                        "description": "Hex mask applied to the register (default 'FF')"
+                    },
+                    "condition_value": {
+                        "type": "string",
+                        "description": "Hex value the masked register must equal (default '00')"
+                    },
+                    "reset_hits": {
+                        "type": "boolean",
+                        "description": "Reset the site's hit count"
+                    }
+                },
+                "required": ["site"]
+            }
+        },
+        {
+            "name": "set_watchpoint",
+            "description": "Watch a Wishbone register on the board itself: the firmware samples it from a hardware timer (1 kHz by default) and reports within one period when (value & mask) changes, or becomes a given value. Matches arrive as watch events (wait_for_event, MCP notifications) and in get_notifications; the sketch can also be paused on a match.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "address": {
+                        "type": "string",
+                        "description": "Hex Wishbone address (e.g., '0000' for the video mode)"
+                    },
+                    "mask": {
+                        "type": "string",
+                        "description": "Hex mask of the bits to watch (default 'FF')"
+                    },
+                    "value": {
+                        "type": "string",
+                        "description": "Hex value: match when the masked register becomes it (default: any change)"
+                    },
+                    "pause": {
+                        "type": "boolean",
+                        "description": "Also pause the sketch on a match",
+                        "default": False
+                    },
+                    "period_us": {
+                        "type": "integer",
+                        "description": "Sample period in microseconds for all watchpoints (minimum 100)"
+                    }
+                },
+                "required": ["address"]
+            }
+        },
+        {
+            "name": "clear_watchpoint",
+            "description": "Remove a watchpoint by ID (from list_watchpoints), or all of them when no ID is given.",
             "inputSchema": {
                 "type": "object",
                 "properties": {
-                    "paused": {
-                        "type": "boolean",
-                        "description": "True to pause the sketch, False to resume"
+                    "id": {
+                        "type": "integer",
+                        "description": "Watchpoint ID"
                     }
-                },
-                "required": ["paused"]
+                }
             }
         },
         {
-            "name": "get_pause_status",
-            "description": "Get the current pause status of the sketch.",
+            "name": "list_watchpoints",
+            "description": "List the board's watchpoints with their conditions, match counts and last sampled values.",
             "inputSchema": {
                 "type": "object",
                 "properties": {}
             }
         },
         {
-            "name": "continue_from_breakpoint",
-            "description": "Continue execution from a breakpoint. Use this when the sketch is stopped at a breakpoint.",
+            "name": "list_serial_ports",
+            "description": "List available serial ports for connecting to the Papilio board.",
             "inputSchema": {
                 "type": "object",
                 "properties": {}
             }
         },
         {
-            "name": "set_breakpoints_enabled",
-            "description": "Enable or disable all breakpoints globally. When disabled, breakpoint() calls in the sketch are skipped.",
+            "name": "connect_board",
+            "description": "Connect to the Papilio board on a specific serial port. It joins the board pool and becomes the active board; other connected boards stay connected.",
             "inputSchema": {
                 "type": "object",
                 "properties": {
-                    "enabled": {
-                        "type": "boolean",
-                        "description": "True to enable breakpoints, False to disable (skip all breakpoints)"
+                    "port": {
+                        "type": "string",
+                        "description": "Serial port name (e.g., COM4, /dev/ttyUSB0)"
                     }
                 },
-                "required": ["enabled"]
+                "required": ["port"]
             }
         },
         {
-            "name": "list_serial_ports",
-            "description": "List available serial ports for connecting to the Papilio board.",
+            "name": "list_boards",
+            "description": "List the boards in the pool with port, USB serial number and firmware features. The active board (*) serves calls without a board argument.",
             "inputSchema": {
                 "type": "object",
                 "properties": {}
             }
         },
         {
-            "name": "connect_board",
-            "description": "Connect to the Papilio board on a specific serial port.",
+            "name": "scan_boards",
+            "description": "Connect to every detected board in parallel and check its firmware (binary protocol, request tags). Use before broadcasting with board='all'.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
+        {
+            "name": "select_board",
+            "description": "Make a board in the pool the active one (port or USB serial number).",
             "inputSchema": {
                 "type": "object",
                 "properties": {
-                    "port": {
+                    "board": {
                         "type": "string",
-                        "description": "Serial port name (e.g., COM4, /dev/ttyUSB0)"
+                        "description": "Port or USB serial number"
                     }
                 },
-                "required": ["port"]
+                "required": ["board"]
             }
         },
         {
             "name": "disconnect_board",
-            "description": "Disconnect from the Papilio board to free the serial port. Use this before flashing the FPGA.",
+            "description": "Disconnect from the Papilio board to free the serial port and drop it from the pool. Use this before flashing the FPGA.",
             "inputSchema": {
                 "type": "object",
                 "properties": {}
@@ -765,6 +2984,16 @@ def handle_tools_list(request_id):
                         "minimum": 5,
                         "maximum": 100
                     },
+                    "changes_only": {
+                        "type": "boolean",
+                        "description": "Return only the region that changed since the previous capture (no image when nothing changed).",
+                        "default": False
+                    },
+                    "fresh": {
+                        "type": "boolean",
+                        "description": "With the camera stream on, wait for a frame taken after this call, e.g. right after a register write (tens of ms).",
+                        "default": False
+                    },
                     "max_inline_bytes": {
                         "type": "integer",
                         "description": "Max base64 length before omitting image.",
@@ -781,6 +3010,20 @@ def handle_tools_list(request_id):
                 "properties": {}
             }
         },
+        {
+            "name": "set_camera_stream",
+            "description": "Start or stop the background camera capture thread. While it runs, capture_screenshot returns the newest frame without camera warm-up.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "enabled": {
+                        "type": "boolean",
+                        "description": "true to start the stream, false to stop it"
+                    }
+                },
+                "required": ["enabled"]
+            }
+        },
         {
             "name": "set_camera",
             "description": "Set which camera index to use for screenshots.",
@@ -834,6 +3077,56 @@ def handle_tools_list(request_id):
                 "properties": {}
             }
         },
+        {
+            "name": "telemetry_start",
+            "description": "Start streaming register samples from the board. The firmware samples the addresses on a hardware timer and pushes timestamped records; the server keeps the latest samples in a ring buffer for telemetry_read.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "addresses": {
+                        "type": "array",
+                        "items": {"type": "string"},
+                        "description": "Wishbone addresses to sample, hex (e.g. [\"8100\", \"8300\"]), up to 16"
+                    },
+                    "period_us": {
+                        "type": "integer",
+                        "description": "Sample period in microseconds (minimum 100)",
+                        "minimum": 100,
+                        "default": 1000
+                    },
+                    "buffer_size": {
+                        "type": "integer",
+                        "description": "Samples kept on the host",
+                        "minimum": 1,
+                        "default": 1000
+                    }
+                },
+                "required": ["addresses"]
+            }
+        },
+        {
+            "name": "telemetry_read",
+            "description": "Return the latest buffered telemetry samples with their device timestamps.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "count": {
+                        "type": "integer",
+                        "description": "Number of most recent samples to return",
+                        "minimum": 1,
+                        "default": 20
+                    }
+                }
+            }
+        },
+        {
+            "name": "telemetry_stop",
+            "description": "Stop the telemetry stream.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {}
+            }
+        },
         {
             "name": "set_video_mode",
             "description": "Set the FPGA video output mode. Modes: 0=Test pattern (color bars, grid, grayscale), 1=Text mode (80x26), 2=Framebuffer (160x120).",
@@ -858,6 +3151,54 @@ def handle_tools_list(request_id):
                 "properties": {}
             }
         },
+        {
+            "name": "framebuffer_blit",
+            "description": "Upload RGB332 pixels to a rectangle of the 160x120 framebuffer. The data is RLE coded and only pixels changed since the previous blit are sent, decoded on the board with burst writes.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "pixels": {
+                        "type": "string",
+                        "description": "width*height RGB332 bytes as hex, row-major. Omit to fill with 'color'."
+                    },
+                    "color": {
+                        "type": "integer",
+                        "description": "Fill colour (RGB332) when pixels is omitted",
+                        "minimum": 0,
+                        "maximum": 255,
+                        "default": 0
+                    },
+                    "x": {
+                        "type": "integer",
+                        "description": "Left column (0-159)",
+                        "minimum": 0,
+                        "maximum": 159,
+                        "default": 0
+                    },
+                    "y": {
+                        "type": "integer",
+                        "description": "Top row (0-119)",
+                        "minimum": 0,
+                        "maximum": 119,
+                        "default": 0
+                    },
+                    "width": {
+                        "type": "integer",
+                        "description": "Rectangle width",
+                        "minimum": 1,
+                        "maximum": 160,
+                        "default": 160
+                    },
+                    "height": {
+                        "type": "integer",
+                        "description": "Rectangle height",
+                        "minimum": 1,
+                        "maximum": 120,
+                        "default": 120
+                    }
+                }
+            }
+        },
         {
             "name": "text_clear",
             "description": "Clear the text mode screen (fill with spaces).",
@@ -866,6 +3207,61 @@ def handle_tools_list(request_id):
                 "properties": {}
             }
         },
+        {
+            "name": "text_fill",
+            "description": "Fill a rectangle of the text screen with one character and color. Only cells that change are sent to the FPGA.",
+            "inputSchema": {
+                "type": "object",
+                "properties": {
+                    "x": {
+                        "type": "integer",
+                        "description": "Left column (0-79)",
+                        "minimum": 0,
+                        "maximum": 79
+                    },
+                    "y": {
+                        "type": "integer",
+                        "description": "Top row (0-25)",
+                        "minimum": 0,
+                        "maximum": 25
+                    },
+                    "width": {
+                        "type": "integer",
+                        "description": "Columns",
+                        "minimum": 1,
+                        "maximum": 80,
+                        "default": 80
+                    },
+                    "height": {
+                        "type": "integer",
+                        "description": "Rows",
+                        "minimum": 1,
+                        "maximum": 26,
+                        "default": 1
+                    },
+                    "char": {
+                        "type": "string",
+                        "description": "Fill character",
+                        "default": " "
+                    },
+                    "foreground": {
+                        "type": "integer",
+                        "description": "Foreground color (0-15)",
+                        "minimum": 0,
+                        "maximum": 15,
+                        "default": 15
+                    },
+                    "background": {
+                        "type": "integer",
+                        "description": "Background color (0-15)",
+                        "minimum": 0,
+                        "maximum": 15,
+                        "default": 0
+                    }
+                },
+                "required": ["x", "y"]
+            }
+        },
         {
             "name": "text_set_cursor",
             "description": "Set the text cursor position for text mode.",
@@ -966,6 +3362,9 @@ def handle_tools_list(request_id):
             }
         }
     ]
+    for tool in tools:
+        if tool["name"] not in HOST_TOOLS:
+            tool["inputSchema"]["properties"]["board"] = BOARD_ARGUMENT
     
     return {
         "jsonrpc": "2.0",
@@ -978,10 +3377,47 @@ def handle_tools_list(request_id):
 
 def handle_tools_call(request_id, params):
     """Handle tools/call request."""
-    global logic_analyzer
     tool_name = params.get("name")
-    arguments = params.get("arguments", {})
+    arguments = dict(params.get("arguments", {}))
+    key = None if tool_name in HOST_TOOLS else arguments.pop("board", None)
+    
+    try:
+        if tool_name in HOST_TOOLS:
+            content = run_tool(boards.active, tool_name, arguments)
+        elif key == "all":
+            results = boards.run_all(lambda b: run_tool(b, tool_name, arguments),
+                                     boards.snapshot(connected=True))
+            content = "\n\n".join(f"[{boards.name(b)}]\n{text}" for b, text in results)
+            if not results:
+                content = "No connected boards (use scan_boards or connect_board)"
+        else:
+            board = boards.find(key) if key else boards.active
+            if board is None:
+                content = f"Unknown board: {key} (see list_boards)"
+            else:
+                content = boards.run(board, run_tool, board, tool_name, arguments)
+    except Exception as e:
+        content = f"Error: {str(e)}"
+    
+    return {
+        "jsonrpc": "2.0",
+        "id": request_id,
+        "result": {
+            "content": content if isinstance(content, list) else [
+                {
+                    "type": "text",
+                    "text": content
+                }
+            ]
+        }
+    }
+
+
+def run_tool(controller: PapilioController, tool_name: str, arguments: dict):
+    """Run one tool call against one board.
     
+    Returns its text, or a list of MCP content items (text and image).
+    """
     try:
         if tool_name == "set_rgb_led":
             red = arguments.get("red", 0)
@@ -1006,9 +3442,9 @@ def handle_tools_call(request_id, params):
             content = f"Write 0x{data:02X} to 0x{address:04X}: {result}"
             
         elif tool_name == "logic_analyzer_status":
-            if logic_analyzer is None:
-                logic_analyzer = LogicAnalyzerTool(controller)
-            status = logic_analyzer.get_status()
+            if controller.logic_analyzer is None:
+                controller.logic_analyzer = LogicAnalyzerTool(controller)
+            status = controller.logic_analyzer.get_status()
             content = f"Logic Analyzer Status:\n"
             content += f"  State: {status['state_name']} ({status['state']})\n"
             content += f"  Device ID: {status['device_id']}\n"
@@ -1016,15 +3452,15 @@ def handle_tools_call(request_id, params):
             content += f"  Memory Depth: {status['depth']} samples"
             
         elif tool_name == "logic_analyzer_configure":
-            if logic_analyzer is None:
-                logic_analyzer = LogicAnalyzerTool(controller)
+            if controller.logic_analyzer is None:
+                controller.logic_analyzer = LogicAnalyzerTool(controller)
             trigger_mask = arguments.get("trigger_mask", 0)
             trigger_value = arguments.get("trigger_value", 0)
             samples = arguments.get("samples", 100)
             post_trigger = arguments.get("post_trigger", 50)
             divider = arguments.get("divider", 0)
             
-            result = logic_analyzer.configure(trigger_mask, trigger_value, samples, post_trigger, divider)
+            result = controller.logic_analyzer.configure(trigger_mask, trigger_value, samples, post_trigger, divider)
             content = f"Logic Analyzer Configured:\n"
             content += f"  Trigger Mask: {result['trigger_mask']}\n"
             content += f"  Trigger Value: {result['trigger_value']}\n"
@@ -1033,24 +3469,31 @@ def handle_tools_call(request_id, params):
             content += f"  Divider: {result['divider']}"
             
         elif tool_name == "logic_analyzer_capture":
-            if logic_analyzer is None:
-                logic_analyzer = LogicAnalyzerTool(controller)
+            if controller.logic_analyzer is None:
+                controller.logic_analyzer = LogicAnalyzerTool(controller)
             
             timeout = arguments.get("timeout", 5.0)
             auto_reset = arguments.get("auto_reset", True)
             
             if auto_reset:
                 import time as time_module
-                logic_analyzer.reset()
+                controller.logic_analyzer.reset()
                 time_module.sleep(0.01)
             
-            logic_analyzer.arm()
-            samples = logic_analyzer.capture(timeout)
+            controller.logic_analyzer.arm()
+            samples = controller.logic_analyzer.capture(timeout)
             
             if samples:
                 # Store samples for export
-                logic_analyzer.last_capture = samples
-                content = f"Captured {len(samples)} samples\n\n"
+                controller.logic_analyzer.last_capture = samples
+                content = f"Captured {len(samples)} samples"
+                if getattr(controller.logic_analyzer, 'last_trigger_us', None) is not None:
+                    content += f" (done {controller.logic_analyzer.last_trigger_us / 1000:.2f} ms after arm)"
+                transfer = getattr(controller.logic_analyzer, 'last_transfer', None)
+                if transfer:
+                    content += (f", {transfer['records']} value changes in {transfer['bytes']} bytes "
+                                f"({transfer['raw_bytes']} raw)")
+                content += "\n\n"
                 
                 # Decode and display samples
                 def decode_sample(s):
@@ -1088,19 +3531,23 @@ def handle_tools_call(request_id, params):
                 content = "Capture timeout - no trigger detected or capture failed"
                 
         elif tool_name == "logic_analyzer_export_vcd":
-            if logic_analyzer is None or not hasattr(logic_analyzer, 'last_capture'):
+            if controller.logic_analyzer is None:
+                controller.logic_analyzer = LogicAnalyzerTool(controller)
+            if not hasattr(controller.logic_analyzer, 'last_capture') and controller.logic_analyzer.get_status()["state_name"] == "DONE":
+                controller.logic_analyzer.last_capture = controller.logic_analyzer.read_samples()
+            if not getattr(controller.logic_analyzer, 'last_capture', None):
                 content = "ERROR: No capture data available. Run logic_analyzer_capture first."
             else:
                 filename = arguments.get("filename", "capture.vcd")
-                result = logic_analyzer.export_vcd(logic_analyzer.last_capture, filename)
+                result = controller.logic_analyzer.export_vcd(controller.logic_analyzer.last_capture, filename)
                 content = f"Exported {result['samples']} samples to {result['filename']}\n"
                 content += f"View with: gtkwave {result['filename']}"
         
         elif tool_name == "logic_analyzer_decode_wb_data":
-            if logic_analyzer is None or not hasattr(logic_analyzer, 'last_capture'):
+            if controller.logic_analyzer is None or not hasattr(controller.logic_analyzer, 'last_capture'):
                 content = "ERROR: No capture data available. Run logic_analyzer_capture first."
             else:
-                decoded = logic_analyzer.decode_wb_data_samples(logic_analyzer.last_capture)
+                decoded = controller.logic_analyzer.decode_wb_data_samples(controller.logic_analyzer.last_capture)
                 content = "Decoded Wishbone Data Bus (wb_dat_o[7:0]):\n\n"
                 content += f"Total samples: {len(decoded)}\n\n"
                 
@@ -1118,15 +3565,15 @@ def handle_tools_call(request_id, params):
                     content += "Values: " + ", ".join(f"0x{v:02X}" for v in sorted(unique_vals))
         
         elif tool_name == "logic_analyzer_analyze_wb":
-            if logic_analyzer is None or not hasattr(logic_analyzer, 'last_capture'):
+            if controller.logic_analyzer is None or not hasattr(controller.logic_analyzer, 'last_capture'):
                 content = "ERROR: No capture data available. Run logic_analyzer_capture first."
             else:
                 trigger_value = arguments.get("trigger_value")
                 context_before = arguments.get("context_before", 10)
                 context_after = arguments.get("context_after", 20)
                 
-                result = logic_analyzer.analyze_wb_transactions(
-                    logic_analyzer.last_capture,
+                result = controller.logic_analyzer.analyze_wb_transactions(
+                    controller.logic_analyzer.last_capture,
                     trigger_value=trigger_value,
                     context_before=context_before,
                     context_after=context_after
@@ -1163,6 +3610,44 @@ def handle_tools_call(request_id, params):
             result = controller.get_debug_dump()
             content = f"FPGA Status:\n{result}"
             
+        elif tool_name == "program_fpga":
+            marks = []
+            
+            def progress(done, total):
+                # Progress goes to the server log in 10% steps
+                step = done * 10 // total
+                if not marks or step > marks[-1]:
+                    marks.append(step)
+                    sys.stderr.write(f"program_fpga: {done}/{total} bytes\n")
+                    sys.stderr.flush()
+            
+            result = controller.program_fpga(arguments.get("path"), progress)
+            lines = [f"IDCODE {result['idcode']}" if "idcode" in result else None,
+                     f"{result['bytes']} bytes sent as {result['packed_bytes']} packed "
+                     f"in {result['chunks']} chunks" if "bytes" in result else None,
+                     f"Stream {result['stream_seconds']} s, {result['bytes_per_s']} bytes/s"
+                     if "stream_seconds" in result else None,
+                     f"Status {result['status']}, total {result['seconds']} s"
+                     if "status" in result else None]
+            head = "FPGA programmed" if result["ok"] else f"Programming failed: {result['error']}"
+            content = "\n".join([head] + [line for line in lines if line])
+            
+        elif tool_name == "get_stats":
+            stats = controller.get_stats(arguments.get("reset", False))
+            if stats is None:
+                content = "Stats not available (build the firmware with -DMCP_ENABLE_STATS=1)"
+            else:
+                content = (f"Over {stats['elapsed_ms']} ms: serial in {stats['serial_in']} B, "
+                           f"out {stats['serial_out']} B, dropped {stats['serial_dropped']} B\n")
+                for cls in ("sketch", "debug"):
+                    spi = stats["spi_" + cls]
+                    content += f"SPI {cls}: {spi['transactions']} transactions, {spi['bytes']} bytes\n"
+                for kind, table in (("Command", stats["commands"]), ("Opcode", stats["opcodes"])):
+                    for name, entry in table.items():
+                        buckets = " ".join(f"<{edge:.0f}us:{n}" for edge, n in entry["histogram"] if n)
+                        content += (f"{kind} {name}: {entry['count']}x mean {entry['mean_us']:.1f}us "
+                                    f"max {entry['max_us']:.1f}us  {buckets}\n")
+        
         elif tool_name == "pause_sketch":
             paused = arguments.get("paused", True)
             if not controller.connect():
@@ -1175,8 +3660,7 @@ def handle_tools_call(request_id, params):
             if not controller.connect():
                 content = "ERROR: Not connected to board"
             else:
-                result = controller.send_command("P")
-                content = f"Pause status: {result}"
+                content = f"Pause status: {controller.pause_status()}"
                 
         elif tool_name == "continue_from_breakpoint":
             if not controller.connect():
@@ -1185,6 +3669,18 @@ def handle_tools_call(request_id, params):
                 result = controller.send_command("C")
                 content = f"Continue: {result}"
                 
+        elif tool_name == "wait_for_event":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            elif not controller.events:
+                content = "Firmware sends no event frames (PapilioMCP.h with the binary protocol needed)"
+            else:
+                event = controller.wait_event(arguments.get("events"), arguments.get("timeout", 10))
+                if event is None:
+                    content = "No event before the timeout"
+                else:
+                    content = f"{event['text']}\n{json.dumps(event)}"
+                
         elif tool_name == "set_breakpoints_enabled":
             enabled = arguments.get("enabled", True)
             if not controller.connect():
@@ -1193,6 +3689,102 @@ def handle_tools_call(request_id, params):
                 result = controller.send_command(f"B {1 if enabled else 0}")
                 content = f"Breakpoints {'enabled' if enabled else 'disabled'}: {result}"
             
+        elif tool_name == "save_snapshot":
+            content = controller.save_snapshot(arguments.get("slot", 0), arguments.get("path"),
+                                               arguments.get("persist", False))
+            
+        elif tool_name == "restore_snapshot":
+            content = controller.restore_snapshot(arguments.get("slot", 0), arguments.get("path"),
+                                                  arguments.get("load", False))
+            
+        elif tool_name == "list_snapshots":
+            result = controller.list_snapshots()
+            if result is None:
+                content = "Firmware has no register snapshots"
+            else:
+                lines = [f"{result['bytes']} bytes per snapshot, layout {result['layout']}"]
+                lines += [f"  {r['name']}: 0x{r['start']:04X}, {r['length']} bytes" for r in result["ranges"]]
+                lines += [f"  slot {sl['slot']}: " + (f"CRC {sl['crc']}" if sl["valid"] else "empty")
+                          for sl in result["slots"]]
+                content = "\n".join(lines)
+            
+        elif tool_name == "get_notifications":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                items = controller.notifications()
+                if items:
+                    content = "\n".join(time.strftime("%H:%M:%S", time.localtime(t)) +
+                                        f".{int(t * 1000) % 1000:03d} {text}" for t, text in items)
+                else:
+                    content = "No notifications"
+                    
+        elif tool_name == "list_breakpoints":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                result = controller.list_breakpoints()
+                if result is None:
+                    content = "Firmware has no per-site breakpoints"
+                else:
+                    lines = [f"Breakpoints {'enabled' if result['enabled'] else 'disabled'}, "
+                             f"{result['hits']} breaks, {len(result['sites'])} sites"]
+                    for site in result["sites"]:
+                        line = (f"  {site['id']:2d} {site['name']}: {'on' if site['enabled'] else 'off'}, "
+                                f"hits={site['hits']} after={site['after']}")
+                        cond = site["condition"]
+                        if cond:
+                            line += f" if [{cond['address']:04X}] & {cond['mask']:02X} == {cond['value']:02X}"
+                        lines.append(line)
+                    content = "\n".join(lines)
+                    
+        elif tool_name == "configure_breakpoint":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                condition = None
+                address = arguments.get("condition_address")
+                if address:
+                    condition = (int(address, 16), int(arguments.get("condition_mask", "FF"), 16),
+                                 int(arguments.get("condition_value", "00"), 16))
+                content = controller.configure_breakpoint(
+                    int(arguments["site"]), enabled=arguments.get("enabled"),
+                    after=arguments.get("break_after"), condition=condition,
+                    clear_condition=address == "", reset_hits=arguments.get("reset_hits", False))
+            
+        elif tool_name == "set_watchpoint":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                value = arguments.get("value")
+                content = controller.set_watchpoint(
+                    int(arguments["address"], 16), int(arguments.get("mask", "FF"), 16),
+                    int(value, 16) if value else None, arguments.get("pause", False),
+                    arguments.get("period_us"))
+                
+        elif tool_name == "clear_watchpoint":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                content = controller.clear_watchpoint(arguments.get("id"))
+                
+        elif tool_name == "list_watchpoints":
+            if not controller.connect():
+                content = "ERROR: Not connected to board"
+            else:
+                result = controller.list_watchpoints()
+                if result is None:
+                    content = "Firmware has no watchpoints"
+                else:
+                    lines = [f"{len(result['watches'])} watchpoints @ {result['period_us']} us, "
+                             f"{result['samples']} samples, {result['dropped']} matches dropped"]
+                    for w in result["watches"]:
+                        cond = "any change" if w["value"] is None else f"== {w['value']:02X}"
+                        lines.append(f"  {w['id']:2d} [{w['address']:04X}] & {w['mask']:02X} {cond}"
+                                     f"{', pauses' if w['pause'] else ''}: hits={w['hits']} "
+                                     f"last={w['last']:02X}")
+                    content = "\n".join(lines)
+            
         elif tool_name == "list_serial_ports":
             ports = serial.tools.list_ports.comports()
             port_list = [f"{p.device}: {p.description}" for p in ports]
@@ -1200,16 +3792,33 @@ def handle_tools_call(request_id, params):
             
         elif tool_name == "connect_board":
             port = arguments.get("port")
-            controller.port = port
-            controller.disconnect()
-            if controller.connect():
+            board = boards.add(port)
+            boards.run(board, board.disconnect)
+            if boards.run(board, board.connect):
+                boards.active = board
                 content = f"Connected to {port}"
             else:
                 content = f"Failed to connect to {port}"
                 
         elif tool_name == "disconnect_board":
-            controller.disconnect()
-            content = "Disconnected from board. Serial port is now free."
+            name = boards.name(controller)
+            boards.remove(controller)
+            content = f"Disconnected from {name}. Serial port is now free."
+            
+        elif tool_name == "list_boards":
+            content = "\n".join(boards.describe(b) for b in boards.snapshot())
+            
+        elif tool_name == "scan_boards":
+            results = boards.scan()
+            content = "\n".join(boards.describe(b) for b, _ in results) or "No boards found"
+            
+        elif tool_name == "select_board":
+            board = boards.find(arguments.get("board", ""))
+            if board is None:
+                content = f"Unknown board: {arguments.get('board')} (see list_boards)"
+            else:
+                boards.active = board
+                content = f"Active board: {boards.name(board)}"
             
         elif tool_name == "send_raw_command":
             command = arguments.get("command", "")
@@ -1221,10 +3830,10 @@ def handle_tools_call(request_id, params):
                 content = "ERROR: Not connected to board"
             else:
                 try:
+                    controller.memory_written()   # Any raw command may write memory
                     controller.serial.reset_input_buffer()
                     controller.serial.write(f"{command}\n".encode())
                     controller.serial.flush()
-                    import time
                     start_time = time.time()
                     response_lines = []
                     termination_markers = ("OK", "ERR", "DONE", "END")
@@ -1260,42 +3869,24 @@ def handle_tools_call(request_id, params):
             scale_percent = arguments.get("scale_percent", 100)
             max_inline_bytes = arguments.get("max_inline_bytes", 300000)
             result = webcam.capture(save_to_file=save_to_file, filename=filename,
-                                    format=format, quality=quality, warmup_frames=warmup_frames)
+                                    format=format, quality=quality, warmup_frames=warmup_frames,
+                                    scale_percent=scale_percent,
+                                    changes_only=arguments.get("changes_only", False),
+                                    fresh=arguments.get("fresh", False))
             if result["success"]:
                 content = result["message"]
                 if "filepath" in result:
                     content += f"\nSaved to: {result['filepath']}"
                 image_b64 = result.get("image_base64")
                 mime_type = result.get("mime_type", "image/jpeg")
-                if scale_percent != 100 and OPENCV_AVAILABLE and image_b64:
-                    try:
-                        import numpy as np
-                        img_bytes = base64.b64decode(image_b64)
-                        img_array = np.frombuffer(img_bytes, dtype=np.uint8)
-                        frame = cv2.imdecode(img_array, cv2.IMREAD_COLOR)
-                        new_w = max(1, int(frame.shape[1] * scale_percent / 100))
-                        new_h = max(1, int(frame.shape[0] * scale_percent / 100))
-                        resized = cv2.resize(frame, (new_w, new_h), interpolation=cv2.INTER_AREA)
-                        if format == "jpeg" or format == "jpg":
-                            _, buf = cv2.imencode('.jpg', resized, [cv2.IMWRITE_JPEG_QUALITY, quality])
-                            mime_type = "image/jpeg"
-                        else:
-                            _, buf = cv2.imencode('.png', resized)
-                            mime_type = "image/png"
-                        image_b64 = base64.b64encode(buf).decode('utf-8')
-                    except Exception:
-                        content += "\n[Warning: scaling failed]"
+                if image_b64 and len(image_b64) > max_inline_bytes:
+                    content += f"\n[Image omitted: {len(image_b64)} base64 bytes > max_inline_bytes]"
+                    image_b64 = None
                 if inline_image and image_b64:
-                    return {
-                        "jsonrpc": "2.0",
-                        "id": request_id,
-                        "result": {
-                            "content": [
-                                {"type": "text", "text": content},
-                                {"type": "image", "data": image_b64, "mimeType": mime_type}
-                            ]
-                        }
-                    }
+                    return [
+                        {"type": "text", "text": content},
+                        {"type": "image", "data": image_b64, "mimeType": mime_type}
+                    ]
             else:
                 content = f"Screenshot failed: {result['message']}"
         
@@ -1308,11 +3899,26 @@ def handle_tools_call(request_id, params):
         
         elif tool_name == "set_camera":
             camera_index = arguments.get("camera_index", 0)
-            # Release old camera if changing index
+            # Release old camera if changing index (a running stream moves along)
             if camera_index != webcam.camera_index:
+                streaming = webcam.streaming
                 webcam.release_camera()
-            webcam.camera_index = camera_index
+                webcam.camera_index = camera_index
+                if streaming:
+                    webcam.start_stream()
             content = f"Camera index set to {camera_index}"
+            
+        elif tool_name == "set_camera_stream":
+            if not arguments.get("enabled", True):
+                webcam.stop_stream()
+                content = "Camera stream stopped"
+            elif webcam.start_stream():
+                status = webcam.frame_after() and webcam.stream_status()
+                content = f"Camera stream running on camera {webcam.camera_index}"
+                if status and status["fps"]:
+                    content += f", {status['fps']} fps"
+            else:
+                content = f"Could not start the camera stream (camera {webcam.camera_index}, OpenCV installed?)"
         
         elif tool_name == "set_screenshot_crop":
             x = arguments.get("x", 0)
@@ -1326,38 +3932,90 @@ def handle_tools_call(request_id, params):
             webcam.clear_crop_region()
             content = "Crop region cleared - will capture full frame"
         
+        elif tool_name == "telemetry_start":
+            addresses = [int(str(a), 16) for a in arguments.get("addresses", [])]
+            period_us = arguments.get("period_us", 1000)
+            error = controller.telemetry_start(addresses, period_us,
+                                               arguments.get("buffer_size", TELEMETRY_DEPTH))
+            if error:
+                content = f"ERROR: {error}"
+            else:
+                content = (f"Sampling {', '.join(f'0x{a:04X}' for a in addresses)} "
+                           f"every {period_us} us")
+        
+        elif tool_name == "telemetry_read":
+            samples = controller.telemetry_read(arguments.get("count", 20))
+            status = controller.telemetry_status()
+            if status is None:
+                content = "No telemetry subscription running"
+            else:
+                content = (f"{status['received']} samples received, {status['lost']} lost, "
+                           f"{status['buffered']} buffered\n")
+                for sample in samples:
+                    values = " ".join(f"{a:04X}={v:02X}" for a, v in sample["values"].items())
+                    content += f"  #{sample['seq']:5d} t={sample['time_us']:>10d}us  {values}\n"
+        
+        elif tool_name == "telemetry_stop":
+            status = controller.telemetry_stop()
+            if status is None:
+                content = "No telemetry subscription running"
+            else:
+                content = f"Telemetry stopped: {status['received']} samples, {status['lost']} lost"
+        
         # Video mode control tools
         elif tool_name == "set_video_mode":
             mode = arguments.get("mode", 0)
-            # Video mode register is at 0x0000 (modular architecture)
-            result = controller.wishbone_write(0x0000, mode)
+            addr = controller.register_address("VIDEO_MODE", VIDEO_MODE_DEFAULT)
+            result = controller.wishbone_write(addr, mode)
             mode_names = {0: "Test pattern", 1: "Text mode", 2: "Framebuffer"}
             content = f"Set video mode to {mode} ({mode_names.get(mode, 'Unknown')})"
             
         elif tool_name == "get_video_mode":
-            mode = controller.wishbone_read(0x0000) & 0x03
+            addr = controller.register_address("VIDEO_MODE", VIDEO_MODE_DEFAULT)
+            mode = controller.wishbone_read(addr) & 0x03
             mode_names = {0: "Test pattern", 1: "Text mode", 2: "Framebuffer"}
             content = f"Video mode: {mode} ({mode_names.get(mode, 'Unknown')})"
         
+        elif tool_name == "framebuffer_blit":
+            x = arguments.get("x", 0)
+            y = arguments.get("y", 0)
+            width = arguments.get("width", FB_WIDTH)
+            height = arguments.get("height", FB_HEIGHT)
+            if "pixels" in arguments:
+                pixels = bytes.fromhex(arguments["pixels"])
+            else:
+                pixels = bytes([arguments.get("color", 0) & 0xFF]) * (width * height)
+            result = controller.framebuffer_blit(pixels, x, y, width, height)
+            if result["ok"]:
+                content = (f"Blitted {width}x{height} at ({x}, {y}): {result['bytes']} bytes sent, "
+                           f"{result['pixels']} pixels written")
+            else:
+                content = f"Blit failed after sending {result['bytes']} bytes"
+        
         # Text mode tools (addresses 0x0020-0x00FF in modular architecture)
         elif tool_name == "text_clear":
-            # Set cursor to 0,0
-            controller.wishbone_write(0x0021, 0)  # cursor_x
-            controller.wishbone_write(0x0022, 0)  # cursor_y
-            # Fill with spaces (80x26 = 2080 characters)
-            controller.wishbone_write(0x0023, 0x0F)  # White on black
-            for i in range(2080):
-                controller.wishbone_write(0x0024, 0x20)  # Space character
-            # Reset cursor
-            controller.wishbone_write(0x0021, 0)
-            controller.wishbone_write(0x0022, 0)
+            # White-on-black spaces over the whole screen, cursor back to 0,0
+            controller.text_fill(0, 0, TEXT_COLS, TEXT_ROWS, " ", 0x0F)
+            controller.wishbone_batch([("W", TEXT_CURSOR_X, b"\x00\x00")])
             content = "Text screen cleared"
             
+        elif tool_name == "text_fill":
+            x = arguments.get("x", 0)
+            y = arguments.get("y", 0)
+            width = arguments.get("width", TEXT_COLS)
+            height = arguments.get("height", 1)
+            char = arguments.get("char", " ")
+            fg = arguments.get("foreground", 15)
+            bg = arguments.get("background", 0)
+            attr = ((bg & 0x0F) << 4) | (fg & 0x0F)
+            controller.text_fill(x, y, width, height, char, attr)
+            content = f"Filled {width}x{height} at ({x}, {y}) with '{char[:1] or ' '}' fg={fg}, bg={bg}"
+            
         elif tool_name == "text_set_cursor":
             x = arguments.get("x", 0)
             y = arguments.get("y", 0)
-            controller.wishbone_write(0x0021, x & 0x7F)  # cursor_x
-            controller.wishbone_write(0x0022, y & 0x1F)  # cursor_y
+            # cursor_x, cursor_y in one write
+            controller.wishbone_batch([("W", 0x0021, bytes([x & 0x7F, y & 0x1F]))])
             content = f"Cursor set to ({x}, {y})"
             
         elif tool_name == "text_set_color":
@@ -1369,8 +4027,7 @@ def handle_tools_call(request_id, params):
             
         elif tool_name == "text_write":
             text = arguments.get("text", "")
-            for ch in text:
-                controller.wishbone_write(0x0024, ord(ch) & 0xFF)
+            controller.wishbone_batch([("F", 0x0024, bytes(ord(ch) & 0xFF for ch in text))])
             content = f"Wrote {len(text)} characters"
             
         elif tool_name == "text_write_at":
@@ -1379,15 +4036,9 @@ def handle_tools_call(request_id, params):
             text = arguments.get("text", "")
             fg = arguments.get("foreground", 15)
             bg = arguments.get("background", 0)
-            # Set position
-            controller.wishbone_write(0x0021, x & 0x7F)
-            controller.wishbone_write(0x0022, y & 0x1F)
-            # Set color
+            # Only changed cells are sent when the firmware has the text engine
             attr = ((bg & 0x0F) << 4) | (fg & 0x0F)
-            controller.wishbone_write(0x0023, attr)
-            # Write characters
-            for ch in text:
-                controller.wishbone_write(0x0024, ord(ch) & 0xFF)
+            controller.text_draw(x, y, text, attr)
             content = f"Wrote '{text}' at ({x}, {y}) with fg={fg}, bg={bg}"
         
         else:
@@ -1395,19 +4046,7 @@ def handle_tools_call(request_id, params):
             
     except Exception as e:
         content = f"Error: {str(e)}"
-    
-    return {
-        "jsonrpc": "2.0",
-        "id": request_id,
-        "result": {
-            "content": [
-                {
-                    "type": "text",
-                    "text": content
-                }
-            ]
-        }
-    }
+    return content
 
 
 def process_request(request: dict) -> Optional[dict]:
@@ -1418,9 +4057,17 @@ def process_request(request: dict) -> Optional[dict]:
     
     if method == "initialize":
         return handle_initialize(request_id, params)
-    elif method == "initialized":
-        # Notification, no response needed
+    elif method in ("initialized", "notifications/initialized"):
+        # Notification, no response needed; board events may be pushed now
+        mcp_session["initialized"] = True
         return None
+    elif method == "logging/setLevel":
+        level = params.get("level", "info")
+        if level not in LOG_LEVELS:
+            return {"jsonrpc": "2.0", "id": request_id,
+                    "error": {"code": -32602, "message": f"Unknown log level: {level}"}}
+        mcp_session["log_level"] = level
+        return {"jsonrpc": "2.0", "id": request_id, "result": {}}
     elif method == "tools/list":
         return handle_tools_list(request_id)
     elif method == "tools/call":
@@ -1444,16 +4091,23 @@ def main():
     parser = argparse.ArgumentParser(description="Papilio Arcade MCP Server")
     parser.add_argument("--port", help="Serial port (e.g., COM4)", default=None)
     parser.add_argument("--baud", type=int, help="Baud rate", default=115200)
+    parser.add_argument("--protocol", choices=["auto", "ascii"], default="auto",
+                        help="auto = use the binary protocol when the firmware supports it")
     parser.add_argument("--screenshots-dir", help="Directory to save screenshots", default=None)
+    parser.add_argument("--camera-stream", action="store_true",
+                        help="Start the background camera capture thread at startup")
     args = parser.parse_args()
     
     # Configure controller
     controller.port = args.port
     controller.baud = args.baud
+    controller.protocol = args.protocol
     
     # Configure webcam screenshot directory
     if args.screenshots_dir:
         webcam.save_dir = args.screenshots_dir
+    if args.camera_stream:
+        webcam.start_stream()
     
     # Read from stdin, write to stdout (MCP stdio transport)
     while True:
@@ -1470,8 +4124,7 @@ def main():
             response = process_request(request)
             
             if response:
-                sys.stdout.write(json.dumps(response) + "\n")
-                sys.stdout.flush()
+                write_message(response)
                 
         except json.JSONDecodeError as e:
             error_response = {
@@ -1482,8 +4135,7 @@ def main():
                     "message": f"Parse error: {str(e)}"
                 }
             }
-            sys.stdout.write(json.dumps(error_response) + "\n")
-            sys.stdout.flush()
+            write_message(error_response)
         except Exception as e:
             # Log to stderr for debugging
             sys.stderr.write(f"Error: {str(e)}\n")
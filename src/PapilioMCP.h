@@ -16,6 +16,16 @@
        if (PapilioMCP.isPaused()) return;  // Skip sketch code when paused
        // ... your sketch code ...
   
+  Optional features (telemetry, events, watchpoints, text engine, logic
+  analyzer, snapshots, JTAG programming, instrumentation) are compiled out
+  unless built with -DMCP_ENABLE_<X>=1; the shadow cache is on by default.
+  
+  Task mode (optional): call PapilioMCP.beginTask() instead of begin() to
+  run the command service in its own FreeRTOS task (core 0 by default).
+  update() then does nothing, commands are answered independently of the
+  sketch's loop time, and breakpoint()/waitWhilePaused() block on an event
+  group instead of polling.
+  
   When enabled, you can use AI assistants (via MCP server) or
   serial commands to read/write FPGA registers, control LED, etc.
   
@@ -23,29 +33,354 @@
     H             - Help
     W AAAA DD     - Write DD to Wishbone address AAAA
     R AAAA        - Read from Wishbone address AAAA  
-    D             - Dump debug registers
-    J [1|0]       - Enable/disable JTAG bridge
+    M AAAA NN     - Read NN (or NNNN, max 256) bytes from AAAA on one line
+    X AAAA LLLL   - Stream LLLL bytes from AAAA in numbered chunks + CRC
+    Q op;op;...   - Run a batch of Wishbone ops back-to-back (see below)
+    E S|F|R|I ... - Text engine: string, fill, cell rectangle, invalidate (below)
+    S PPPPPPPP AAAA [AAAA ...] - Sample the addresses every PPPPPPPP us (below)
+    S 0        - Stop sampling; S alone shows the subscription
+    A AAAA MM VV [TTTTTTTT [IIII]] - Wait until (AAAA & MM) == VV on the device,
+                    timeout T us (default 1 s), I us between reads (default 0).
+                    Under update() it runs in MCP_AWAIT_SLICE_US steps between
+                    loop() passes; later commands wait for its reply.
+    D             - Dump the register map (MCP_REGISTER_MAP, below)
+    N [S|R|P|L|D [n]] - Register snapshot slot n: save, restore, persist to
+                    NVS, load from NVS, dump (N alone lists the slots; below)
+    N W n OOOO HH.. - Upload snapshot bytes at offset OOOO into slot n
+    T [AAAA [NN [SSSS]]] - SPI timing: show, or calibrate against the ID
+                    register AAAA (NN bytes, optional scratch RAM SSSS; below)
+    T S HHHHHHHH WWWW - Set the SPI clock (Hz) and read wait (ns) by hand
+    K ...         - Shadow cache: list, declare range, flush (see README)
+    Z [R]         - Instrumentation counters and histograms, R resets (below)
+    J [1|0]       - Enable/disable JTAG bridge (J alone also shows programming)
     P [1|0]       - Pause/resume sketch (MCP takes full control)
     C             - Continue from breakpoint
-    B [1|0]       - Enable/disable breakpoints globally
+    B [1|0]       - List sites / enable or disable breakpoints globally
+    B II 1|0|R    - Enable, disable or reset the hit count of site II
+    B II N NNNNNNNN - Site II only breaks after NNNNNNNN hits
+    B II C [AAAA MM VV] - Site II only breaks while (AAAA & MM) == VV
   
   Breakpoints:
-    Add PapilioMCP.breakpoint("name") in your sketch to pause at that point.
-    Use 'C' command to continue, or 'B 0' to disable all breakpoints.
+    Add MCP_BREAKPOINT("name") to your sketch to pause at that point, and
+    use 'C' to continue. Every use is a site with its own enable, hit count,
+    hit threshold and register condition. A site is registered (and gets
+    its ID) the first time it runs, which also happens while disabled. A
+    disabled site then costs one load and one branch: no counting,
+    formatting or serial. Enabled sites count hits without any I/O until
+    the threshold and condition let them break. 'B 0' disables every site.
+    PapilioMCP.breakpoint("name") still works; it looks its site up by name
+    on every call.
+  
+  Serial Output:
+    Replies are formatted into a MCP_TX_BUFFER_SIZE byte ring and drained
+    into Serial only as far as Serial.availableForWrite() allows, at the end
+    of every service pass (update() or the service task). A full USB CDC FIFO
+    therefore never blocks output that fits in the ring. When the ring is full,
+    command replies (and breakpoint messages) wait for the host, draining as
+    it reads. If the host takes nothing for MCP_TX_STALL_MS the rest of the
+    reply is dropped and counted, so a closed port cannot hang the sketch.
+    Telemetry records are never split: a record that does not fit stays in
+    the sample ring and goes out on a later pass. If the samples pile up,
+    the sampler drops them and the host sees a SEQ gap.
+    With MCP_USB_DIRECT=1 (ESP32-S3, Serial on USB-Serial-JTAG) the ring
+    bypasses Serial and fills the 64-byte IN FIFO directly, sending each
+    packet as soon as it is full. Input is read MCP_RX_CHUNK bytes at a time.
+    The sketch must not print to Serial from another task in this mode.
+  
+  Streaming Dump (X):
+    Each chunk line is "X<seq> <hex data>", seq counting from 0000 with up to
+    MCP_STREAM_CHUNK bytes per line, followed by "OK X AAAA LLLL CRC=CCCC".
+    CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over all data bytes.
+  
+  Logic Analyzer (L):
+    L [NNNN] checks the capture block's status for DONE and burst-reads
+    NNNN samples (default MCP_LA_DEPTH). It sends one record per run of
+    identical samples instead of the raw data, in lines of
+    "L<seq> <record> <record> ...":
+      <M><changed bytes>[*<run>]
+    M is a hex nibble; bit b set means byte b (bits 8b+7..8b) changed from
+    the previous record. The changed bytes follow as hex, highest byte first.
+    The first record has M = F. *run (hex) is how many samples hold the
+    value, and is left out when it is 1. For example "F0012A4B0*1F 2C3"
+    means 0012A4B0 for 0x1F samples, then 0012C3B0 for one sample.
+    The reply ends with "OK L NNNN RRRR CRC=CCCC": NNNN samples, RRRR
+    records, and the CRC-16 of X over the raw little-endian sample bytes.
+    Without DONE the reply is "ERR L NOT DONE SS".
+  
+  Batch (Q):
+    Ops are separated by ';' or spaces, all numbers are hex:
+      WAAAA=DD[DD..]   write bytes to AAAA, AAAA+1, ...
+      FAAAA=DD[DD..]   write bytes to AAAA each time (character port, FIFO)
+      FAAAA=DD*NNNN    write DD to AAAA NNNN times
+      RAAAA[:NN]       read NN bytes (default 1, at most FF)
+      PAAAA&MM=VV[@TTTT]  poll until (AAAA & MM) == VV, timeout TTTT ms
+      DNNNN            delay NNNN microseconds
+    Reply: "OK Q NN: DD DD ..." with NN ops run and every read/poll result,
+    or "ERR Q NN <reason>" naming the op that failed: SYNTAX, BAD COUNT (a
+    read over FF bytes), TOO LONG (ops or results past MCP_M_MAX bytes),
+    TIMEOUT, BAD OP or BAD LEN.
+  
+  Text Engine (E):
+    The device keeps a shadow of the 80x26 text screen and only sends cells
+    that differ, as one cursor/attr burst plus one character-port burst per run.
+      E S XX YY AA text              write text at (XX,YY) with attr AA, wraps
+      E F XX YY WW HH CC AA          fill a WWxHH rectangle with char CC attr AA
+      E R XX YY WW HH CCAA[CCAA..]   rectangle of char+attr cells, row-major
+      E I                            forget the shadow (next draw rewrites all)
+      E                              show cells requested / written
+    Any other write to the character port invalidates the shadow.
+  
+  Telemetry (S):
+    A subscription samples up to MCP_SUB_MAX_ADDRS addresses from an esp_timer
+    (hardware timer) callback and queues the samples in a ring. Each service
+    pass sends the queued records as unsolicited binary frames:
+      A5 LEN 80 SEQ_H SEQ_L COUNT TIME_US[4] VALUE[COUNT] CRC
+    SEQ counts samples, so the host sees gaps when the ring overflowed. The
+    timestamp is micros() at sampling time, big-endian.
+  
+  Events (EVENTS frame, MCP_ENABLE_EVENTS):
+    An EVENTS frame with a mask of MCP_EVENT_* kinds (bit kind-1) makes the
+    device push those state changes as unsolicited frames, so a host can
+    wait for a breakpoint instead of polling P or parsing the messages:
+      A5 LEN 81 SEQ_H SEQ_L KIND TIME_US[4] DATA... CRC
+    SEQ counts events, TIME_US is micros() when it happened. KIND and DATA:
+      01 BREAK     SITE BP[2] HITS[4]   stopped at breakpoint #BP of site SITE
+      02 CONTINUE  SITE BP[2]           left that breakpoint
+      03 PAUSE, 04 RESUME               P / P 0 / C on a paused sketch
+      05 JTAG      STATE                MCP_JTAG_STATE_* (inputs, bridge, programming)
+      06 WATCH     ADDR[2] OLD NEW      watched register changed
+    The reply to EVENTS carries the current state, so the host starts in
+    sync: FLAGS (MCP_STATE_*) JTAG_STATE BP[2]. A mask of 0 stops the events
+    (the text messages are sent either way). Events wait for room in the
+    output ring like command replies, so none is lost on a live port.
+  
+  Watchpoints (V, MCP_ENABLE_WATCH):
+    Up to MCP_WATCH_MAX registers are read from an esp_timer callback every
+    MCP_WATCH_PERIOD_US (1 kHz by default), so a change is seen within one
+    period instead of a host R round trip. Watched addresses within
+    MCP_WATCH_GAP bytes of each other share one burst read.
+      V AAAA MM [VV] [P]   watch (AAAA & MM): any change, or becoming VV;
+                           P also pauses the sketch (as P does) on a match
+      V - II | V 0         remove watch II | all of them
+      V T PPPPPPPP         sample period in us (MCP_WATCH_MIN_PERIOD_US min.)
+      V                    list: "V II AAAA MM ANY|=VV [P] hits=n last=XX"
+    A match is queued with its sample time and sent on the next service
+    pass as "[MCP] WATCH II AAAA OO -> NN" and a WATCH event. Matches that
+    overflow the MCP_WATCH_RING queue are counted as dropped. Sampling is
+    skipped while the JTAG pins are acquired for programming.
+  
+  Register Map and Command Table:
+    MCP_REGISTER_MAP(X) lists named contiguous ranges as X(NAME, START, LEN).
+    D reads each range with one burst and prints it under a
+    "--- NAME (0xSSSS-0xEEEE) ---" header, which is how the host finds the
+    registers of the running gateware. The sketch gets MCP_REG_NAME and
+    MCP_REG_NAME_LEN constants for every entry.
+    MCP_COMMANDS(X) lists the serial commands as X(LETTER, HANDLER, RAW, HELP);
+    the dispatcher is a template chain generated from it, so a command left
+    out of the table is never compiled in. Define either one before the
+    include to override it, e.g.
+      #define MCP_COMMANDS(X) MCP_CMD_CORE(X) MCP_CMD_CONTROL(X)
+  
+  Register Snapshots (N, MCP_SNAPSHOT_MAP):
+    MCP_SNAPSHOT_MAP(X) lists the ranges a snapshot holds, X(NAME, START,
+    LEN) like the register map (which is the default). N S n burst-reads
+    every range into RAM slot n as one blob of MCP_SNAP_BYTES bytes; N R n
+    burst-writes it back, so a test scenario is set up by one command
+    instead of a stream of W. N P n / N L n copy a slot to and from NVS
+    (MCP_SNAPSHOT_NVS) as key "snapN", with the layout CRC in "snapNL", so
+    a blob saved for another map is refused. N D n prints the blob as
+    "N OOOO HH.." lines and N W uploads one, for snapshots kept on the host;
+    an upload runs in order from offset 0 and the slot is valid only once
+    the last byte is in.
+    Replies: "OK N S n LLLL CRC=CCCC", "OK N R n LLLL", "ERR N R n EMPTY".
+  
+  SPI Calibration (T, calibrateSPI()):
+    A single read waits MCP_READ_WAIT_NS (2 us) between the header and the
+    data byte for the Wishbone read to finish. calibrateSPI() takes a
+    reference read of a constant ID register at MCP_SPI_SPEED, then walks
+    the clock up through MCP_CAL_CLOCKS. At each clock it finds the shortest
+    wait that gives MCP_CAL_ROUNDS clean single and burst reads (and scratch
+    write/read-back when given), and it stops at the first clock where none
+    does, so headers are never sent far past the working range. The
+    cheapest passing setting wins, with the wait one step longer than the
+    shortest that passed.
+    Bridges that implement the ready byte are also tried: a read with
+    MCP_WB_CMD_WAIT set returns MCP_WB_READY once the data is valid, and the
+    host polls for it (up to MCP_READY_MAX_POLLS bytes) instead of waiting
+    blindly. Define MCP_CALIBRATE_ID to calibrate in begin().
+  
+  Instrumentation (Z, build with -DMCP_ENABLE_STATS=1):
+    Counts serial bytes in/out, SPI transactions and wire bytes per bus class,
+    and the CPU cycles (esp_cpu_get_cycle_count) spent in every ASCII command
+    and binary opcode. Z prints one line per counter group and per command
+    seen, then "OK Z CPU=<MHz> SPI=<Hz> T=<ms since reset>":
+      Z SERIAL IN=n OUT=n DROP=n
+      Z SPI SKETCH=transactions/bytes DEBUG=transactions/bytes
+      Z CMD W N=count MEAN=cycles MAX=cycles H=h0,h1,...
+      Z OP 01 N=count MEAN=cycles MAX=cycles H=h0,h1,...
+    Histogram bucket i counts runs of 2^(i+10) to 2^(i+11) cycles; bucket 0
+    also takes shorter ones and the last bucket longer ones. In task mode the
+    cycles include any time the service task was preempted.
+  
+  Request Tags (#II):
+    A command line may start with a tag of 1-4 hex digits, "#1F R 8100".
+    A tagged command is not echoed. Every line of its reply is prefixed with
+    the tag and a space, "#1F OK R 8100=00", and the reply ends with the bare
+    tag on a line of its own, "#1F". A host can keep several tagged commands
+    in flight and route the reply lines by tag. Untagged lines in between
+    are unsolicited output (breakpoints, sketch prints). A bare tag with no
+    command just returns the end line, so it also probes for tag support.
+  
+  Binary Protocol (for scripted access, no echo):
+    A frame starts with the escape byte 0xA5, which never appears in an
+    ASCII command line, so both protocols share the same serial port.
+      Request:  A5 LEN OP ADDR_H ADDR_L COUNT PAYLOAD... CRC
+      Response: A5 LEN STATUS ADDR_H ADDR_L COUNT DATA... CRC
+    LEN counts the bytes from OP/STATUS to the end of PAYLOAD/DATA (4 + n).
+    CRC is CRC-8 (poly 0x07, init 0x00) over LEN through the last payload byte.
+    Opcodes: 00 PING, 01 READ (COUNT bytes), 02 WRITE (COUNT payload bytes),
+             03 READ_FIXED, 04 WRITE_FIXED (same address, e.g. a FIFO port),
+             05 BATCH (payload is a list of batch ops, see MCP_BATCH_*),
+             06 POLL (payload MASK VALUE TIMEOUT_US[4] INTERVAL_US[2], big-endian;
+                      data VALUE ELAPSED_US[4], status 04 on timeout)
+             07 SUBSCRIBE (payload PERIOD_US[4] then ADDR[2] per address;
+                           an empty payload stops the subscription)
+             08 JTAG, 09 JTAG_DATA (FPGA programming, below)
+             0A EVENTS (COUNT = kind mask; pushed state changes, see Events)
+  
+  JTAG Programming (JTAG/JTAG_DATA frames, MCP_ENABLE_JTAG_PROG):
+    The bitstream comes over the serial link and the ESP32 shifts it out
+    on the JTAG pins with direct GPIO register writes, so programming needs
+    no USB bridge switch, re-enumeration or port hand-over. A JTAG frame's
+    COUNT is the action (MCP_JTAG_*): ACQUIRE takes the pins from the bridge
+    or inputs, resets the TAP and returns the IDCODE; IR, DR and IDLE drive
+    the TAP from Run-Test/Idle and back; RELEASE returns the pins. The
+    device-specific sequence (erase, config enable, ...) stays on the host.
+    JTAG_DATA streams one Shift-DR scan over any number of frames: ADDR is
+    the chunk sequence from 0, COUNT has MCP_JTAG_FIRST on the first chunk
+    (enter Shift-DR) and MCP_JTAG_LAST on the final one (exit after its last
+    bit). Bits go out LSB first. The payload is PackBits-style: a control
+    byte n < 0x80 is followed by n+1 literal bytes, n >= 0x80 by one byte
+    that repeats n-0x7D (3..130) times; 00/FF runs only toggle TCK. Each
+    chunk is answered with BYTES[4] CRC16[2] (big-endian) over the unpacked
+    stream so far, which is also the host's flow control.
+  
+  Burst Access:
+    wishboneReadBurst()/wishboneWriteBurst() send one 3-byte header and then
+    stream all data bytes under a single CS assertion. MCP_BURST_INCREMENT
+    walks the address, MCP_BURST_FIXED repeats it (character ports, FIFOs).
+    Call negotiateBurst(scratchAddr) to verify the bridge supports bursts.
+  
+  Bus Arbitration:
+    Every Wishbone transaction holds the bus through McpBusArbiter, so the
+    sketch and the service task (beginTask) can both call the Wishbone API.
+    An uncontended transaction costs one atomic compare-and-swap. Waiters are
+    queued by class: sketch transactions go first, but debug traffic is let
+    through after MCP_BUS_MAX_BYPASS consecutive sketch hand-offs. MCP bursts
+    are at most 256 bytes, so a sketch waits ~0.3 ms at worst. Wishbone calls
+    are not allowed from ISRs.
+  
+  Builds and Translation Units:
+    Every member is inline and PapilioMCP is one object for the whole
+    program (an inline variable, or a template static member before C++17),
+    so any number of .cpp files may include the header. They must all see
+    the same PAPILIO_MCP_ENABLED and MCP_* settings: set them in build_flags
+    or in one config header that every file includes first.
+    Without PAPILIO_MCP_ENABLED the class is static no-ops on a constexpr
+    instance and SPI.h is not included, so the disabled build adds no code
+    or data at all. The MCP_ENABLE_* switches leave single features out;
+    server/mcp_size_report.py builds examples/mcp_size_report with each one
+    off and reports its flash and RAM cost.
 */
 
 #ifndef PAPILIO_MCP_H
 #define PAPILIO_MCP_H
 
 #include <Arduino.h>
+#ifdef PAPILIO_MCP_ENABLED
 #include <SPI.h>
+#else
+class SPIClass;   // The disabled build does not pull in the SPI library
+#endif
+
+// Address behaviour of a burst (shared by the real and the stub class)
+enum McpBurstMode : uint8_t {
+  MCP_BURST_INCREMENT = 0x00,  // addr, addr+1, addr+2, ...
+  MCP_BURST_FIXED     = 0x04   // Same address for every byte (MCP_WB_CMD_FIXED)
+};
+
+// Shadow cache policy for a declared address range (cacheRange)
+enum McpCachePolicy : uint8_t {
+  MCP_CACHE_VOLATILE      = 0,  // Always live (also the default for undeclared addresses)
+  MCP_CACHE_WRITE_THROUGH = 1,  // Reads from RAM once known, writes go straight out
+  MCP_CACHE_CACHED        = 2   // Write-back: writes coalesce in RAM until flushCache()
+};
+
+// Register map: X(NAME, START, LEN) per contiguous range (see above)
+#ifndef MCP_REGISTER_MAP
+#define MCP_REGISTER_MAP(X)      \
+  X(RGB_LED,    0x8100, 4)       \
+  X(VIDEO_MODE, 0x8010, 1)
+#endif
+
+struct McpRegRange {
+  const char* name;
+  uint16_t start;
+  uint16_t len;
+};
+
+#define MCP_REG_CONST(name, start, len)              \
+  static constexpr uint16_t MCP_REG_##name = start;  \
+  static constexpr uint16_t MCP_REG_##name##_LEN = len;
+MCP_REGISTER_MAP(MCP_REG_CONST)
+#undef MCP_REG_CONST
+
+// Snapshot ranges: X(NAME, START, LEN), the register map unless overridden
+#ifndef MCP_SNAPSHOT_MAP
+#define MCP_SNAPSHOT_MAP(X) MCP_REGISTER_MAP(X)
+#endif
+
+// The tables are static members of a class template so that every
+// translation unit shares one copy (C++11 has no inline variables)
+#define MCP_REG_ENTRY(name, start, len) { #name, start, len },
+template <typename T = void> struct McpMaps {
+  static constexpr McpRegRange registers[] = { MCP_REGISTER_MAP(MCP_REG_ENTRY) };
+  static constexpr McpRegRange snapshot[] = { MCP_SNAPSHOT_MAP(MCP_REG_ENTRY) };
+};
+#undef MCP_REG_ENTRY
+#if __cplusplus < 201703L
+template <typename T> constexpr McpRegRange McpMaps<T>::registers[];
+template <typename T> constexpr McpRegRange McpMaps<T>::snapshot[];
+#endif
+static constexpr size_t MCP_REG_COUNT = sizeof(McpMaps<>::registers) / sizeof(McpRegRange);
+static constexpr size_t MCP_SNAP_RANGES = sizeof(McpMaps<>::snapshot) / sizeof(McpRegRange);
+
+constexpr bool mcpRegRangesValid(size_t i = 0) {
+  return i == MCP_REG_COUNT ||
+         (McpMaps<>::registers[i].len > 0 &&
+          McpMaps<>::registers[i].start + McpMaps<>::registers[i].len <= 0x10000 &&
+          mcpRegRangesValid(i + 1));
+}
+static_assert(mcpRegRangesValid(), "MCP_REGISTER_MAP: empty range or range past 0xFFFF");
+
+constexpr size_t mcpSnapBytes(size_t i = 0) {
+  return i == MCP_SNAP_RANGES ? 0 : McpMaps<>::snapshot[i].len + mcpSnapBytes(i + 1);
+}
+static constexpr size_t MCP_SNAP_BYTES = mcpSnapBytes();
 
 #ifdef PAPILIO_MCP_ENABLED
 
 #include "soc/usb_serial_jtag_reg.h"
 #include "soc/gpio_sig_map.h"
+#include "soc/gpio_reg.h"
 #include "esp_rom_gpio.h"
 #include "hal/usb_serial_jtag_ll.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 
 // Default pin configuration (can override before including)
 #ifndef MCP_SPI_CLK
@@ -78,45 +413,1028 @@
 #define MCP_PIN_SRST  13
 #endif
 
+#ifndef MCP_SPI_SPEED
 #define MCP_SPI_SPEED 8000000
+#endif
+
+// Wishbone SPI bridge command byte
+#define MCP_WB_CMD_READ   0x00
+#define MCP_WB_CMD_WRITE  0x01
+#define MCP_WB_CMD_BURST  0x02  // Stream N data bytes after one header
+#define MCP_WB_CMD_FIXED  0x04  // With BURST: keep the address (FIFO port)
+#define MCP_WB_CMD_WAIT   0x08  // Read: clock until MCP_WB_READY, then data
+#define MCP_WB_READY      0x5A
+
+// Read turnaround and calibration (calibrateSPI)
+#ifndef MCP_READ_WAIT_NS
+#define MCP_READ_WAIT_NS     2000  // Header to data for a read without the ready byte
+#endif
+#define MCP_READY_MAX_POLLS  32    // Bytes clocked waiting for MCP_WB_READY
+#define MCP_CAL_ROUNDS       16    // Clean passes a setting needs
+#define MCP_CAL_MAX_ID       8     // Bytes compared from the ID register
+#define MCP_CAL_CLOCKS  { 8000000, 10000000, 13333333, 16000000, 20000000, 26666666, 40000000 }
+#define MCP_CAL_WAITS   { 0, 100, 250, 500, 1000, 1500, 2000, 3000 }
+
+// Set to 0 for bridge gateware that only knows single-byte transactions;
+// the burst APIs then fall back to one CS cycle per byte.
+#ifndef MCP_SPI_BURST
+#define MCP_SPI_BURST 1
+#endif
+
+// ASCII command line buffer (static, no heap). Longer lines are rejected.
+#ifndef MCP_CMD_BUFFER_SIZE
+#define MCP_CMD_BUFFER_SIZE  256
+#endif
+#define MCP_CMD_MAX_ARGS     8
+#define MCP_TAG_DIGITS       4     // Hex digits in a "#II" request tag
+
+// Response ring between the MCP service and Serial (static, power of 2).
+// 2 KB holds two full M replies (~780 characters each), so the next
+// pipelined reply is formatted while the previous one drains.
+#ifndef MCP_TX_BUFFER_SIZE
+#define MCP_TX_BUFFER_SIZE   2048
+#endif
+#ifndef MCP_TX_STALL_MS
+#define MCP_TX_STALL_MS      100   // A reply waits this long for a stalled host, then drops
+#endif
+#define MCP_RX_CHUNK         64    // Bytes taken from Serial per read (one USB packet)
+
+// Direct USB transport: the ring drains straight into the USB-Serial-JTAG
+// IN FIFO in full 64-byte packets instead of through Serial (HWCDC)
+#ifndef MCP_USB_DIRECT
+#define MCP_USB_DIRECT       0
+#endif
+#define MCP_USB_PACKET       64    // IN FIFO size = full-speed bulk packet
+#ifndef MCP_USB_SPIN_US
+#define MCP_USB_SPIN_US      200   // Wait this long for the host to take a packet
+#endif
+#if MCP_USB_DIRECT && !(ARDUINO_USB_MODE == 1 && ARDUINO_USB_CDC_ON_BOOT == 1)
+#error "MCP_USB_DIRECT needs Serial on USB-Serial-JTAG (USB Mode: Hardware CDC, CDC On Boot: Enabled)"
+#endif
+
+
+// Service task (beginTask)
+#ifndef MCP_TASK_STACK
+#define MCP_TASK_STACK       8192
+#endif
+#define MCP_EVT_RUN          0x01  // Set while the sketch is not paused
+#define MCP_EVT_CONTINUE     0x02  // Set to release a breakpoint
+
+// Breakpoint sites (MCP_BREAKPOINT)
+#ifndef MCP_BP_MAX
+#define MCP_BP_MAX           32    // Registered sites; later ones follow B 1|0 only
+#endif
+#define MCP_BP_NAMED         8     // Sites created for breakpoint(name) calls
+
+// Bus arbitration
+#ifndef MCP_BUS_MAX_BYPASS
+#define MCP_BUS_MAX_BYPASS   4     // Sketch hand-offs before a debug waiter wins
+#endif
+#define MCP_BUS_MAX_WAITERS  8     // Per class (counting semaphore depth)
+
+// Optional subsystems. The cache is on by default; the others (telemetry,
+// events, watchpoints, text engine, logic analyzer, snapshots, JTAG
+// programming, instrumentation) are off and are built in per sketch with
+// -DMCP_ENABLE_<X>=1, so a plain debug build pays only for the core.
+
+// Register shadow cache
+#ifndef MCP_ENABLE_CACHE
+#define MCP_ENABLE_CACHE     1
+#endif
+#ifndef MCP_CACHE_SIZE
+#define MCP_CACHE_SIZE       128   // Shadowed bytes across all ranges
+#endif
+#ifndef MCP_CACHE_RANGES
+#define MCP_CACHE_RANGES     8
+#endif
+
+// Telemetry subscription (S command, SUBSCRIBE frame)
+#ifndef MCP_ENABLE_TELEMETRY
+#define MCP_ENABLE_TELEMETRY 0
+#endif
+#ifndef MCP_SUB_MAX_ADDRS
+#define MCP_SUB_MAX_ADDRS    16
+#endif
+#ifndef MCP_SUB_RING
+#define MCP_SUB_RING         64    // Queued samples between service passes
+#endif
+#define MCP_SUB_MIN_PERIOD_US 100
+#define MCP_SUB_GAP          4     // Unsubscribed bytes read to join two addresses
+#define MCP_SUB_RAW          (MCP_SUB_MAX_ADDRS * (MCP_SUB_GAP + 1))
+
+// Event frames (EVENTS frame): pushed breakpoint, pause and JTAG changes
+#ifndef MCP_ENABLE_EVENTS
+#define MCP_ENABLE_EVENTS    0
+#endif
+#define MCP_EVENT_MAX_DATA   8       // Kind-specific bytes after TIME_US
+
+// Register watchpoints (V command)
+#ifndef MCP_ENABLE_WATCH
+#define MCP_ENABLE_WATCH     0
+#endif
+#ifndef MCP_WATCH_MAX
+#define MCP_WATCH_MAX        8
+#endif
+#ifndef MCP_WATCH_PERIOD_US
+#define MCP_WATCH_PERIOD_US  1000    // Default sample period (1 kHz)
+#endif
+#ifndef MCP_WATCH_RING
+#define MCP_WATCH_RING       16      // Matches queued between service passes
+#endif
+#define MCP_WATCH_MIN_PERIOD_US 100
+#define MCP_WATCH_GAP        4       // Unwatched bytes read to join two addresses
+#define MCP_WATCH_SPAN       16      // Bytes per burst read
+
+// Text engine (80x26 character screen behind the character port)
+#ifndef MCP_ENABLE_TEXT
+#define MCP_ENABLE_TEXT      0
+#endif
+#define MCP_TEXT_COLS        80
+#define MCP_TEXT_ROWS        26
+#define MCP_TEXT_CURSOR_X    0x0021  // CURSOR_Y and ATTR follow at +1, +2
+#define MCP_TEXT_CHAR_PORT   0x0024  // Writes a char at the cursor and advances it
+#define MCP_TEXT_GAP         3       // Unchanged cells bridged rather than re-seeking
+
+// Logic analyzer readout (L command) for the SUMP-style capture block
+#ifndef MCP_ENABLE_LA
+#define MCP_ENABLE_LA        0
+#endif
+#ifndef MCP_LA_BASE
+#define MCP_LA_BASE          0x8300
+#endif
+#ifndef MCP_LA_DEPTH
+#define MCP_LA_DEPTH         2048    // 32-bit samples in the capture memory
+#endif
+#define MCP_LA_STATUS_DONE   0x04    // Status register (base + 0) bit
+#define MCP_LA_DATA          0x80    // Sample i at base + 0x80 + 4*i, little-endian
+#define MCP_LA_LINE          96      // Record characters per L line
+
+// Register snapshots (N command, MCP_SNAPSHOT_MAP)
+#ifndef MCP_ENABLE_SNAPSHOT
+#define MCP_ENABLE_SNAPSHOT  0
+#endif
+#ifndef MCP_SNAPSHOT_SLOTS
+#define MCP_SNAPSHOT_SLOTS   4
+#endif
+#ifndef MCP_SNAPSHOT_NVS
+#define MCP_SNAPSHOT_NVS     1       // N P / N L through Preferences
+#endif
+#define MCP_SNAP_NVS_NAME    "papilio_mcp"
+#define MCP_SNAP_LINE        64      // Bytes per N D line
+#if MCP_ENABLE_SNAPSHOT && MCP_SNAPSHOT_NVS
+#include <Preferences.h>
+#endif
+
+// JTAG programming over the serial link (JTAG/JTAG_DATA frames)
+#ifndef MCP_ENABLE_JTAG_PROG
+#define MCP_ENABLE_JTAG_PROG 0
+#endif
+#ifndef MCP_JTAG_HALF_CYCLES
+#define MCP_JTAG_HALF_CYCLES 0       // CPU cycles added per TCK half period (slow TAPs)
+#endif
+#define MCP_JTAG_DR_MAX      32      // Bits per JTAG DR action (register reads)
+
+// Instrumentation (Z command), opt-in: every transaction updates counters
+#ifndef MCP_ENABLE_STATS
+#define MCP_ENABLE_STATS     0
+#endif
+#define MCP_STATS_BUCKETS    16
+#define MCP_STATS_LOG2_MIN   10      // Bucket i counts 2^(i+10)..2^(i+11) cycles
+#define MCP_STATS_OPS        11      // Binary opcodes 00..0A
+
+// Command table: X(LETTER, HANDLER, RAW, HELP). RAW handlers get the line
+// untokenized in McpArgs::rest. Groups can be combined in MCP_COMMANDS.
+#define MCP_CMD_CORE(X) \
+  X('W', cmdWrite,  false, "W AAAA DD  - Write DD to addr AAAA") \
+  X('R', cmdRead,   false, "R AAAA     - Read from addr AAAA") \
+  X('M', cmdMulti,  false, "M AAAA NN  - Read NN bytes from AAAA") \
+  X('X', cmdStream, false, "X AAAA LLLL - Stream LLLL bytes from AAAA") \
+  X('Q', cmdBatch,  true,  "Q op;op;... - Batch: WAAAA=DD FAAAA=DD[*NNNN] RAAAA[:NN] PAAAA&MM=VV[@TTTT] DNNNN") \
+  X('A', cmdAwait,  false, "A AAAA MM VV [T [I]] - Wait until (AAAA & MM) == VV, timeout/interval in us") \
+  X('D', cmdDump,   false, "D          - Dump the register map")
+#define MCP_CMD_CONTROL(X) \
+  X('T', cmdTiming,      false, "T [AAAA [NN [SSSS]]] | T S HHHHHHHH WWWW - SPI timing: show, calibrate on ID reg, set") \
+  X('J', cmdJtag,        false, "J [1|0]    - Enable/disable JTAG") \
+  X('P', cmdPause,       false, "P [1|0]    - Pause/resume sketch") \
+  X('C', cmdContinue,    false, "C          - Continue from breakpoint") \
+  X('B', cmdBreakpoints, false, "B [1|0] | B II 1|0|R | B II N NNNNNNNN | B II C [AAAA MM VV] - Breakpoints") \
+  X('H', cmdHelp,        false, "H          - This help") \
+  X('?', cmdHelp,        false, nullptr)
+#if MCP_ENABLE_CACHE
+#define MCP_CMD_CACHE(X) \
+  X('K', cmdCache, false, "K [AAAA LLLL C|T|V | F | I | R] - Shadow cache: list/add range, flush, invalidate, reset")
+#else
+#define MCP_CMD_CACHE(X)
+#endif
+#if MCP_ENABLE_TELEMETRY
+#define MCP_CMD_TELEMETRY(X) \
+  X('S', cmdSubscribe, false, "S PPPPPPPP AAAA [AAAA..] | S 0 - Stream samples every PPPPPPPP us (binary records)")
+#else
+#define MCP_CMD_TELEMETRY(X)
+#endif
+#if MCP_ENABLE_TEXT
+#define MCP_CMD_TEXT(X) \
+  X('E', cmdText, true, "E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA.. | E I - Text engine")
+#else
+#define MCP_CMD_TEXT(X)
+#endif
+#if MCP_ENABLE_LA
+#define MCP_CMD_LA(X) \
+  X('L', cmdLogic, false, "L [NNNN]   - Read NNNN logic analyzer samples as value changes")
+#else
+#define MCP_CMD_LA(X)
+#endif
+#if MCP_ENABLE_WATCH
+#define MCP_CMD_WATCH(X) \
+  X('V', cmdWatch, false, "V [AAAA MM [VV] [P] | - II | 0 | T PPPPPPPP] - Register watchpoints: add, remove, clear, period")
+#else
+#define MCP_CMD_WATCH(X)
+#endif
+#if MCP_ENABLE_SNAPSHOT
+#define MCP_CMD_SNAPSHOT(X) \
+  X('N', cmdSnapshot, false, "N [S|R|P|L|D [n] | W n OOOO HH..] - Register snapshots: save, restore, persist, load, dump, upload")
+#else
+#define MCP_CMD_SNAPSHOT(X)
+#endif
+#if MCP_ENABLE_STATS
+#define MCP_CMD_STATS(X) \
+  X('Z', cmdStats, false, "Z [R]      - Instrumentation counters and histograms, R resets")
+#else
+#define MCP_CMD_STATS(X)
+#endif
+#ifndef MCP_COMMANDS
+#define MCP_COMMANDS(X) \
+  MCP_CMD_CORE(X) MCP_CMD_CACHE(X) MCP_CMD_TELEMETRY(X) MCP_CMD_WATCH(X) MCP_CMD_TEXT(X) \
+  MCP_CMD_LA(X) MCP_CMD_SNAPSHOT(X) MCP_CMD_STATS(X) MCP_CMD_CONTROL(X)
+#endif
+
+// ASCII memory dumps
+#ifndef MCP_M_MAX
+#define MCP_M_MAX         256  // Bytes per M command line
+#endif
+#ifndef MCP_STREAM_CHUNK
+#define MCP_STREAM_CHUNK  64   // Bytes per X chunk line
+#endif
+
+// Binary protocol
+#define MCP_BIN_SYNC          0xA5
+#define MCP_BIN_VERSION       1
+#ifndef MCP_BIN_MAX_PAYLOAD
+#define MCP_BIN_MAX_PAYLOAD   250  // LEN is one byte: 4 + payload must fit
+#endif
+static_assert(MCP_BIN_MAX_PAYLOAD >= 1 && MCP_BIN_MAX_PAYLOAD <= 251,
+              "MCP_BIN_MAX_PAYLOAD: LEN (4 + payload) and the PING info byte are one byte wide");
+#ifndef MCP_BIN_TIMEOUT_MS
+#define MCP_BIN_TIMEOUT_MS    100  // Drop a partial frame after this long
+#endif
+
+// Binary opcodes (host -> device)
+#define MCP_OP_PING   0x00
+#define MCP_OP_READ   0x01
+#define MCP_OP_WRITE  0x02
+#define MCP_OP_READ_FIXED   0x03
+#define MCP_OP_WRITE_FIXED  0x04
+#define MCP_OP_BATCH        0x05
+#define MCP_OP_POLL         0x06
+#define MCP_OP_SUBSCRIBE    0x07
+#define MCP_OP_JTAG         0x08  // COUNT = MCP_JTAG_* action
+#define MCP_OP_JTAG_DATA    0x09  // Packed Shift-DR chunk, ADDR = sequence
+#define MCP_OP_EVENTS       0x0A  // COUNT = MCP_EVENT_* mask to push, 0 stops
+
+// Binary status codes (device -> host)
+#define MCP_ST_OK         0x00
+#define MCP_ST_BAD_CRC    0x01
+#define MCP_ST_BAD_OP     0x02
+#define MCP_ST_BAD_LEN    0x03
+#define MCP_ST_TIMEOUT    0x04  // Poll timed out (BATCH: COUNT = ops completed)
+#define MCP_ST_BAD_SEQ    0x05  // JTAG: pins not acquired, or chunk out of order
+#define MCP_ST_TELEMETRY  0x80  // Unsolicited sample record (ADDR = sequence number)
+#define MCP_ST_EVENT      0x81  // Unsolicited event (ADDR = sequence, COUNT = MCP_EVENT_*)
+
+// Event kinds (COUNT of an event frame; bit kind-1 of the EVENTS mask)
+#define MCP_EVENT_BREAK        0x01  // SITE BP_H BP_L HITS[4]
+#define MCP_EVENT_CONTINUE     0x02  // SITE BP_H BP_L
+#define MCP_EVENT_PAUSE        0x03
+#define MCP_EVENT_RESUME       0x04
+#define MCP_EVENT_JTAG         0x05  // STATE (MCP_JTAG_STATE_*)
+#define MCP_EVENT_WATCH        0x06  // ADDR_H ADDR_L OLD NEW
+#define MCP_EVENT_ALL          0x3F
+
+// State reported in the EVENTS reply
+#define MCP_STATE_PAUSED       0x01
+#define MCP_STATE_BREAKPOINT   0x02  // Stopped at a breakpoint (PAUSED is set too)
+#define MCP_STATE_BP_ENABLED   0x04
+#define MCP_JTAG_STATE_OFF     0x00  // Pins are inputs
+#define MCP_JTAG_STATE_BRIDGE  0x01  // USB JTAG bridge drives the pins
+#define MCP_JTAG_STATE_PROG    0x02  // Acquired for programming (JTAG frames)
+
+// Batch ops, encoded back-to-back in a BATCH payload (Q is parsed into these)
+#define MCP_BATCH_WRITE        0x01  // ADDR_H ADDR_L N DATA[N]
+#define MCP_BATCH_WRITE_FIXED  0x02  // ADDR_H ADDR_L N DATA[N]
+#define MCP_BATCH_READ         0x03  // ADDR_H ADDR_L N          -> N bytes
+#define MCP_BATCH_POLL         0x04  // ADDR_H ADDR_L MASK VALUE TMO_H TMO_L -> 1 byte
+#define MCP_BATCH_DELAY        0x05  // US_H US_L
+#define MCP_BATCH_FILL         0x06  // ADDR_H ADDR_L VALUE CNT_H CNT_L (fixed address)
+// JTAG actions (COUNT of a JTAG frame)
+#define MCP_JTAG_RELEASE       0x00  // Pins back to inputs, or to the USB bridge if it was on
+#define MCP_JTAG_ACQUIRE       0x01  // Take the pins, reset the TAP -> IDCODE[4]
+#define MCP_JTAG_IR            0x02  // ADDR = instruction, payload BITS (1-16) -> captured IR
+#define MCP_JTAG_DR            0x03  // payload BITS TDI[(BITS+7)/8] -> TDO[(BITS+7)/8]
+#define MCP_JTAG_IDLE          0x04  // ADDR = TCK cycles in Run-Test/Idle
+
+// JTAG_DATA flags (COUNT)
+#define MCP_JTAG_FIRST         0x01  // Enter Shift-DR first; the sequence restarts at 0
+#define MCP_JTAG_LAST          0x02  // Leave for Run-Test/Idle after the last bit
+
+#ifndef MCP_POLL_TIMEOUT_MS
+#define MCP_POLL_TIMEOUT_MS    100   // Q poll default when @TTTT is omitted
+#endif
+#ifndef MCP_AWAIT_TIMEOUT_US
+#define MCP_AWAIT_TIMEOUT_US   1000000  // A command default timeout
+#endif
+#ifndef MCP_AWAIT_SLICE_US
+#define MCP_AWAIT_SLICE_US     1000     // update() mode: longest A/POLL step per pass
+#endif
+
+// Bus priority classes
+enum McpBusClass : uint8_t {
+  MCP_BUS_SKETCH = 0,  // Sketch register updates (real-time)
+  MCP_BUS_DEBUG  = 1,  // MCP service traffic
+  MCP_BUS_CLASSES
+};
+
+// Wishbone bus lock. _state: 0 = free, 1 = held, 2 = held with waiters.
+// The fast path is a single CAS each way; the spinlock and semaphores are
+// only touched when another core or task is waiting. Ownership is handed
+// directly to the chosen waiter, so the bus is never free in between.
+class McpBusArbiter {
+public:
+  void acquire(McpBusClass cls) {
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&_state, &expected, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return;
+    }
+    acquireSlow(cls);
+  }
+  
+  void release() {
+    int expected = 1;
+    if (__atomic_compare_exchange_n(&_state, &expected, 0, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
+    releaseSlow();
+  }
+  
+  uint32_t contended() const { return _contended; }
+  
+private:
+  volatile int _state = 0;
+  uint8_t _waiting[MCP_BUS_CLASSES] = { 0, 0 };
+  uint8_t _bypass = 0;
+  uint32_t _contended = 0;
+  SemaphoreHandle_t _sem[MCP_BUS_CLASSES] = { nullptr, nullptr };
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  
+  void acquireSlow(McpBusClass cls);
+  void releaseSlow();
+};
+
+inline void McpBusArbiter::acquireSlow(McpBusClass cls) {
+  // Semaphores are created on first contention so a single-task sketch
+  // never allocates them
+  if (!_sem[cls]) {
+    SemaphoreHandle_t sem = xSemaphoreCreateCounting(MCP_BUS_MAX_WAITERS, 0);
+    portENTER_CRITICAL(&_mux);
+    if (!_sem[cls]) {
+      _sem[cls] = sem;
+      sem = nullptr;
+    }
+    portEXIT_CRITICAL(&_mux);
+    if (sem) vSemaphoreDelete(sem);
+  }
+  if (!_sem[cls]) {
+    // Out of memory: poll for a free bus instead of queueing for a hand-off.
+    // A tick's sleep (not a yield) lets a lower-priority holder finish.
+    portENTER_CRITICAL(&_mux);
+    _contended++;
+    portEXIT_CRITICAL(&_mux);
+    for (;;) {
+      int expected = 0;
+      if (__atomic_compare_exchange_n(&_state, &expected, 1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+      }
+      vTaskDelay(1);
+    }
+  }
+  
+  portENTER_CRITICAL(&_mux);
+  for (;;) {
+    int s = _state;
+    if (s == 0 && __atomic_compare_exchange_n(&_state, &s, 1, false,
+                                              __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      portEXIT_CRITICAL(&_mux);
+      return;   // Freed while we were getting here
+    }
+    if (s == 2 || (s == 1 && __atomic_compare_exchange_n(&_state, &s, 2, false,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+      break;
+    }
+  }
+  _waiting[cls]++;
+  _contended++;
+  portEXIT_CRITICAL(&_mux);
+  
+  // releaseSlow() gives exactly one unit of this class's semaphore per hand-off
+  xSemaphoreTake(_sem[cls], portMAX_DELAY);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+inline void McpBusArbiter::releaseSlow() {
+  portENTER_CRITICAL(&_mux);
+  McpBusClass next = MCP_BUS_SKETCH;
+  if (_waiting[MCP_BUS_SKETCH] && _waiting[MCP_BUS_DEBUG]) {
+    // Both waiting: sketch first, but never starve the debug link
+    if (++_bypass > MCP_BUS_MAX_BYPASS) {
+      next = MCP_BUS_DEBUG;
+      _bypass = 0;
+    }
+  } else if (!_waiting[MCP_BUS_SKETCH]) {
+    next = MCP_BUS_DEBUG;
+    _bypass = 0;
+  }
+  _waiting[next]--;
+  if (!_waiting[MCP_BUS_SKETCH] && !_waiting[MCP_BUS_DEBUG]) {
+    __atomic_store_n(&_state, 1, __ATOMIC_RELEASE);  // Still held, by the new owner
+  }
+  portEXIT_CRITICAL(&_mux);
+  xSemaphoreGive(_sem[next]);
+}
+
+// Holds the bus for the lifetime of the object
+class McpBusLock {
+public:
+  McpBusLock(McpBusArbiter& bus, McpBusClass cls) : _bus(bus) { _bus.acquire(cls); }
+  ~McpBusLock() { _bus.release(); }
+  
+private:
+  McpBusArbiter& _bus;
+};
+
+#if MCP_ENABLE_CACHE
+struct McpCacheRange {
+  uint16_t start;
+  uint16_t len;
+  uint16_t offset;   // Into the shadow pool
+  uint8_t policy;
+};
+#endif
+
+// Arguments of one ASCII command. Tokenized commands get argv[0] = the
+// command word; arg1/arg2 are argv[1]/argv[2] parsed as hex.
+struct McpArgs {
+  char* rest;        // Line after the command letter (RAW commands only)
+  char* argv[MCP_CMD_MAX_ARGS];
+  uint8_t argc;
+  uint32_t arg1, arg2;
+  bool has1, has2;
+  char action;       // First character of argv[1]
+};
+
+// Serial output of the MCP service: a ring drained into Serial (with
+// MCP_USB_DIRECT, the USB-Serial-JTAG FIFO) without blocking. write() is
+// for replies and waits while the host is reading; tryWrite() is
+// all-or-nothing and never waits (telemetry). Between beginTag() and
+// endTag() the calling task's lines carry the request tag.
+class McpOutput : public Print {
+public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t len) override {
+    if (_tagLen && xTaskGetCurrentTaskHandle() == _tagOwner) return writeTagged(buf, len);
+    return put(buf, len);
+  }
+  using Print::write;
+  bool tryWrite(const uint8_t* buf, size_t len) { return push(buf, len, true) == len; }
+  
+  void beginTag(const char* tag, uint8_t len);
+  void endTag();
+  uint8_t suspendTag();          // Stop tagging for now; returns what resumeTag() needs
+  void resumeTag(uint8_t len);
+  
+  size_t space() const { return MCP_TX_BUFFER_SIZE - (_head - _tail); }
+  bool pending() const { return _head != _tail; }
+  bool drain();                  // Moves what Serial takes now; true if anything moved
+  void drainFor(uint32_t stallMs);  // Drains until empty or the host stalls
+#if MCP_USB_DIRECT
+  void beginDirect();            // Switch to the IN FIFO once Serial is idle
+#endif
+  
+  uint32_t bytes = 0;    // Accepted into the ring (MCP_ENABLE_STATS)
+  uint32_t dropped = 0;  // Reply bytes lost to a stalled host
+  
+private:
+  size_t push(const uint8_t* buf, size_t len, bool whole);
+  size_t put(const uint8_t* buf, size_t len);
+  size_t writeTagged(const uint8_t* buf, size_t len);
+#if MCP_USB_DIRECT
+  size_t writeFifo(const uint8_t* buf, size_t len);
+  int _serialIdle = -1;          // Serial.availableForWrite() with nothing queued
+  bool _fifoTimedOut = false;    // The host left the last packet in the FIFO
+#endif
+  
+  uint8_t _tag[MCP_TAG_DIGITS + 2];  // "#II "
+  uint8_t _tagLen = 0;
+  bool _tagLineStart = false;
+  TaskHandle_t _tagOwner = nullptr;
+  
+  uint8_t _buf[MCP_TX_BUFFER_SIZE];
+  volatile uint32_t _head = 0;   // Free-running; written by producers under _mux
+  volatile uint32_t _tail = 0;   // Free-running; written by the drainer only
+  uint8_t _draining = 0;
+  volatile bool _stalled = false;  // Host took nothing for MCP_TX_STALL_MS
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+static_assert((MCP_TX_BUFFER_SIZE & (MCP_TX_BUFFER_SIZE - 1)) == 0,
+              "MCP_TX_BUFFER_SIZE must be a power of 2");
+
+// One breakpoint site. Constant-initialized, so the function-local static
+// behind MCP_BREAKPOINT has no guard; armed is the only fast-path read.
+struct McpBreakSite {
+  constexpr McpBreakSite(const char* siteName)
+    : name(siteName), armed(1), id(0), enabled(true), condMask(0), condValue(0),
+      condAddr(0), hits(0), after(0) {}
+  
+  const char* name;
+  uint8_t armed;       // Enabled here and globally (1 until registered)
+  uint8_t id;          // 1..MCP_BP_MAX once registered, 0xFF if the table was full
+  bool enabled;
+  uint8_t condMask;    // 0 = no register condition
+  uint8_t condValue;
+  uint16_t condAddr;
+  uint32_t hits;
+  uint32_t after;      // Hits that pass before the site breaks
+};
+
+#define MCP_BREAKPOINT(siteName) do {                                  \
+    static McpBreakSite mcpSite_(siteName);                            \
+    if (__builtin_expect(__atomic_load_n(&mcpSite_.armed, __ATOMIC_RELAXED), 0)) \
+      PapilioMCP.breakpointHit(mcpSite_);                              \
+  } while (0)
+
+#if MCP_ENABLE_STATS
+struct McpCmdStats {
+  uint32_t count;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t hist[MCP_STATS_BUCKETS];
+};
+#endif
+
+class PapilioMCPClass;
+
+// One command table entry as a type, so dispatch resolves at compile time
+template <char Letter, void (PapilioMCPClass::*Handler)(McpArgs&), bool Raw>
+struct McpCommand {
+  static constexpr char letter = Letter;
+  static constexpr bool raw = Raw;
+  static void call(PapilioMCPClass& mcp, McpArgs& args) { (mcp.*Handler)(args); }
+};
+
+struct McpCommandEnd {};
+template <typename... Commands> struct McpDispatch;
 
 class PapilioMCPClass {
 public:
   void begin(SPIClass* spi = nullptr);
   void update();
   
+  // Run the command service in its own task; update() becomes a no-op
+  bool beginTask(BaseType_t core = 0, UBaseType_t priority = 1, SPIClass* spi = nullptr);
+  bool isTaskRunning() { return _task != nullptr; }
+  
+  // Number of Wishbone transactions that had to wait for the bus
+  uint32_t busContention() const { return _bus.contended(); }
+  
   // Direct Wishbone access (usable by sketch)
   void wishboneWrite(uint16_t address, uint8_t data);
   uint8_t wishboneRead(uint16_t address);
   
+  // Burst Wishbone access - one header, then len bytes under a single CS
+  void wishboneReadBurst(uint16_t address, uint8_t* buf, size_t len,
+                         McpBurstMode mode = MCP_BURST_INCREMENT);
+  void wishboneWriteBurst(uint16_t address, const uint8_t* buf, size_t len,
+                          McpBurstMode mode = MCP_BURST_INCREMENT);
+  bool negotiateBurst(uint16_t scratchAddress);
+  void setBurstEnabled(bool enabled) { _burstEnabled = enabled; }
+  bool isBurstEnabled() { return _burstEnabled; }
+  
+  // SPI timing (see SPI Calibration above). scratchAddress < 0 skips the
+  // write check; idLen is capped at MCP_CAL_MAX_ID.
+  bool calibrateSPI(uint16_t idAddress, uint8_t idLen = 4, int32_t scratchAddress = -1);
+  void setSPITiming(uint32_t clockHz, uint16_t readWaitNs, bool readyByte = false);
+  uint32_t spiClock() { return _spiHz; }
+  uint16_t readWaitNs() { return _readWaitNs; }
+  bool isReadyByteEnabled() { return _readyByte; }
+  
+#if MCP_ENABLE_TEXT
+  // Text engine - only cells that differ from the device-side shadow are sent
+  void textWrite(uint8_t x, uint8_t y, const char* text, uint8_t attr);
+  void textFill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, char c, uint8_t attr);
+  void textRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t* cells);
+  void textInvalidate() { memset(_textKnown, 0, sizeof(_textKnown)); }
+#else
+  void textWrite(uint8_t x, uint8_t y, const char* text, uint8_t attr) {}
+  void textFill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, char c, uint8_t attr) {}
+  void textRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t* cells) {}
+  void textInvalidate() {}
+#endif
+  
+#if MCP_ENABLE_TELEMETRY
+  // Sample count addresses every periodUs from a hardware timer and stream
+  // the records to the host (see Telemetry above). Replaces any running one.
+  bool subscribe(const uint16_t* addrs, uint8_t count, uint32_t periodUs);
+  void unsubscribe();
+  bool isSubscribed() { return _subCount != 0; }
+#else
+  bool subscribe(const uint16_t* addrs, uint8_t count, uint32_t periodUs) { return false; }
+  void unsubscribe() {}
+  bool isSubscribed() { return false; }
+#endif
+  
+#if MCP_ENABLE_WATCH
+  // Watch (read(address) & mask) from a hardware timer (see Watchpoints
+  // above): any change, or value >= 0 to match on becoming that value.
+  // Returns the watch ID (1..MCP_WATCH_MAX), or 0 when the table is full.
+  uint8_t watch(uint16_t address, uint8_t mask = 0xFF, int16_t value = -1, bool pause = false);
+  bool unwatch(uint8_t id);
+  void clearWatches();
+  bool setWatchPeriod(uint32_t periodUs);
+#else
+  uint8_t watch(uint16_t address, uint8_t mask = 0xFF, int16_t value = -1, bool pause = false) { return 0; }
+  bool unwatch(uint8_t id) { return false; }
+  void clearWatches() {}
+  bool setWatchPeriod(uint32_t periodUs) { return false; }
+#endif
+  
+#if MCP_ENABLE_CACHE
+  // Shadow cache (see README). Ranges are checked in declaration order.
+  bool cacheRange(uint16_t start, uint16_t len, McpCachePolicy policy);
+  uint16_t flushCache();
+  void invalidateCache();
+  void clearCache();
+#else
+  bool cacheRange(uint16_t start, uint16_t len, McpCachePolicy policy) { return false; }
+  uint16_t flushCache() { return 0; }
+  void invalidateCache() {}
+  void clearCache() {}
+#endif
+  
+#if MCP_ENABLE_SNAPSHOT
+  // Register snapshots of MCP_SNAPSHOT_MAP (see README). Slots live in RAM;
+  // persist/load copy one to and from NVS.
+  bool snapshotSave(uint8_t slot);
+  bool snapshotRestore(uint8_t slot);
+  bool snapshotPersist(uint8_t slot);
+  bool snapshotLoad(uint8_t slot);
+#else
+  bool snapshotSave(uint8_t slot) { return false; }
+  bool snapshotRestore(uint8_t slot) { return false; }
+  bool snapshotPersist(uint8_t slot) { return false; }
+  bool snapshotLoad(uint8_t slot) { return false; }
+#endif
+  
+  // Poll until (read & mask) == value. Returns false on timeout;
+  // last (if given) receives the final value read.
+  bool wishbonePoll(uint16_t address, uint8_t mask, uint8_t value,
+                    uint16_t timeoutMs, uint8_t* last = nullptr);
+  // Same with a microsecond timeout, intervalUs between reads, and the time
+  // until the match (or timeout) reported in elapsedUs
+  bool wishbonePollUs(uint16_t address, uint8_t mask, uint8_t value, uint32_t timeoutUs,
+                      uint32_t intervalUs = 0, uint8_t* last = nullptr,
+                      uint32_t* elapsedUs = nullptr);
+  
   // JTAG control
   void enableJTAG();
   void disableJTAG();
   bool isJTAGEnabled() { return _jtagEnabled; }
+#if MCP_ENABLE_JTAG_PROG
+  bool isJTAGProgramming() { return _jtagOwned; }
+#else
+  bool isJTAGProgramming() { return false; }
+#endif
   
   // Pause control - allows MCP to take full control
   void pause();
   void resume();
   bool isPaused() { return _paused; }
+  void waitWhilePaused();  // Block the sketch until resumed
   
-  // Breakpoint support
+  // Breakpoint support (MCP_BREAKPOINT for per-site control)
   void breakpoint(const char* name = nullptr);
-  void enableBreakpoints() { _breakpointsEnabled = true; }
-  void disableBreakpoints() { _breakpointsEnabled = false; }
+  void breakpointHit(McpBreakSite& site);   // Slow path of MCP_BREAKPOINT
+  void enableBreakpoints() { setBreakpointsEnabled(true); }
+  void disableBreakpoints() { setBreakpointsEnabled(false); }
   bool areBreakpointsEnabled() { return _breakpointsEnabled; }
+  
+#if MCP_ENABLE_STATS
+  void resetStats();
+#else
+  void resetStats() {}
+#endif
 
 private:
   SPIClass* _spi = nullptr;
   bool _ownSpi = false;
-  String _cmdBuffer;
+  bool _burstEnabled = MCP_SPI_BURST;
+  uint32_t _spiHz = MCP_SPI_SPEED;
+  uint16_t _readWaitNs = MCP_READ_WAIT_NS;
+  bool _readyByte = false;
+  uint32_t _readyTimeouts = 0;
+  uint32_t _cpuMhz = 240;
+  char _cmdBuf[MCP_CMD_BUFFER_SIZE];
+  uint16_t _cmdLen = 0;
+  bool _cmdOverflow = false;
+  // Read from Serial, not parsed yet (a member, so a nested service() keeps the order)
+  uint8_t _rxBuf[MCP_RX_CHUNK];
+  uint8_t _rxPos = 0, _rxLen = 0;
+  // A or POLL still waiting in update() mode; input stays queued behind it
+  struct McpAwait {
+    uint16_t address;
+    uint8_t mask, value;
+    uint32_t timeoutUs, intervalUs;
+    unsigned long startUs, readUs;
+    uint8_t last;
+    bool binary;        // Reply with a POLL frame (count echoed)
+    uint8_t count;
+    uint8_t tagLen;     // Request tag held back until the reply
+  };
+  McpAwait _await;
+  bool _awaitPending = false;
   bool _jtagEnabled = false;
-  bool _paused = false;
-  bool _breakpointsEnabled = true;
-  bool _atBreakpoint = false;
+  volatile bool _paused = false;
+  volatile bool _breakpointsEnabled = true;
+  volatile bool _atBreakpoint = false;
   uint16_t _breakpointCount = 0;
+  McpBreakSite* _bpSites[MCP_BP_MAX];
+  volatile uint8_t _bpCount = 0;
+  McpBreakSite _bpNamed[MCP_BP_NAMED] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+  };
+  uint8_t _bpNamedCount = 0;
+  portMUX_TYPE _bpMux = portMUX_INITIALIZER_UNLOCKED;
+  
+#if MCP_ENABLE_JTAG_PROG
+  // JTAG programming: pins owned by ACQUIRE, open Shift-DR stream
+  bool _jtagOwned = false;
+  bool _jtagBridgeWas = false;   // Bridge is restored on RELEASE
+  bool _jtagShifting = false;
+  uint16_t _jtagSeq = 0;         // Next JTAG_DATA chunk expected
+  uint32_t _jtagBytes = 0;
+  uint16_t _jtagCrc = 0xFFFF;
+  
+  static uint8_t jtagClock(uint8_t tms, uint8_t tdi);
+  static void jtagTms(uint8_t bits, uint8_t n);
+  static void jtagShift(const uint8_t* tdi, uint8_t* tdo, uint16_t bits, bool exit);
+  static void jtagShiftBytes(const uint8_t* data, uint16_t n);
+  static void jtagShiftRun(uint8_t value, uint16_t n);
+  static bool jtagPackValid(const uint8_t* p, uint8_t len);
+  void jtagAcquire();
+  void jtagRelease();
+  void jtagFrame(uint16_t addr, uint8_t action, const uint8_t* payload, uint8_t len);
+  void jtagData(uint16_t seq, uint8_t flags, const uint8_t* payload, uint8_t len);
+#endif
+  
+#if MCP_ENABLE_EVENTS
+  volatile uint8_t _eventMask = 0;   // MCP_EVENT_* kinds the host asked for
+  uint16_t _eventSeq = 0;
+  portMUX_TYPE _eventMux = portMUX_INITIALIZER_UNLOCKED;
+  
+  void sendEvent(uint8_t kind, const uint8_t* data = nullptr, uint8_t len = 0) {
+    sendEventAt(kind, micros(), data, len);
+  }
+  void sendEventAt(uint8_t kind, uint32_t timeUs, const uint8_t* data, uint8_t len);
+  uint8_t jtagState();
+#else
+  void sendEvent(uint8_t, const uint8_t* = nullptr, uint8_t = 0) {}
+  void sendEventAt(uint8_t, uint32_t, const uint8_t*, uint8_t) {}
+#endif
+  
+  // Binary frame receive state (_binPos == 0 means idle)
+  uint8_t _binBuf[MCP_BIN_MAX_PAYLOAD + 7];
+  uint16_t _binPos = 0;
+  unsigned long _binStart = 0;
+  
+  TaskHandle_t _task = nullptr;
+  EventGroupHandle_t _events = nullptr;
+  McpBusArbiter _bus;
+  McpOutput _out;
+  
+#if MCP_ENABLE_STATS
+  McpCmdStats _statCmd[26];             // ASCII commands by letter
+  McpCmdStats _statOp[MCP_STATS_OPS];   // Binary frames by opcode
+  uint32_t _statBytesIn = 0;
+  uint32_t _statSpiCount[MCP_BUS_CLASSES] = {};
+  uint32_t _statSpiBytes[MCP_BUS_CLASSES] = {};
+  unsigned long _statSince = 0;
+  
+  static void statRecord(McpCmdStats& st, uint32_t cycles);
+  void statPrint(const char* kind, const char* name, const McpCmdStats& st);
+  void cmdStats(McpArgs& a);
+#endif
+  
+#if MCP_ENABLE_CACHE
+  McpCacheRange _cacheRanges[MCP_CACHE_RANGES];
+  uint8_t _cacheRangeCount = 0;
+  uint16_t _cacheUsed = 0;
+  uint8_t _cacheData[MCP_CACHE_SIZE];
+  uint8_t _cacheValid[(MCP_CACHE_SIZE + 7) / 8];
+  uint8_t _cacheDirty[(MCP_CACHE_SIZE + 7) / 8];
+  uint32_t _cacheHits = 0;
+  uint32_t _cacheMisses = 0;
+  
+  int16_t cacheSlot(uint16_t address, uint8_t& policy);
+  void cacheRead(uint16_t address, uint8_t* buf, size_t len);
+  void cacheWrite(uint16_t address, const uint8_t* buf, size_t len);
+  void cacheForget(uint16_t address);
+#endif
+  
+#if MCP_ENABLE_TELEMETRY
+  struct McpSample {
+    uint16_t seq;
+    uint8_t count;
+    uint32_t timeUs;
+    uint8_t values[MCP_SUB_MAX_ADDRS];
+  };
+  struct McpSubSpan {
+    uint16_t start;
+    uint8_t len;
+    uint8_t at;         // Offset of the burst in the sampler's read buffer
+  };
+  esp_timer_handle_t _subTimer = nullptr;
+  uint16_t _subAddrs[MCP_SUB_MAX_ADDRS];
+  uint8_t _subPos[MCP_SUB_MAX_ADDRS];   // Each address's byte in the read buffer
+  McpSubSpan _subSpans[MCP_SUB_MAX_ADDRS];
+  uint8_t _subSpanCount = 0;
+  uint32_t _subGen = 0;               // Bumped on every (un)subscribe
+  volatile uint8_t _subCount = 0;
+  uint32_t _subPeriodUs = 0;
+  McpSample _subRing[MCP_SUB_RING];
+  volatile uint16_t _subHead = 0;     // Written by the timer callback
+  volatile uint16_t _subTail = 0;     // Written by service()
+  uint16_t _subSeq = 0;
+  uint32_t _subSent = 0;
+  uint32_t _subDropped = 0;
+  portMUX_TYPE _subMux = portMUX_INITIALIZER_UNLOCKED;
+  
+  static void subTimerEntry(void* arg);
+  void sampleTelemetry();
+  void sendTelemetry();
+#endif
+  
+#if MCP_ENABLE_WATCH
+  struct McpWatch {
+    uint16_t address;
+    uint8_t mask;
+    uint8_t value;      // Match value when equal is set
+    uint8_t last;       // Previous sample (whole byte)
+    bool used, equal, pause;
+    uint8_t span, offset;   // Where the sampler finds the byte
+    uint32_t hits;
+  };
+  struct McpWatchSpan {
+    uint16_t start;
+    uint8_t len;
+  };
+  struct McpWatchHit {
+    uint32_t timeUs;
+    uint16_t address;
+    uint8_t id, old, value;
+  };
+  esp_timer_handle_t _watchTimer = nullptr;
+  McpWatch _watches[MCP_WATCH_MAX] = {};
+  McpWatchSpan _watchSpans[MCP_WATCH_MAX];
+  uint8_t _watchSpanCount = 0;     // 0 = timer stopped
+  uint32_t _watchPeriodUs = MCP_WATCH_PERIOD_US;
+  uint32_t _watchGen = 0;          // Bumped on every table change
+  McpWatchHit _watchRing[MCP_WATCH_RING];
+  volatile uint8_t _watchHead = 0; // Written by the timer callback
+  volatile uint8_t _watchTail = 0; // Written by service()
+  volatile bool _watchPause = false;
+  uint32_t _watchSamples = 0;
+  uint32_t _watchDropped = 0;
+  portMUX_TYPE _watchMux = portMUX_INITIALIZER_UNLOCKED;
+  
+  static void watchTimerEntry(void* arg);
+  void watchRebuild();             // Call with _watchMux held
+  void watchTimerSync(bool was);
+  void sampleWatch();
+  void sendWatch();
+  void printWatch(const char* prefix, uint8_t id);
+  void cmdWatch(McpArgs& a);
+#endif
+  
+#if MCP_ENABLE_SNAPSHOT
+  uint8_t _snapData[MCP_SNAPSHOT_SLOTS][MCP_SNAP_BYTES];
+  uint16_t _snapCrc[MCP_SNAPSHOT_SLOTS];
+  bool _snapValid[MCP_SNAPSHOT_SLOTS] = {};
+  size_t _snapFill[MCP_SNAPSHOT_SLOTS] = {};   // Bytes uploaded so far by N W
+  
+  static uint16_t snapLayout();
+  void cmdSnapshot(McpArgs& a);
+#endif
+  
+#if MCP_ENABLE_TEXT
+  uint8_t _textChar[MCP_TEXT_COLS * MCP_TEXT_ROWS];
+  uint8_t _textAttr[MCP_TEXT_COLS * MCP_TEXT_ROWS];
+  uint8_t _textKnown[(MCP_TEXT_COLS * MCP_TEXT_ROWS + 7) / 8] = {};
+  uint32_t _textCells = 0;     // Cells requested
+  uint32_t _textWritten = 0;   // Cells actually sent
+  uint32_t _textRuns = 0;      // Seek + burst pairs
+  
+  void textRow(uint8_t x, uint8_t y, const uint8_t* ch, const uint8_t* at, uint8_t n);
+  void textSetCursor(uint8_t x, uint8_t y, uint8_t attr);
+  void processText(const char* p);
+#endif
+  
+  // Service task traffic is debug class, everything else is sketch class
+  McpBusClass busClass() {
+    return (_task && xTaskGetCurrentTaskHandle() == _task) ? MCP_BUS_DEBUG : MCP_BUS_SKETCH;
+  }
+  
+  void service();
+  static void taskEntry(void* arg);
+  void releaseBreakpoint();
+  void setBreakpointsEnabled(bool enabled);
+  void registerSite(McpBreakSite& site);
+  void printSite(const char* prefix, const McpBreakSite& site);
   
-  void processCommand(String cmd);
+  template <typename... Commands> friend struct McpDispatch;
+  void processCommand(char* cmd);
+  void parseArgs(char* line, McpArgs& args, bool raw);
+  static uint8_t tokenize(char* line, char** argv, uint8_t maxArgs);
+  
+  // Command handlers (MCP_COMMANDS)
+  void cmdWrite(McpArgs& a);
+  void cmdRead(McpArgs& a);
+  void cmdMulti(McpArgs& a);
+  void cmdStream(McpArgs& a);
+  void cmdBatch(McpArgs& a) { processBatch(a.rest); }
+  void cmdAwait(McpArgs& a);
+  void awaitBegin(uint16_t address, uint8_t mask, uint8_t value, uint32_t timeoutUs,
+                  uint32_t intervalUs, bool binary, uint8_t count);
+  void awaitStep();
+  void awaitReply(bool ok, uint32_t elapsed);
+  void cmdDump(McpArgs& a);
+  void cmdTiming(McpArgs& a);
+  void cmdJtag(McpArgs& a);
+  void cmdPause(McpArgs& a);
+  void cmdContinue(McpArgs& a);
+  void cmdBreakpoints(McpArgs& a);
+  void cmdHelp(McpArgs& a);
+#if MCP_ENABLE_CACHE
+  void cmdCache(McpArgs& a);
+#endif
+#if MCP_ENABLE_TELEMETRY
+  void cmdSubscribe(McpArgs& a);
+#endif
+#if MCP_ENABLE_TEXT
+  void cmdText(McpArgs& a) { processText(a.rest); }
+#endif
+#if MCP_ENABLE_LA
+  void cmdLogic(McpArgs& a);
+#endif
+  static bool parseHex(const char* token, uint32_t& value);
   void sendResponse(const char* response);
+  
+  void feedBinary(uint8_t c);
+  void processFrame(uint8_t op, uint16_t addr, uint8_t count,
+                    const uint8_t* payload, uint8_t len);
+  bool sendFrame(uint8_t status, uint16_t addr, uint8_t count,
+                 const uint8_t* data = nullptr, uint8_t len = 0, bool dropIfFull = false);
+  static uint8_t crc8(const uint8_t* data, size_t len, uint8_t crc = 0x00);
+  static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+  
+  void streamDump(uint16_t addr, uint32_t total);
+#if MCP_ENABLE_LA
+  void laRecord(char* line, int& pos, uint16_t& seq, uint32_t value,
+                uint32_t changed, uint32_t run);
+#endif
+  
+  uint8_t runBatch(const uint8_t* ops, size_t len, uint8_t* out, size_t outMax,
+                   size_t& outLen, uint8_t& done);
+  void processBatch(const char* text);
+  
+  void wbSelect(uint8_t cmd, uint16_t address);
+  bool readTurnaround();
+  bool calTest(uint16_t idAddress, const uint8_t* ref, uint8_t idLen, int32_t scratchAddress);
+  uint16_t calFindWait(uint16_t idAddress, const uint8_t* ref, uint8_t idLen,
+                       int32_t scratchAddress, bool& found);
+  void rawRead(uint16_t address, uint8_t* buf, size_t len, McpBurstMode mode);
+  void rawWrite(uint16_t address, const uint8_t* buf, size_t len, McpBurstMode mode);
+  void wbDeselect();
 };
 
 // Implementation inline to keep as single header
@@ -133,51 +1451,958 @@ inline void PapilioMCPClass::begin(SPIClass* spi) {
   pinMode(MCP_SPI_CS, OUTPUT);
   digitalWrite(MCP_SPI_CS, HIGH);
   pinMode(MCP_SPI_MISO, INPUT);
+  _cpuMhz = getCpuFrequencyMhz();
+  resetStats();
+#if MCP_USB_DIRECT
+  _out.beginDirect();
+#endif
+#ifdef MCP_CALIBRATE_ID
+  calibrateSPI(MCP_CALIBRATE_ID);
+#endif
   
-  Serial.println("[MCP] Debug interface ready. Type H for help.");
+  _out.println("[MCP] Debug interface ready. Type H for help.");
+  _out.drainFor(MCP_TX_STALL_MS);  // Boot messages before the sketch's own
 }
 
-inline void PapilioMCPClass::update() {
-  while (Serial.available()) {
-    char c = Serial.read();
-    if (c == '\n' || c == '\r') {
-      if (_cmdBuffer.length() > 0) {
-        processCommand(_cmdBuffer);
-        _cmdBuffer = "";
-      }
-    } else if (_cmdBuffer.length() < 256) {
-      _cmdBuffer += c;
-    }
+inline bool PapilioMCPClass::beginTask(BaseType_t core, UBaseType_t priority, SPIClass* spi) {
+  if (_task) return true;
+  if (!_spi) begin(spi);
+  
+  _events = xEventGroupCreate();
+  if (!_events) return false;
+  xEventGroupSetBits(_events, _paused ? 0 : MCP_EVT_RUN);
+  
+  if (xTaskCreatePinnedToCore(taskEntry, "PapilioMCP", MCP_TASK_STACK, this,
+                              priority, &_task, core) != pdPASS) {
+    _task = nullptr;
+    return false;
   }
+  _out.printf("[MCP] Service task running on core %d\n", (int)core);
+  _out.drainFor(MCP_TX_STALL_MS);
+  return true;
 }
 
-inline void PapilioMCPClass::wishboneWrite(uint16_t address, uint8_t data) {
-  if (!_spi) return;
-  _spi->beginTransaction(SPISettings(MCP_SPI_SPEED, MSBFIRST, SPI_MODE0));
-  digitalWrite(MCP_SPI_CS, LOW);
-  _spi->transfer(0x01);
-  _spi->transfer((address >> 8) & 0xFF);
-  _spi->transfer(address & 0xFF);
-  _spi->transfer(data);
-  digitalWrite(MCP_SPI_CS, HIGH);
-  _spi->endTransaction();
+inline void PapilioMCPClass::taskEntry(void* arg) {
+  PapilioMCPClass* self = static_cast<PapilioMCPClass*>(arg);
+  for (;;) {
+    self->service();
+    // Sleep one tick when idle so lower-priority tasks on this core still run
+    if (!Serial.available()) ulTaskNotifyTake(pdTRUE, 1);
+  }
 }
 
-inline uint8_t PapilioMCPClass::wishboneRead(uint16_t address) {
-  if (!_spi) return 0;
-  uint8_t result;
-  _spi->beginTransaction(SPISettings(MCP_SPI_SPEED, MSBFIRST, SPI_MODE0));
+inline void PapilioMCPClass::update() {
+  if (_task) return;  // The service task owns the serial port
+  service();
+}
+
+inline void PapilioMCPClass::service() {
+  // Drop a binary frame that stalled mid-way so the parser can resync
+  if (_binPos && millis() - _binStart > MCP_BIN_TIMEOUT_MS) {
+    _binPos = 0;
+  }
+  
+  if (_awaitPending) awaitStep();
+  for (;;) {
+    if (_awaitPending) break;   // Later commands wait for its reply
+    // A USB packet per read instead of a Serial call per byte
+    if (_rxPos == _rxLen) {
+      int avail = Serial.available();
+      if (avail <= 0) break;
+      _rxLen = Serial.read(_rxBuf, avail < MCP_RX_CHUNK ? avail : MCP_RX_CHUNK);
+      _rxPos = 0;
+      if (!_rxLen) break;
+    }
+    char c = (char)_rxBuf[_rxPos++];
+#if MCP_ENABLE_STATS
+    _statBytesIn++;
+#endif
+    if (_binPos || (uint8_t)c == MCP_BIN_SYNC) {
+      feedBinary((uint8_t)c);
+    } else if (c == '\n' || c == '\r') {
+      if (_cmdOverflow) {
+        sendResponse("ERR: Line too long");
+      } else if (_cmdLen > 0) {
+        _cmdBuf[_cmdLen] = '\0';
+        processCommand(_cmdBuf);
+      }
+      _cmdLen = 0;
+      _cmdOverflow = false;
+    } else if (_cmdLen < MCP_CMD_BUFFER_SIZE - 1) {
+      _cmdBuf[_cmdLen++] = c;
+    } else {
+      _cmdOverflow = true;
+    }
+  }
+  
+#if MCP_ENABLE_CACHE
+  flushCache();  // Coalesced write-back bytes go out once per service pass
+#endif
+#if MCP_ENABLE_TELEMETRY
+  sendTelemetry();
+#endif
+#if MCP_ENABLE_WATCH
+  sendWatch();
+#endif
+  _out.drain();
+}
+
+inline void PapilioMCPClass::wbSelect(uint8_t cmd, uint16_t address) {
+#if MCP_ENABLE_STATS
+  _statSpiCount[busClass()]++;
+  _statSpiBytes[busClass()] += 3;   // Header; rawRead/rawWrite add the data
+#endif
+  _spi->beginTransaction(SPISettings(_spiHz, MSBFIRST, SPI_MODE0));
   digitalWrite(MCP_SPI_CS, LOW);
-  _spi->transfer(0x00);
+  _spi->transfer(cmd);
   _spi->transfer((address >> 8) & 0xFF);
   _spi->transfer(address & 0xFF);
-  delayMicroseconds(2);
-  result = _spi->transfer(0x00);
+}
+
+inline void PapilioMCPClass::wbDeselect() {
   digitalWrite(MCP_SPI_CS, HIGH);
   _spi->endTransaction();
+}
+
+// Between a read header and the data: poll for the ready byte, or wait out
+// the Wishbone read. False if the bridge never became ready.
+inline bool PapilioMCPClass::readTurnaround() {
+  if (_readyByte) {
+    for (uint8_t i = 0; i < MCP_READY_MAX_POLLS; i++) {
+      if (_spi->transfer(0x00) == MCP_WB_READY) return true;
+    }
+    _readyTimeouts++;
+    return false;
+  }
+  if (_readWaitNs) {
+    uint32_t cycles = (uint32_t)_readWaitNs * _cpuMhz / 1000;
+    uint32_t start = esp_cpu_get_cycle_count();
+    while (esp_cpu_get_cycle_count() - start < cycles) {}
+  }
+  return true;
+}
+
+// Raw bus access - caller holds the bus lock, no cache
+inline void PapilioMCPClass::rawRead(uint16_t address, uint8_t* buf, size_t len,
+                                     McpBurstMode mode) {
+  uint8_t wait = _readyByte ? MCP_WB_CMD_WAIT : 0;
+#if MCP_ENABLE_STATS
+  _statSpiBytes[busClass()] += len;
+#endif
+  if (!_burstEnabled || len == 1) {
+    for (size_t i = 0; i < len; i++) {
+      wbSelect(MCP_WB_CMD_READ | wait, mode == MCP_BURST_FIXED ? address : address + i);
+      buf[i] = readTurnaround() ? _spi->transfer(0x00) : 0xFF;
+      wbDeselect();
+    }
+    return;
+  }
+  wbSelect(MCP_WB_CMD_READ | MCP_WB_CMD_BURST | mode | wait, address);
+  // First Wishbone read; the bridge prefetches the rest
+  if (readTurnaround()) {
+    memset(buf, 0x00, len);
+    _spi->transfer(buf, len);
+  } else {
+    memset(buf, 0xFF, len);
+  }
+  wbDeselect();
+}
+
+inline void PapilioMCPClass::rawWrite(uint16_t address, const uint8_t* buf, size_t len,
+                                      McpBurstMode mode) {
+#if MCP_ENABLE_STATS
+  _statSpiBytes[busClass()] += len;
+#endif
+  if (!_burstEnabled || len == 1) {
+    for (size_t i = 0; i < len; i++) {
+      wbSelect(MCP_WB_CMD_WRITE, mode == MCP_BURST_FIXED ? address : address + i);
+      _spi->transfer(buf[i]);
+      wbDeselect();
+    }
+    return;
+  }
+  wbSelect(MCP_WB_CMD_WRITE | MCP_WB_CMD_BURST | mode, address);
+  _spi->writeBytes(buf, len);
+  wbDeselect();
+}
+
+inline void PapilioMCPClass::wishboneWrite(uint16_t address, uint8_t data) {
+  wishboneWriteBurst(address, &data, 1);
+}
+
+inline uint8_t PapilioMCPClass::wishboneRead(uint16_t address) {
+  uint8_t result = 0;
+  wishboneReadBurst(address, &result, 1);
   return result;
 }
 
+inline void PapilioMCPClass::wishboneReadBurst(uint16_t address, uint8_t* buf, size_t len,
+                                               McpBurstMode mode) {
+  if (!_spi || !len) return;
+  McpBusLock lock(_bus, busClass());
+#if MCP_ENABLE_CACHE
+  if (_cacheRangeCount && mode == MCP_BURST_INCREMENT) {
+    cacheRead(address, buf, len);
+    return;
+  }
+#endif
+  rawRead(address, buf, len, mode);
+}
+
+inline void PapilioMCPClass::wishboneWriteBurst(uint16_t address, const uint8_t* buf, size_t len,
+                                                McpBurstMode mode) {
+  if (!_spi || !len) return;
+  McpBusLock lock(_bus, busClass());
+#if MCP_ENABLE_TEXT
+  // A raw character-port write moves the screen out from under the shadow
+  if (address <= MCP_TEXT_CHAR_PORT &&
+      (mode == MCP_BURST_FIXED ? address == MCP_TEXT_CHAR_PORT
+                               : address + len > MCP_TEXT_CHAR_PORT)) {
+    textInvalidate();
+  }
+#endif
+#if MCP_ENABLE_CACHE
+  if (_cacheRangeCount) {
+    if (mode == MCP_BURST_INCREMENT) {
+      cacheWrite(address, buf, len);
+      return;
+    }
+    cacheForget(address);
+  }
+#endif
+  rawWrite(address, buf, len, mode);
+}
+
+#if MCP_ENABLE_CACHE
+inline bool PapilioMCPClass::cacheRange(uint16_t start, uint16_t len, McpCachePolicy policy) {
+  McpBusLock lock(_bus, busClass());
+  if (!len || _cacheRangeCount >= MCP_CACHE_RANGES) return false;
+  uint16_t offset = _cacheUsed;
+  if (policy != MCP_CACHE_VOLATILE) {
+    if (_cacheUsed + len > MCP_CACHE_SIZE) return false;
+    _cacheUsed += len;
+  }
+  McpCacheRange& r = _cacheRanges[_cacheRangeCount];
+  r.start = start;
+  r.len = len;
+  r.offset = offset;
+  r.policy = policy;
+  for (uint16_t i = 0; i < len && policy != MCP_CACHE_VOLATILE; i++) {
+    _cacheValid[(offset + i) >> 3] &= ~(1 << ((offset + i) & 7));
+    _cacheDirty[(offset + i) >> 3] &= ~(1 << ((offset + i) & 7));
+  }
+  _cacheRangeCount++;
+  return true;
+}
+
+// Pool slot for address, or -1 if it is not shadowed (volatile / undeclared).
+// The first range containing the address decides.
+inline int16_t PapilioMCPClass::cacheSlot(uint16_t address, uint8_t& policy) {
+  for (uint8_t i = 0; i < _cacheRangeCount; i++) {
+    const McpCacheRange& r = _cacheRanges[i];
+    if ((uint16_t)(address - r.start) < r.len) {
+      policy = r.policy;
+      return policy == MCP_CACHE_VOLATILE ? -1 : r.offset + (address - r.start);
+    }
+  }
+  policy = MCP_CACHE_VOLATILE;
+  return -1;
+}
+
+// Hits and misses count shadowed bytes only: a hit is a byte served from
+// RAM, a miss one fetched from the bus. Volatile and undeclared bytes are
+// always live and not counted.
+inline void PapilioMCPClass::cacheRead(uint16_t address, uint8_t* buf, size_t len) {
+  uint8_t policy;
+  size_t known = 0;
+  for (size_t i = 0; i < len; i++) {
+    int16_t slot = cacheSlot(address + i, policy);
+    if (slot < 0 || !(_cacheValid[slot >> 3] & (1 << (slot & 7)))) break;
+    buf[i] = _cacheData[slot];
+    known++;
+  }
+  if (known == len) {
+    _cacheHits += len;
+    return;
+  }
+  
+  // Any miss fetches the whole request live, then refreshes the shadow.
+  // Dirty bytes are newer than the hardware, so they win.
+  rawRead(address, buf, len, MCP_BURST_INCREMENT);
+  for (size_t i = 0; i < len; i++) {
+    int16_t slot = cacheSlot(address + i, policy);
+    if (slot < 0) continue;
+    uint8_t bit = 1 << (slot & 7);
+    if (_cacheDirty[slot >> 3] & bit) {
+      buf[i] = _cacheData[slot];
+      _cacheHits++;
+    } else {
+      _cacheData[slot] = buf[i];
+      _cacheValid[slot >> 3] |= bit;
+      _cacheMisses++;
+    }
+  }
+}
+
+// A fixed-address write (FIFO port) changes the byte behind the shadow:
+// forget it, pending write-back included, so the next read goes live
+inline void PapilioMCPClass::cacheForget(uint16_t address) {
+  uint8_t policy;
+  int16_t slot = cacheSlot(address, policy);
+  if (slot < 0) return;
+  uint8_t bit = 1 << (slot & 7);
+  _cacheValid[slot >> 3] &= ~bit;
+  _cacheDirty[slot >> 3] &= ~bit;
+}
+
+inline void PapilioMCPClass::cacheWrite(uint16_t address, const uint8_t* buf, size_t len) {
+  // Write-back bytes stay in RAM; everything else goes out in bursts of
+  // consecutive live bytes
+  size_t run = 0;
+  uint8_t policy;
+  for (size_t i = 0; i < len; i++) {
+    int16_t slot = cacheSlot(address + i, policy);
+    if (slot < 0) continue;
+    uint8_t bit = 1 << (slot & 7);
+    _cacheData[slot] = buf[i];
+    _cacheValid[slot >> 3] |= bit;
+    if (policy == MCP_CACHE_CACHED) {
+      _cacheDirty[slot >> 3] |= bit;
+      if (i > run) rawWrite(address + run, buf + run, i - run, MCP_BURST_INCREMENT);
+      run = i + 1;
+    }
+  }
+  if (len > run) rawWrite(address + run, buf + run, len - run, MCP_BURST_INCREMENT);
+}
+
+// Write out dirty write-back bytes, one burst per dirty run. Returns bytes written.
+inline uint16_t PapilioMCPClass::flushCache() {
+  if (!_spi || !_cacheRangeCount) return 0;
+  McpBusLock lock(_bus, busClass());
+  uint16_t flushed = 0;
+  for (uint8_t r = 0; r < _cacheRangeCount; r++) {
+    const McpCacheRange& range = _cacheRanges[r];
+    if (range.policy != MCP_CACHE_CACHED) continue;
+    uint16_t i = 0;
+    while (i < range.len) {
+      uint16_t slot = range.offset + i;
+      if (!(_cacheDirty[slot >> 3] & (1 << (slot & 7)))) {
+        i++;
+        continue;
+      }
+      uint16_t n = 0;
+      for (; i + n < range.len; n++) {
+        uint16_t s = slot + n;
+        if (!(_cacheDirty[s >> 3] & (1 << (s & 7)))) break;
+        _cacheDirty[s >> 3] &= ~(1 << (s & 7));
+      }
+      rawWrite(range.start + i, &_cacheData[slot], n, MCP_BURST_INCREMENT);
+      flushed += n;
+      i += n;
+    }
+  }
+  return flushed;
+}
+
+// Forget shadowed values (dirty bytes are flushed first)
+inline void PapilioMCPClass::invalidateCache() {
+  flushCache();
+  McpBusLock lock(_bus, busClass());
+  memset(_cacheValid, 0, sizeof(_cacheValid));
+}
+
+inline void PapilioMCPClass::clearCache() {
+  flushCache();
+  McpBusLock lock(_bus, busClass());
+  _cacheRangeCount = 0;
+  _cacheUsed = 0;
+  memset(_cacheValid, 0, sizeof(_cacheValid));
+}
+#endif
+
+#if MCP_ENABLE_TELEMETRY
+inline bool PapilioMCPClass::subscribe(const uint16_t* addrs, uint8_t count, uint32_t periodUs) {
+  unsubscribe();
+  if (!_spi || count == 0 || count > MCP_SUB_MAX_ADDRS || periodUs < MCP_SUB_MIN_PERIOD_US) {
+    return false;
+  }
+  if (!_subTimer) {
+    esp_timer_create_args_t args = {};
+    args.callback = subTimerEntry;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "mcp_sub";
+    args.skip_unhandled_events = true;   // Late ticks are dropped, not queued up
+    if (esp_timer_create(&args, &_subTimer) != ESP_OK) return false;
+  }
+  
+  // Group the addresses into burst reads, as watchRebuild() does
+  uint8_t order[MCP_SUB_MAX_ADDRS];
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t j = i;
+    for (; j > 0 && addrs[order[j - 1]] > addrs[i]; j--) order[j] = order[j - 1];
+    order[j] = i;
+  }
+  uint8_t gap = _burstEnabled ? MCP_SUB_GAP : 0;
+  McpSubSpan spans[MCP_SUB_MAX_ADDRS];
+  uint8_t pos[MCP_SUB_MAX_ADDRS];
+  uint8_t spanCount = 0, raw = 0;
+  for (uint8_t k = 0; k < count; k++) {
+    uint16_t addr = addrs[order[k]];
+    McpSubSpan* sp = spanCount ? &spans[spanCount - 1] : nullptr;
+    uint32_t end = sp ? (uint32_t)sp->start + sp->len : 0;
+    if (sp && addr < end) {
+      // Same address as the previous one
+    } else if (sp && addr <= end + gap) {
+      raw += addr + 1 - end;
+      sp->len = addr - sp->start + 1;
+    } else {
+      sp = &spans[spanCount++];
+      sp->start = addr;
+      sp->len = 1;
+      sp->at = raw++;
+    }
+    pos[order[k]] = sp->at + (addr - sp->start);
+  }
+  
+  // The gen bump makes a sample still running from the old subscription drop its result
+  portENTER_CRITICAL(&_subMux);
+  memcpy(_subAddrs, addrs, count * sizeof(uint16_t));
+  memcpy(_subPos, pos, count);
+  memcpy(_subSpans, spans, spanCount * sizeof(McpSubSpan));
+  _subSpanCount = spanCount;
+  _subPeriodUs = periodUs;
+  _subHead = _subTail = 0;
+  _subSeq = 0;
+  _subSent = _subDropped = 0;
+  _subCount = count;
+  _subGen++;
+  portEXIT_CRITICAL(&_subMux);
+  if (esp_timer_start_periodic(_subTimer, periodUs) != ESP_OK) {
+    _subCount = 0;
+    return false;
+  }
+  return true;
+}
+
+// esp_timer_stop() does not wait for a callback that is already running;
+// the gen bump keeps that one from publishing into the ring
+inline void PapilioMCPClass::unsubscribe() {
+  if (!_subCount) return;
+  esp_timer_stop(_subTimer);
+  portENTER_CRITICAL(&_subMux);
+  _subCount = 0;
+  _subGen++;
+  portEXIT_CRITICAL(&_subMux);
+}
+
+inline void PapilioMCPClass::subTimerEntry(void* arg) {
+  static_cast<PapilioMCPClass*>(arg)->sampleTelemetry();
+}
+
+// Runs in the esp_timer task. Reads bypass the shadow cache: telemetry
+// is meant to show the live registers.
+inline void PapilioMCPClass::sampleTelemetry() {
+  McpSubSpan spans[MCP_SUB_MAX_ADDRS];
+  uint8_t pos[MCP_SUB_MAX_ADDRS];
+  portENTER_CRITICAL(&_subMux);
+  uint8_t count = _subCount;
+  uint8_t n = _subSpanCount;
+  uint32_t gen = _subGen;
+  bool full = (_subHead + 1) % MCP_SUB_RING == _subTail;
+  if (count && full) {
+    _subSeq++;   // The gap in SEQ tells the host a sample was lost
+    _subDropped++;
+  }
+  memcpy(spans, _subSpans, n * sizeof(McpSubSpan));
+  memcpy(pos, _subPos, count);
+  portEXIT_CRITICAL(&_subMux);
+  if (!count || full) return;
+  
+  McpSample sample;
+  uint8_t raw[MCP_SUB_RAW];
+  {
+    McpBusLock lock(_bus, MCP_BUS_DEBUG);
+    sample.timeUs = micros();
+    for (uint8_t i = 0; i < n; i++) {
+      rawRead(spans[i].start, &raw[spans[i].at], spans[i].len, MCP_BURST_INCREMENT);
+    }
+  }
+  for (uint8_t i = 0; i < count; i++) sample.values[i] = raw[pos[i]];
+  sample.count = count;
+  
+  bool published = false;
+  portENTER_CRITICAL(&_subMux);
+  if (gen == _subGen) {   // Not resubscribed or stopped during the reads
+    sample.seq = _subSeq++;
+    _subRing[_subHead] = sample;
+    _subHead = (_subHead + 1) % MCP_SUB_RING;
+    published = true;
+  }
+  portEXIT_CRITICAL(&_subMux);
+  if (published && _task) xTaskNotifyGive(_task);
+}
+
+inline void PapilioMCPClass::sendTelemetry() {
+  while (_subTail != _subHead) {
+    const McpSample& sample = _subRing[_subTail];
+    uint8_t data[4 + MCP_SUB_MAX_ADDRS] = {
+      (uint8_t)(sample.timeUs >> 24), (uint8_t)(sample.timeUs >> 16),
+      (uint8_t)(sample.timeUs >> 8), (uint8_t)sample.timeUs
+    };
+    memcpy(&data[4], sample.values, sample.count);
+    // A record that does not fit waits in the sample ring for the next pass
+    if (!sendFrame(MCP_ST_TELEMETRY, sample.seq, sample.count, data, 4 + sample.count, true)) break;
+    _subSent++;
+    portENTER_CRITICAL(&_subMux);
+    _subTail = (_subTail + 1) % MCP_SUB_RING;
+    portEXIT_CRITICAL(&_subMux);
+  }
+}
+
+// S PPPPPPPP AAAA [AAAA ...] | S 0 | S
+inline void PapilioMCPClass::cmdSubscribe(McpArgs& a) {
+  char** argv = a.argv;
+  uint8_t argc = a.argc;
+  uint32_t period;
+  if (argc == 1) {
+    if (_subCount) {
+      _out.printf("OK S %u @ %luus sent=%lu dropped=%lu\n", _subCount,
+                    (unsigned long)_subPeriodUs, (unsigned long)_subSent,
+                    (unsigned long)_subDropped);
+    } else {
+      sendResponse("OK S OFF");
+    }
+    return;
+  }
+  if (!parseHex(argv[1], period)) {
+    sendResponse("ERR: S PPPPPPPP AAAA [AAAA ...] | S 0");
+    return;
+  }
+  if (period == 0 && argc == 2) {
+    bool was = _subCount;
+    unsubscribe();
+    sendTelemetry();   // Whatever was sampled before the stop still goes out
+    _out.printf("OK S %s sent=%lu dropped=%lu\n", was ? "STOPPED" : "OFF",
+                  (unsigned long)_subSent, (unsigned long)_subDropped);
+    return;
+  }
+  
+  uint16_t addrs[MCP_SUB_MAX_ADDRS];
+  uint8_t count = 0;
+  for (uint8_t i = 2; i < argc; i++) {
+    uint32_t addr;
+    if (count == MCP_SUB_MAX_ADDRS || !parseHex(argv[i], addr) || addr > 0xFFFF) {
+      sendResponse("ERR: S PPPPPPPP AAAA [AAAA ...] (max 16 addresses)");
+      return;
+    }
+    addrs[count++] = addr;
+  }
+  // Reply before the first record can be queued behind it
+  if (count == 0 || period < MCP_SUB_MIN_PERIOD_US) {
+    sendResponse("ERR: S needs addresses and a period >= 100 (0x64) us");
+    return;
+  }
+  _out.printf("OK S %u @ %luus\n", count, (unsigned long)period);
+  if (!subscribe(addrs, count, period)) {
+    sendResponse("ERR S TIMER");
+  }
+}
+#endif
+
+#if MCP_ENABLE_TEXT
+// Caller holds the bus lock
+inline void PapilioMCPClass::textSetCursor(uint8_t x, uint8_t y, uint8_t attr) {
+  uint8_t regs[3] = { x, y, attr };
+  rawWrite(MCP_TEXT_CURSOR_X, regs, 3, MCP_BURST_INCREMENT);
+}
+
+// Bring n cells of row y starting at column x up to date. Runs of changed
+// cells with the same attribute cost one cursor/attr burst and one burst
+// to the character port; short unchanged gaps are rewritten instead of
+// paying for another seek. Caller holds the bus lock.
+inline void PapilioMCPClass::textRow(uint8_t x, uint8_t y, const uint8_t* ch,
+                                     const uint8_t* at, uint8_t n) {
+  uint16_t base = y * MCP_TEXT_COLS + x;
+  _textCells += n;
+  
+  auto same = [&](uint8_t i) {
+    uint16_t cell = base + i;
+    return (_textKnown[cell >> 3] & (1 << (cell & 7))) &&
+           _textChar[cell] == ch[i] && _textAttr[cell] == at[i];
+  };
+  
+  uint8_t i = 0;
+  while (i < n) {
+    if (same(i)) {
+      i++;
+      continue;
+    }
+    uint8_t start = i;
+    uint8_t end = i + 1;   // One past the last changed cell in the run
+    for (uint8_t j = end; j < n && at[j] == at[start]; j++) {
+      if (!same(j)) end = j + 1;
+      else if (j - end >= MCP_TEXT_GAP) break;
+    }
+    
+    textSetCursor(x + start, y, at[start]);
+    rawWrite(MCP_TEXT_CHAR_PORT, &ch[start], end - start, MCP_BURST_FIXED);
+    for (uint8_t k = start; k < end; k++) {
+      uint16_t cell = base + k;
+      _textChar[cell] = ch[k];
+      _textAttr[cell] = at[k];
+      _textKnown[cell >> 3] |= 1 << (cell & 7);
+    }
+    _textWritten += end - start;
+    _textRuns++;
+    i = end;
+  }
+}
+
+// Write text at (x, y), wrapping at the right edge. The hardware cursor is
+// left after the last character so character-port writes can continue.
+inline void PapilioMCPClass::textWrite(uint8_t x, uint8_t y, const char* text, uint8_t attr) {
+  if (!_spi || x >= MCP_TEXT_COLS || y >= MCP_TEXT_ROWS) return;
+  McpBusLock lock(_bus, busClass());
+  uint8_t ch[MCP_TEXT_COLS], at[MCP_TEXT_COLS];
+  memset(at, attr, sizeof(at));
+  size_t len = strlen(text);
+  
+  while (len && y < MCP_TEXT_ROWS) {
+    uint8_t n = MCP_TEXT_COLS - x;
+    if (len < n) n = len;
+    memcpy(ch, text, n);
+    textRow(x, y, ch, at, n);
+    text += n;
+    len -= n;
+    x += n;
+    if (x == MCP_TEXT_COLS && len) {
+      x = 0;
+      y++;
+    }
+  }
+  textSetCursor(x < MCP_TEXT_COLS ? x : MCP_TEXT_COLS - 1,
+                y < MCP_TEXT_ROWS ? y : MCP_TEXT_ROWS - 1, attr);
+}
+
+inline void PapilioMCPClass::textFill(uint8_t x, uint8_t y, uint8_t w, uint8_t h,
+                                      char c, uint8_t attr) {
+  if (!_spi || x >= MCP_TEXT_COLS || y >= MCP_TEXT_ROWS) return;
+  if (w > MCP_TEXT_COLS - x) w = MCP_TEXT_COLS - x;
+  if (h > MCP_TEXT_ROWS - y) h = MCP_TEXT_ROWS - y;
+  McpBusLock lock(_bus, busClass());
+  uint8_t ch[MCP_TEXT_COLS], at[MCP_TEXT_COLS];
+  memset(ch, c, w);
+  memset(at, attr, w);
+  for (uint8_t r = 0; r < h; r++) {
+    textRow(x, y + r, ch, at, w);
+  }
+}
+
+// cells holds w*h (char, attr) pairs, row by row
+inline void PapilioMCPClass::textRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h,
+                                      const uint8_t* cells) {
+  if (!_spi || x >= MCP_TEXT_COLS || y >= MCP_TEXT_ROWS) return;
+  uint8_t stride = w;
+  if (w > MCP_TEXT_COLS - x) w = MCP_TEXT_COLS - x;
+  if (h > MCP_TEXT_ROWS - y) h = MCP_TEXT_ROWS - y;
+  McpBusLock lock(_bus, busClass());
+  uint8_t ch[MCP_TEXT_COLS], at[MCP_TEXT_COLS];
+  for (uint8_t r = 0; r < h; r++) {
+    const uint8_t* row = &cells[r * stride * 2];
+    for (uint8_t i = 0; i < w; i++) {
+      ch[i] = row[i * 2];
+      at[i] = row[i * 2 + 1];
+    }
+    textRow(x, y + r, ch, at, w);
+  }
+}
+
+// E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA... | E I | E
+inline void PapilioMCPClass::processText(const char* p) {
+  while (*p == ' ') p++;
+  char sub = toupper(*p);
+  if (sub) p++;
+  
+  uint32_t arg[6] = { 0 };
+  uint8_t argc = 0;
+  uint8_t want = sub == 'S' ? 3 : sub == 'F' ? 6 : sub == 'R' ? 4 : 0;
+  char* end;
+  while (argc < want) {
+    while (*p == ' ') p++;
+    arg[argc] = strtoul(p, &end, 16);
+    if (end == p || arg[argc] > 0xFF) break;
+    p = end;
+    argc++;
+  }
+  bool bad = want ? (argc < want || arg[0] >= MCP_TEXT_COLS || arg[1] >= MCP_TEXT_ROWS)
+                  : (sub != 'I' && sub != '\0');
+  if (bad) {
+    sendResponse("ERR: E S XX YY AA text | E F XX YY WW HH CC AA | E R XX YY WW HH CCAA.. | E I");
+    return;
+  }
+  
+  uint32_t written = _textWritten;
+  uint32_t cells = _textCells;
+  switch (sub) {
+    case 'S':
+      if (*p == ' ') p++;   // Exactly one separator; further spaces are text
+      textWrite(arg[0], arg[1], p, arg[2]);
+      break;
+    case 'F':
+      textFill(arg[0], arg[1], arg[2], arg[3], arg[4], arg[5]);
+      break;
+    case 'R': {
+      // Parse the hex cell list in place of the text: 4 hex digits per cell
+      uint8_t cellBuf[MCP_CMD_BUFFER_SIZE / 2];
+      size_t n = 0;
+      while (*p == ' ') p++;
+      while (isxdigit(p[0]) && isxdigit(p[1]) && n < sizeof(cellBuf)) {
+        char byteHex[3] = { p[0], p[1], 0 };
+        cellBuf[n++] = strtoul(byteHex, NULL, 16);
+        p += 2;
+      }
+      if (!arg[2] || !arg[3] || n != arg[2] * arg[3] * 2) {
+        sendResponse("ERR: E R needs WW*HH cells of CCAA");
+        return;
+      }
+      textRect(arg[0], arg[1], arg[2], arg[3], cellBuf);
+      break;
+    }
+    case 'I':
+      textInvalidate();
+      sendResponse("OK E INVALIDATED");
+      return;
+    default:
+      _out.printf("OK E cells=%lu written=%lu runs=%lu\n", (unsigned long)_textCells,
+                    (unsigned long)_textWritten, (unsigned long)_textRuns);
+      return;
+  }
+  _out.printf("OK E %c cells=%lu written=%lu\n", sub,
+                (unsigned long)(_textCells - cells), (unsigned long)(_textWritten - written));
+}
+#endif
+
+// Check that the bridge handles bursts by writing two patterns to a scratch
+// range (4 bytes starting at scratchAddress) and reading them back both ways.
+// The original contents are restored. Bursts stay disabled if it fails.
+inline bool PapilioMCPClass::negotiateBurst(uint16_t scratchAddress) {
+  if (!_spi) return false;
+  static const uint8_t patterns[2][4] = {
+    { 0x5A, 0xA5, 0x3C, 0xC3 },
+    { 0x01, 0x02, 0x04, 0x08 }
+  };
+  uint8_t saved[4], check[4];
+  for (uint8_t i = 0; i < 4; i++) saved[i] = wishboneRead(scratchAddress + i);
+  
+  _burstEnabled = true;
+  bool ok = true;
+  for (uint8_t p = 0; p < 2 && ok; p++) {
+    wishboneWriteBurst(scratchAddress, patterns[p], 4);
+    for (uint8_t i = 0; i < 4; i++) {
+      if (wishboneRead(scratchAddress + i) != patterns[p][i]) ok = false;
+    }
+    wishboneReadBurst(scratchAddress, check, 4);
+    if (memcmp(check, patterns[p], 4) != 0) ok = false;
+  }
+  
+  _burstEnabled = false;
+  for (uint8_t i = 0; i < 4; i++) wishboneWrite(scratchAddress + i, saved[i]);
+  _burstEnabled = ok;
+  
+  _out.printf("[MCP] Burst transfers %s\n", ok ? "enabled" : "NOT supported - using single-byte");
+  return ok;
+}
+
+inline void PapilioMCPClass::setSPITiming(uint32_t clockHz, uint16_t readWaitNs, bool readyByte) {
+  McpBusLock lock(_bus, busClass());
+  _spiHz = clockHz;
+  _readWaitNs = readWaitNs;
+  _readyByte = readyByte;
+}
+
+// One candidate setting: MCP_CAL_ROUNDS of single and burst ID reads, plus
+// a scratch write/read-back, all matching the reference. Caller holds the bus.
+inline bool PapilioMCPClass::calTest(uint16_t idAddress, const uint8_t* ref, uint8_t idLen,
+                                     int32_t scratchAddress) {
+  uint8_t buf[MCP_CAL_MAX_ID];
+  for (uint8_t round = 0; round < MCP_CAL_ROUNDS; round++) {
+    for (uint8_t i = 0; i < idLen; i++) {
+      rawRead(idAddress + i, buf, 1, MCP_BURST_INCREMENT);
+      if (buf[0] != ref[i]) return false;
+    }
+    rawRead(idAddress, buf, idLen, MCP_BURST_INCREMENT);
+    if (memcmp(buf, ref, idLen) != 0) return false;
+    if (scratchAddress >= 0) {
+      uint8_t pattern[4] = { (uint8_t)(0x5A ^ round), (uint8_t)(0xA5 + round),
+                             (uint8_t)(1 << (round & 7)), (uint8_t)~(1 << (round & 7)) };
+      rawWrite(scratchAddress, pattern, sizeof(pattern), MCP_BURST_INCREMENT);
+      rawRead(scratchAddress, buf, sizeof(pattern), MCP_BURST_INCREMENT);
+      if (memcmp(buf, pattern, sizeof(pattern)) != 0) return false;
+    }
+  }
+  return true;
+}
+
+// Shortest passing read wait at the current clock, plus one step of margin.
+// If the margin step fails the scan goes on past it; found reports whether
+// any wait passed, and without a margin the last passing wait is returned.
+inline uint16_t PapilioMCPClass::calFindWait(uint16_t idAddress, const uint8_t* ref,
+                                             uint8_t idLen, int32_t scratchAddress,
+                                             bool& found) {
+  static const uint16_t waits[] = MCP_CAL_WAITS;
+  const uint8_t steps = sizeof(waits) / sizeof(waits[0]);
+  uint16_t passed = 0;
+  found = false;
+  for (uint8_t w = 0; w < steps; w++) {
+    _readWaitNs = waits[w];
+    if (!calTest(idAddress, ref, idLen, scratchAddress)) continue;
+    found = true;
+    passed = waits[w];
+    if (w + 1 == steps) break;   // Longest wait: no margin step left
+    _readWaitNs = waits[++w];
+    if (calTest(idAddress, ref, idLen, scratchAddress)) return waits[w];
+  }
+  return passed;
+}
+
+inline bool PapilioMCPClass::calibrateSPI(uint16_t idAddress, uint8_t idLen,
+                                          int32_t scratchAddress) {
+  static const uint32_t clocks[] = MCP_CAL_CLOCKS;
+  const uint8_t nClocks = sizeof(clocks) / sizeof(clocks[0]);
+  if (!_spi) return false;
+  if (idLen == 0) idLen = 1;
+  if (idLen > MCP_CAL_MAX_ID) idLen = MCP_CAL_MAX_ID;
+  
+  // Per-clock outcome, printed once the bus is released: cost 0 = failed
+  uint32_t costNs[nClocks] = {};
+  uint16_t waitNs[nClocks] = {};
+  bool readyOk[nClocks] = {};
+  uint8_t tried = 0;
+  uint8_t ref[MCP_CAL_MAX_ID];
+  bool ok;
+  
+  {
+    // The sweep holds the bus throughout (tens of ms), so no other
+    // transaction ever runs at an untested setting
+    McpBusLock lock(_bus, busClass());
+    uint32_t oldHz = _spiHz;
+    uint16_t oldWait = _readWaitNs;
+    bool oldReady = _readyByte;
+    
+    // Reference read at the conservative default timing
+    _spiHz = MCP_SPI_SPEED;
+    _readWaitNs = MCP_READ_WAIT_NS;
+    _readyByte = false;
+    rawRead(idAddress, ref, idLen, MCP_BURST_INCREMENT);
+    ok = false;
+    for (uint8_t i = 0; i < idLen; i++) {
+      if (ref[i] != 0x00 && ref[i] != 0xFF) ok = true;   // Not a floating bus
+    }
+    ok = ok && calTest(idAddress, ref, idLen, scratchAddress);
+    
+    uint32_t bestHz = oldHz, bestCost = UINT32_MAX;
+    uint16_t bestWait = oldWait;
+    bool bestReady = oldReady;
+    for (uint8_t c = 0; ok && c < nClocks; c++) {
+      if (clocks[c] < MCP_SPI_SPEED) continue;
+      tried = c + 1;
+      _spiHz = clocks[c];
+      uint32_t byteNs = 8000000000ULL / clocks[c];
+      
+      _readyByte = true;
+      _readyTimeouts = 0;
+      bool ready = calTest(idAddress, ref, idLen, scratchAddress) && !_readyTimeouts;
+      _readyByte = false;
+      bool found;
+      uint16_t wait = calFindWait(idAddress, ref, idLen, scratchAddress, found);
+      if (!ready && !found) break;
+      
+      // A single read is 4 bytes on the wire plus the turnaround; the ready
+      // byte costs at least one more byte time
+      uint32_t waitCost = found ? 4 * byteNs + wait : UINT32_MAX;
+      uint32_t readyCost = ready ? 5 * byteNs : UINT32_MAX;
+      readyOk[c] = readyCost < waitCost;
+      costNs[c] = readyOk[c] ? readyCost : waitCost;
+      waitNs[c] = wait;
+      if (costNs[c] < bestCost) {
+        bestCost = costNs[c];
+        bestHz = clocks[c];
+        bestWait = found ? wait : MCP_READ_WAIT_NS;
+        bestReady = readyOk[c];
+      }
+    }
+    
+    _spiHz = ok ? bestHz : oldHz;
+    _readWaitNs = ok ? bestWait : oldWait;
+    _readyByte = ok ? bestReady : oldReady;
+    _readyTimeouts = 0;
+  }
+  
+  if (!ok) {
+    _out.printf("ERR T ID register %04X unstable or floating (%02X)\n", idAddress, ref[0]);
+    return false;
+  }
+  for (uint8_t c = 0; c < tried; c++) {
+    if (clocks[c] < MCP_SPI_SPEED) continue;
+    if (!costNs[c]) _out.printf("T %luHz FAIL\n", (unsigned long)clocks[c]);
+    else if (readyOk[c]) _out.printf("T %luHz READY ~%luns/read\n",
+                                     (unsigned long)clocks[c], (unsigned long)costNs[c]);
+    else _out.printf("T %luHz WAIT=%uns ~%luns/read\n", (unsigned long)clocks[c],
+                     waitNs[c], (unsigned long)costNs[c]);
+  }
+  _out.printf("[MCP] SPI calibrated: %luHz, %s, wait %uns\n", (unsigned long)_spiHz,
+              _readyByte ? "ready byte" : "timed read", _readWaitNs);
+  return true;
+}
+
+#if MCP_ENABLE_CACHE
+// K                  - list ranges and hit/miss counts
+// K AAAA LLLL C|T|V  - declare a cached / write-through / volatile range
+// K F | K I | K R    - flush, invalidate, remove all ranges
+inline void PapilioMCPClass::cmdCache(McpArgs& a) {
+  char** argv = a.argv;
+  uint8_t argc = a.argc;
+  static const char* policyNames[] = { "VOLATILE", "WRITE-THROUGH", "CACHED" };
+  uint32_t start, len;
+  
+  if (argc == 1) {
+    for (uint8_t i = 0; i < _cacheRangeCount; i++) {
+      const McpCacheRange& r = _cacheRanges[i];
+      uint16_t valid = 0, dirty = 0;
+      for (uint16_t j = 0; j < r.len && r.policy != MCP_CACHE_VOLATILE; j++) {
+        uint16_t slot = r.offset + j;
+        if (_cacheValid[slot >> 3] & (1 << (slot & 7))) valid++;
+        if (_cacheDirty[slot >> 3] & (1 << (slot & 7))) dirty++;
+      }
+      _out.printf("  %04X-%04X %-13s valid=%u dirty=%u\n", r.start, r.start + r.len - 1,
+                    policyNames[r.policy], valid, dirty);
+    }
+    _out.printf("OK K %u ranges, %u/%u bytes, hits=%lu misses=%lu\n",
+                  _cacheRangeCount, _cacheUsed, MCP_CACHE_SIZE,
+                  (unsigned long)_cacheHits, (unsigned long)_cacheMisses);
+  } else if (argc == 2 && strlen(argv[1]) == 1) {
+    char action = toupper(argv[1][0]);
+    if (action == 'F') _out.printf("OK K FLUSHED %u\n", flushCache());
+    else if (action == 'I') { invalidateCache(); sendResponse("OK K INVALIDATED"); }
+    else if (action == 'R') { clearCache(); sendResponse("OK K RESET"); }
+    else sendResponse("ERR: K [AAAA LLLL C|T|V | F | I | R]");
+  } else if (argc == 4 && parseHex(argv[1], start) && parseHex(argv[2], len) &&
+             strlen(argv[3]) == 1 && strchr("CcTtVv", argv[3][0])) {
+    char p = toupper(argv[3][0]);
+    McpCachePolicy policy = p == 'C' ? MCP_CACHE_CACHED :
+                            p == 'T' ? MCP_CACHE_WRITE_THROUGH : MCP_CACHE_VOLATILE;
+    if (start > 0xFFFF || len > 0xFFFF || !cacheRange(start, len, policy)) {
+      sendResponse("ERR: K range table or pool full");
+    } else {
+      _out.printf("OK K %04X %04X %s\n", (unsigned)start, (unsigned)len, policyNames[policy]);
+    }
+  } else {
+    sendResponse("ERR: K [AAAA LLLL C|T|V | F | I | R]");
+  }
+}
+#endif
+
 inline void PapilioMCPClass::enableJTAG() {
   pinMode(MCP_PIN_TCK, OUTPUT);
   pinMode(MCP_PIN_TMS, OUTPUT);
@@ -197,245 +2422,2032 @@ inline void PapilioMCPClass::enableJTAG() {
   esp_rom_gpio_connect_in_signal(MCP_PIN_TDO,   USB_JTAG_TDO_BRIDGE_IDX, false);
   
   _jtagEnabled = true;
-  Serial.println("[MCP] JTAG bridge enabled");
+  _out.println("[MCP] JTAG bridge enabled");
+  uint8_t state = MCP_JTAG_STATE_BRIDGE;
+  sendEvent(MCP_EVENT_JTAG, &state, 1);
+}
+
+inline void PapilioMCPClass::disableJTAG() {
+  WRITE_PERI_REG(USB_SERIAL_JTAG_CONF0_REG,
+    READ_PERI_REG(USB_SERIAL_JTAG_CONF0_REG)
+    & ~USB_SERIAL_JTAG_USB_JTAG_BRIDGE_EN);
+  
+  pinMode(MCP_PIN_TCK,  INPUT);
+  pinMode(MCP_PIN_TMS,  INPUT);
+  pinMode(MCP_PIN_TDI,  INPUT);
+  pinMode(MCP_PIN_TDO,  INPUT);
+  pinMode(MCP_PIN_SRST, INPUT);
+  
+  _jtagEnabled = false;
+  _out.println("[MCP] JTAG bridge disabled");
+  uint8_t state = MCP_JTAG_STATE_OFF;
+  sendEvent(MCP_EVENT_JTAG, &state, 1);
+}
+
+#if MCP_ENABLE_JTAG_PROG
+static_assert(MCP_PIN_TCK < 32 && MCP_PIN_TMS < 32 && MCP_PIN_TDI < 32 && MCP_PIN_TDO < 32,
+              "JTAG programming drives the pins through the GPIO 0-31 registers");
+#define MCP_JTAG_TCK_MASK (1u << MCP_PIN_TCK)
+#define MCP_JTAG_TMS_MASK (1u << MCP_PIN_TMS)
+#define MCP_JTAG_TDI_MASK (1u << MCP_PIN_TDI)
+
+inline void mcpJtagDelay() {
+#if MCP_JTAG_HALF_CYCLES
+  uint32_t start = esp_cpu_get_cycle_count();
+  while (esp_cpu_get_cycle_count() - start < MCP_JTAG_HALF_CYCLES) {}
+#endif
+}
+
+// One TCK cycle. TMS/TDI are set while TCK is low; TDO changes on the
+// falling edge, so it is read with TCK high.
+inline uint8_t PapilioMCPClass::jtagClock(uint8_t tms, uint8_t tdi) {
+  REG_WRITE(tms ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, MCP_JTAG_TMS_MASK);
+  REG_WRITE(tdi ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, MCP_JTAG_TDI_MASK);
+  mcpJtagDelay();
+  REG_WRITE(GPIO_OUT_W1TS_REG, MCP_JTAG_TCK_MASK);
+  uint8_t tdo = (REG_READ(GPIO_IN_REG) >> MCP_PIN_TDO) & 1;
+  mcpJtagDelay();
+  REG_WRITE(GPIO_OUT_W1TC_REG, MCP_JTAG_TCK_MASK);
+  return tdo;
+}
+
+// n TMS bits, LSB first (TDI low)
+inline void PapilioMCPClass::jtagTms(uint8_t bits, uint8_t n) {
+  for (; n; n--, bits >>= 1) jtagClock(bits & 1, 0);
+}
+
+// General scan in Shift-IR/DR, LSB first; tdi or tdo may be null. With exit
+// the last bit moves on to Exit1.
+inline void PapilioMCPClass::jtagShift(const uint8_t* tdi, uint8_t* tdo, uint16_t bits, bool exit) {
+  for (uint16_t i = 0; i < bits; i++) {
+    uint8_t in = tdi ? (tdi[i >> 3] >> (i & 7)) & 1 : 0;
+    uint8_t out = jtagClock(exit && i == bits - 1, in);
+    if (!tdo) continue;
+    if ((i & 7) == 0) tdo[i >> 3] = 0;
+    tdo[i >> 3] |= out << (i & 7);
+  }
+}
+
+// Bitstream fast path: TMS stays low in Shift-DR and TDO is not read
+inline void PapilioMCPClass::jtagShiftBytes(const uint8_t* data, uint16_t n) {
+  while (n--) {
+    uint8_t v = *data++;
+    for (uint8_t bit = 0; bit < 8; bit++, v >>= 1) {
+      REG_WRITE((v & 1) ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, MCP_JTAG_TDI_MASK);
+      mcpJtagDelay();
+      REG_WRITE(GPIO_OUT_W1TS_REG, MCP_JTAG_TCK_MASK);
+      mcpJtagDelay();
+      REG_WRITE(GPIO_OUT_W1TC_REG, MCP_JTAG_TCK_MASK);
+    }
+  }
+}
+
+// Runs of 00/FF (most of a sparse bitstream) set TDI once and toggle TCK
+inline void PapilioMCPClass::jtagShiftRun(uint8_t value, uint16_t n) {
+  if (value != 0x00 && value != 0xFF) {
+    while (n--) jtagShiftBytes(&value, 1);
+    return;
+  }
+  REG_WRITE(value ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, MCP_JTAG_TDI_MASK);
+  for (uint32_t bits = (uint32_t)n * 8; bits; bits--) {
+    mcpJtagDelay();
+    REG_WRITE(GPIO_OUT_W1TS_REG, MCP_JTAG_TCK_MASK);
+    mcpJtagDelay();
+    REG_WRITE(GPIO_OUT_W1TC_REG, MCP_JTAG_TCK_MASK);
+  }
+}
+
+// A chunk is checked whole before any of it is shifted
+inline bool PapilioMCPClass::jtagPackValid(const uint8_t* p, uint8_t len) {
+  uint16_t i = 0;
+  while (i < len) {
+    uint8_t c = p[i++];
+    i += c >= 0x80 ? 1 : c + 1;
+  }
+  return len > 0 && i == len;
+}
+
+inline void PapilioMCPClass::jtagAcquire() {
+  // Take the pins from the USB bridge without the J command's messages
+  _jtagBridgeWas = _jtagEnabled;
+  if (_jtagEnabled) {
+    WRITE_PERI_REG(USB_SERIAL_JTAG_CONF0_REG,
+      READ_PERI_REG(USB_SERIAL_JTAG_CONF0_REG)
+      & ~USB_SERIAL_JTAG_USB_JTAG_BRIDGE_EN);
+    _jtagEnabled = false;
+  }
+  REG_WRITE(GPIO_OUT_W1TC_REG, MCP_JTAG_TCK_MASK | MCP_JTAG_TMS_MASK | MCP_JTAG_TDI_MASK);
+  pinMode(MCP_PIN_TCK, OUTPUT);
+  pinMode(MCP_PIN_TMS, OUTPUT);
+  pinMode(MCP_PIN_TDI, OUTPUT);
+  pinMode(MCP_PIN_TDO, INPUT);
+  pinMode(MCP_PIN_SRST, OUTPUT);
+  digitalWrite(MCP_PIN_SRST, HIGH);
+  esp_rom_gpio_connect_out_signal(MCP_PIN_TCK, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MCP_PIN_TMS, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MCP_PIN_TDI, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MCP_PIN_SRST, SIG_GPIO_OUT_IDX, false, false);
+  
+  jtagTms(0x1F, 5);   // Test-Logic-Reset from any state
+  jtagTms(0x00, 1);   // Run-Test/Idle
+  _jtagOwned = true;
+  _jtagShifting = false;
+  uint8_t state = MCP_JTAG_STATE_PROG;
+  sendEvent(MCP_EVENT_JTAG, &state, 1);
+}
+
+inline void PapilioMCPClass::jtagRelease() {
+  if (_jtagShifting) jtagTms(0x03, 3);   // Exit1, Update, Run-Test/Idle
+  _jtagOwned = false;
+  _jtagShifting = false;
+  pinMode(MCP_PIN_TCK,  INPUT);
+  pinMode(MCP_PIN_TMS,  INPUT);
+  pinMode(MCP_PIN_TDI,  INPUT);
+  pinMode(MCP_PIN_SRST, INPUT);
+  if (_jtagBridgeWas) {
+    enableJTAG();   // Reports the bridge state
+  } else {
+    uint8_t state = MCP_JTAG_STATE_OFF;
+    sendEvent(MCP_EVENT_JTAG, &state, 1);
+  }
+  // New gateware: nothing shadowed from the old one is valid
+  invalidateCache();
+}
+
+inline void PapilioMCPClass::jtagFrame(uint16_t addr, uint8_t action, const uint8_t* payload,
+                                       uint8_t len) {
+  if (action != MCP_JTAG_ACQUIRE && action != MCP_JTAG_RELEASE &&
+      (!_jtagOwned || _jtagShifting)) {
+    sendFrame(MCP_ST_BAD_SEQ, addr, action);
+    return;
+  }
+  uint8_t data[(MCP_JTAG_DR_MAX + 7) / 8];
+  switch (action) {
+    case MCP_JTAG_ACQUIRE:
+      jtagAcquire();
+      jtagTms(0x01, 3);                  // Select-DR, Capture-DR, Shift-DR
+      jtagShift(nullptr, data, 32, true); // IDCODE is selected after reset
+      jtagTms(0x01, 2);                  // Update-DR, Run-Test/Idle
+      sendFrame(MCP_ST_OK, addr, action, data, 4);
+      break;
+    case MCP_JTAG_RELEASE:
+      if (_jtagOwned) jtagRelease();
+      sendFrame(MCP_ST_OK, addr, action);
+      break;
+    case MCP_JTAG_IR: {
+      if (len != 1 || payload[0] == 0 || payload[0] > 16) {
+        sendFrame(MCP_ST_BAD_LEN, addr, action);
+        break;
+      }
+      uint8_t ir[2] = { (uint8_t)(addr & 0xFF), (uint8_t)(addr >> 8) };
+      jtagTms(0x03, 4);                  // Select-DR, Select-IR, Capture-IR, Shift-IR
+      jtagShift(ir, data, payload[0], true);
+      jtagTms(0x01, 2);
+      sendFrame(MCP_ST_OK, addr, action, data, (payload[0] + 7) / 8);
+      break;
+    }
+    case MCP_JTAG_DR: {
+      uint8_t bits = len ? payload[0] : 0;
+      if (bits == 0 || bits > MCP_JTAG_DR_MAX || len != 1 + (bits + 7) / 8) {
+        sendFrame(MCP_ST_BAD_LEN, addr, action);
+        break;
+      }
+      jtagTms(0x01, 3);
+      jtagShift(payload + 1, data, bits, true);
+      jtagTms(0x01, 2);
+      sendFrame(MCP_ST_OK, addr, action, data, (bits + 7) / 8);
+      break;
+    }
+    case MCP_JTAG_IDLE:
+      for (uint32_t i = 0; i < addr; i++) jtagClock(0, 0);
+      sendFrame(MCP_ST_OK, addr, action);
+      break;
+    default:
+      sendFrame(MCP_ST_BAD_OP, addr, action);
+      break;
+  }
+}
+
+inline void PapilioMCPClass::jtagData(uint16_t seq, uint8_t flags, const uint8_t* payload,
+                                      uint8_t len) {
+  bool first = flags & MCP_JTAG_FIRST;
+  if (!_jtagOwned || (first ? seq != 0 : !_jtagShifting || seq != _jtagSeq)) {
+    sendFrame(MCP_ST_BAD_SEQ, seq, flags);
+    return;
+  }
+  if (!jtagPackValid(payload, len)) {
+    sendFrame(MCP_ST_BAD_LEN, seq, flags);
+    return;
+  }
+  if (first) {
+    if (_jtagShifting) jtagTms(0x03, 3);
+    jtagTms(0x01, 3);   // Select-DR, Capture-DR, Shift-DR
+    _jtagShifting = true;
+    _jtagBytes = 0;
+    _jtagCrc = 0xFFFF;
+  }
+  
+  bool last = flags & MCP_JTAG_LAST;
+  for (uint8_t i = 0; i < len;) {
+    uint8_t c = payload[i++];
+    bool run = c >= 0x80;
+    uint16_t n = run ? c - 0x7D : c + 1;
+    const uint8_t* p = &payload[i];
+    i += run ? 1 : n;
+    // The stream's final bit goes out with TMS high
+    uint16_t body = last && i == len ? n - 1 : n;
+    if (run) {
+      jtagShiftRun(*p, body);
+      for (uint16_t k = 0; k < n; k++) _jtagCrc = crc16(p, 1, _jtagCrc);
+    } else {
+      jtagShiftBytes(p, body);
+      _jtagCrc = crc16(p, n, _jtagCrc);
+    }
+    if (body != n) {
+      jtagShift(run ? p : p + n - 1, nullptr, 8, true);
+      jtagTms(0x01, 2);   // Update-DR, Run-Test/Idle
+      _jtagShifting = false;
+    }
+    _jtagBytes += n;
+  }
+  _jtagSeq = seq + 1;
+  
+  uint8_t info[6] = {
+    (uint8_t)(_jtagBytes >> 24), (uint8_t)(_jtagBytes >> 16),
+    (uint8_t)(_jtagBytes >> 8), (uint8_t)_jtagBytes,
+    (uint8_t)(_jtagCrc >> 8), (uint8_t)_jtagCrc
+  };
+  sendFrame(MCP_ST_OK, seq, flags, info, sizeof(info));
+}
+#endif
+
+#if MCP_ENABLE_EVENTS
+// Callable from the sketch and the service task. Waits for room in the
+// output ring like a command reply, so a live host sees every event.
+inline void PapilioMCPClass::sendEventAt(uint8_t kind, uint32_t t, const uint8_t* data,
+                                         uint8_t len) {
+  if (!(_eventMask & (1u << (kind - 1)))) return;
+  uint8_t body[4 + MCP_EVENT_MAX_DATA] = {
+    (uint8_t)(t >> 24), (uint8_t)(t >> 16), (uint8_t)(t >> 8), (uint8_t)t
+  };
+  if (len) memcpy(&body[4], data, len);
+  portENTER_CRITICAL(&_eventMux);
+  uint16_t seq = _eventSeq++;
+  portEXIT_CRITICAL(&_eventMux);
+  sendFrame(MCP_ST_EVENT, seq, kind, body, 4 + len);
+}
+
+inline uint8_t PapilioMCPClass::jtagState() {
+  if (isJTAGProgramming()) return MCP_JTAG_STATE_PROG;
+  return _jtagEnabled ? MCP_JTAG_STATE_BRIDGE : MCP_JTAG_STATE_OFF;
+}
+#endif
+
+#if MCP_ENABLE_WATCH
+inline uint8_t PapilioMCPClass::watch(uint16_t address, uint8_t mask, int16_t value, bool pause) {
+  if (!_spi || !mask) return 0;
+  uint8_t last = wishboneRead(address);   // Reference for the first sample
+  uint8_t id = 0;
+  portENTER_CRITICAL(&_watchMux);
+  bool was = _watchSpanCount;
+  for (uint8_t i = 0; i < MCP_WATCH_MAX && !id; i++) {
+    McpWatch& w = _watches[i];
+    if (w.used) continue;
+    w.address = address;
+    w.mask = mask;
+    w.equal = value >= 0;
+    w.value = value;
+    w.last = last;
+    w.pause = pause;
+    w.hits = 0;
+    w.used = true;
+    id = i + 1;
+  }
+  // The sampler must never see the slot before its span and offset
+  if (id) watchRebuild();
+  portEXIT_CRITICAL(&_watchMux);
+  if (id) watchTimerSync(was);
+  return id;
+}
+
+inline bool PapilioMCPClass::unwatch(uint8_t id) {
+  if (id < 1 || id > MCP_WATCH_MAX || !_watches[id - 1].used) return false;
+  portENTER_CRITICAL(&_watchMux);
+  bool was = _watchSpanCount;
+  _watches[id - 1].used = false;
+  watchRebuild();
+  portEXIT_CRITICAL(&_watchMux);
+  watchTimerSync(was);
+  return true;
+}
+
+inline void PapilioMCPClass::clearWatches() {
+  portENTER_CRITICAL(&_watchMux);
+  bool was = _watchSpanCount;
+  for (McpWatch& w : _watches) w.used = false;
+  watchRebuild();
+  portEXIT_CRITICAL(&_watchMux);
+  watchTimerSync(was);
+}
+
+inline bool PapilioMCPClass::setWatchPeriod(uint32_t periodUs) {
+  if (periodUs < MCP_WATCH_MIN_PERIOD_US) return false;
+  _watchPeriodUs = periodUs;
+  if (_watchSpanCount) {
+    esp_timer_stop(_watchTimer);
+    esp_timer_start_periodic(_watchTimer, periodUs);
+  }
+  return true;
+}
+
+// Group the watched addresses into burst reads. Runs under _watchMux together
+// with the table change, so sampleWatch() sees both or neither.
+inline void PapilioMCPClass::watchRebuild() {
+  uint8_t order[MCP_WATCH_MAX];
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < MCP_WATCH_MAX; i++) {
+    if (!_watches[i].used) continue;
+    uint8_t j = n++;
+    for (; j > 0 && _watches[order[j - 1]].address > _watches[i].address; j--) order[j] = order[j - 1];
+    order[j] = i;
+  }
+  // Reading across a gap only pays off when the bytes come in one burst
+  uint8_t gap = _burstEnabled ? MCP_WATCH_GAP : 0;
+  McpWatchSpan spans[MCP_WATCH_MAX];
+  uint8_t spanCount = 0;
+  for (uint8_t k = 0; k < n; k++) {
+    McpWatch& w = _watches[order[k]];
+    McpWatchSpan* sp = spanCount ? &spans[spanCount - 1] : nullptr;
+    uint32_t end = sp ? (uint32_t)sp->start + sp->len : 0;
+    if (sp && w.address < end) {
+      // Same address as the previous watch
+    } else if (sp && w.address <= end + gap && w.address - sp->start < MCP_WATCH_SPAN) {
+      sp->len = w.address - sp->start + 1;
+    } else {
+      sp = &spans[spanCount++];
+      sp->start = w.address;
+      sp->len = 1;
+    }
+    w.span = sp - spans;
+    w.offset = w.address - sp->start;
+  }
+  memcpy(_watchSpans, spans, sizeof(spans));
+  _watchSpanCount = spanCount;
+  _watchGen++;
+}
+
+// (Re)start or stop the timer after a table change; was = spans before it
+inline void PapilioMCPClass::watchTimerSync(bool was) {
+  uint8_t spanCount = _watchSpanCount;
+  if (!_watchTimer && spanCount) {
+    esp_timer_create_args_t args = {};
+    args.callback = watchTimerEntry;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "mcp_watch";
+    args.skip_unhandled_events = true;
+    if (esp_timer_create(&args, &_watchTimer) != ESP_OK) {
+      portENTER_CRITICAL(&_watchMux);
+      _watchSpanCount = 0;
+      portEXIT_CRITICAL(&_watchMux);
+      return;
+    }
+  }
+  if (spanCount && !was) {
+    esp_timer_start_periodic(_watchTimer, _watchPeriodUs);
+  } else if (!spanCount && was) {
+    esp_timer_stop(_watchTimer);
+  }
+}
+
+inline void PapilioMCPClass::watchTimerEntry(void* arg) {
+  static_cast<PapilioMCPClass*>(arg)->sampleWatch();
+}
+
+// Runs in the esp_timer task. Like telemetry, reads bypass the shadow cache.
+inline void PapilioMCPClass::sampleWatch() {
+  McpWatchSpan spans[MCP_WATCH_MAX];
+  portENTER_CRITICAL(&_watchMux);
+  uint8_t n = _watchSpanCount;
+  uint32_t gen = _watchGen;
+  memcpy(spans, _watchSpans, n * sizeof(McpWatchSpan));
+  portEXIT_CRITICAL(&_watchMux);
+  if (!n || isJTAGProgramming()) return;
+  
+  uint8_t data[MCP_WATCH_MAX][MCP_WATCH_SPAN];
+  uint32_t t;
+  {
+    McpBusLock lock(_bus, MCP_BUS_DEBUG);
+    t = micros();
+    for (uint8_t i = 0; i < n; i++) {
+      rawRead(spans[i].start, data[i], spans[i].len, MCP_BURST_INCREMENT);
+    }
+  }
+  
+  bool matched = false;
+  portENTER_CRITICAL(&_watchMux);
+  _watchSamples++;
+  if (gen == _watchGen) {   // The table did not change during the reads
+    for (uint8_t i = 0; i < MCP_WATCH_MAX; i++) {
+      McpWatch& w = _watches[i];
+      if (!w.used) continue;
+      uint8_t v = data[w.span][w.offset];
+      uint8_t was = w.last & w.mask;
+      uint8_t now = v & w.mask;
+      bool hit = w.equal ? (now == w.value && was != w.value) : now != was;
+      uint8_t old = w.last;
+      w.last = v;
+      if (!hit) continue;
+      w.hits++;
+      matched = true;
+      if (w.pause) _watchPause = true;
+      uint8_t next = (_watchHead + 1) % MCP_WATCH_RING;
+      if (next == _watchTail) {
+        _watchDropped++;
+        continue;
+      }
+      _watchRing[_watchHead] = { t, w.address, (uint8_t)(i + 1), old, v };
+      _watchHead = next;
+    }
+  }
+  portEXIT_CRITICAL(&_watchMux);
+  if (matched && _task) xTaskNotifyGive(_task);
+}
+
+inline void PapilioMCPClass::sendWatch() {
+  while (_watchTail != _watchHead) {
+    McpWatchHit hit = _watchRing[_watchTail];
+    portENTER_CRITICAL(&_watchMux);
+    _watchTail = (_watchTail + 1) % MCP_WATCH_RING;
+    portEXIT_CRITICAL(&_watchMux);
+    _out.printf("[MCP] WATCH %02X %04X %02X -> %02X\n", hit.id, hit.address, hit.old, hit.value);
+    uint8_t info[4] = { (uint8_t)(hit.address >> 8), (uint8_t)hit.address, hit.old, hit.value };
+    sendEventAt(MCP_EVENT_WATCH, hit.timeUs, info, sizeof(info));
+  }
+  if (_watchPause) {
+    _watchPause = false;
+    if (!_paused) pause();
+  }
+}
+
+inline void PapilioMCPClass::printWatch(const char* prefix, uint8_t id) {
+  const McpWatch& w = _watches[id - 1];
+  _out.printf("%sV %02X %04X %02X ", prefix, id, w.address, w.mask);
+  if (w.equal) _out.printf("=%02X", w.value);
+  else _out.print("ANY");
+  _out.printf("%s hits=%lu last=%02X\n", w.pause ? " P" : "", (unsigned long)w.hits, w.last);
+}
+
+// V AAAA MM [VV] [P] | V - II | V 0 | V T PPPPPPPP | V
+inline void PapilioMCPClass::cmdWatch(McpArgs& a) {
+  uint8_t argc = a.argc;
+  if (argc == 1) {
+    uint8_t count = 0;
+    for (uint8_t i = 1; i <= MCP_WATCH_MAX; i++) {
+      if (_watches[i - 1].used) {
+        printWatch("", i);
+        count++;
+      }
+    }
+    _out.printf("OK V %u @ %luus samples=%lu dropped=%lu\n", count, (unsigned long)_watchPeriodUs,
+                (unsigned long)_watchSamples, (unsigned long)_watchDropped);
+    return;
+  }
+  uint32_t n;
+  if (argc == 3 && a.action == '-' && !a.argv[1][1] && parseHex(a.argv[2], n) && n <= 0xFF) {
+    if (unwatch(n)) _out.printf("OK V - %02X\n", (unsigned)n);
+    else sendResponse("ERR V NO WATCH");
+    return;
+  }
+  if (argc == 3 && toupper(a.action) == 'T' && !a.argv[1][1] && parseHex(a.argv[2], n)) {
+    if (setWatchPeriod(n)) _out.printf("OK V T %luus\n", (unsigned long)n);
+    else sendResponse("ERR V PERIOD");
+    return;
+  }
+  if (argc == 2 && a.has1 && a.arg1 == 0) {
+    clearWatches();
+    sendResponse("OK V 0");
+    return;
+  }
+  
+  uint32_t addr, mask, value;
+  bool pause = argc >= 4 && toupper(a.argv[argc - 1][0]) == 'P' && !a.argv[argc - 1][1];
+  uint8_t valueArgs = argc - 3 - (pause ? 1 : 0);
+  if (argc < 3 || valueArgs > 1 || !parseHex(a.argv[1], addr) || addr > 0xFFFF ||
+      !parseHex(a.argv[2], mask) || !mask || mask > 0xFF ||
+      (valueArgs && (!parseHex(a.argv[3], value) || value > 0xFF))) {
+    sendResponse("ERR: V [AAAA MM [VV] [P] | - II | 0 | T PPPPPPPP]");
+    return;
+  }
+  uint8_t id = watch(addr, mask, valueArgs ? (int16_t)value : -1, pause);
+  if (id) printWatch("OK ", id);
+  else sendResponse("ERR V FULL");
+}
+#endif
+
+inline void PapilioMCPClass::pause() {
+  if (_events) xEventGroupClearBits(_events, MCP_EVT_RUN);
+  _paused = true;
+  _out.println("[MCP] Sketch PAUSED - MCP has full control");
+  sendEvent(MCP_EVENT_PAUSE);
+}
+
+inline void PapilioMCPClass::resume() {
+  _paused = false;
+  releaseBreakpoint();
+  if (_events) xEventGroupSetBits(_events, MCP_EVT_RUN);
+  _out.println("[MCP] Sketch RESUMED");
+  sendEvent(MCP_EVENT_RESUME);
+}
+
+inline void PapilioMCPClass::waitWhilePaused() {
+  while (_paused) {
+    if (_events) {
+      xEventGroupWaitBits(_events, MCP_EVT_RUN, pdFALSE, pdFALSE, portMAX_DELAY);
+    } else {
+      update();
+      delay(1);
+    }
+  }
+}
+
+// Let a sketch blocked in breakpoint() continue
+inline void PapilioMCPClass::releaseBreakpoint() {
+  _atBreakpoint = false;
+  if (_events) xEventGroupSetBits(_events, MCP_EVT_CONTINUE);
+}
+
+inline void PapilioMCPClass::setBreakpointsEnabled(bool enabled) {
+  portENTER_CRITICAL(&_bpMux);
+  _breakpointsEnabled = enabled;
+  for (uint8_t i = 0; i < _bpCount; i++) {
+    _bpSites[i]->armed = enabled && _bpSites[i]->enabled;
+  }
+  portEXIT_CRITICAL(&_bpMux);
+}
+
+// First run of a site: give it an ID and its real armed state
+inline void PapilioMCPClass::registerSite(McpBreakSite& site) {
+  portENTER_CRITICAL(&_bpMux);
+  if (!site.id) {
+    if (_bpCount < MCP_BP_MAX) {
+      _bpSites[_bpCount++] = &site;
+      site.id = _bpCount;
+    } else {
+      site.id = 0xFF;   // Unlisted: follows B 1|0 only
+    }
+  }
+  site.armed = _breakpointsEnabled && site.enabled;
+  portEXIT_CRITICAL(&_bpMux);
+}
+
+// Legacy entry point: the site is found by name on every call
+inline void PapilioMCPClass::breakpoint(const char* name) {
+  if (!_breakpointsEnabled) return;
+  
+  McpBreakSite* site = nullptr;
+  for (uint8_t i = 0; i < _bpNamedCount && !site; i++) {
+    const char* n = _bpNamed[i].name;
+    if (n == name || (n && name && strcmp(n, name) == 0)) site = &_bpNamed[i];
+  }
+  if (!site && _bpNamedCount < MCP_BP_NAMED) {
+    site = &_bpNamed[_bpNamedCount++];
+    site->name = name;
+  }
+  if (!site) {
+    static McpBreakSite overflow(nullptr);   // Shared by names past MCP_BP_NAMED
+    site = &overflow;
+  }
+  if (site->armed) breakpointHit(*site);
+}
+
+inline void PapilioMCPClass::breakpointHit(McpBreakSite& site) {
+  if (site.id == 0) {
+    registerSite(site);
+    if (!site.armed) return;
+  }
+  
+  // Counted, thresholded and conditional hits pass without any I/O
+  site.hits++;
+  if (site.hits <= site.after) return;
+  if (site.condMask && (wishboneRead(site.condAddr) & site.condMask) != site.condValue) return;
+  
+  _breakpointCount++;
+  if (_events) xEventGroupClearBits(_events, MCP_EVT_CONTINUE);
+  _atBreakpoint = true;
+  _paused = true;
+  
+  const char* name = site.name;
+  if (name) {
+    _out.printf("[MCP] BREAKPOINT #%d '%s' (site %02X, hit %lu) - Type C to continue\n",
+                _breakpointCount, name, site.id, (unsigned long)site.hits);
+  } else {
+    _out.printf("[MCP] BREAKPOINT #%d (site %02X, hit %lu) - Type C to continue\n",
+                _breakpointCount, site.id, (unsigned long)site.hits);
+  }
+  uint16_t number = _breakpointCount;
+  uint8_t info[7] = {
+    site.id, (uint8_t)(number >> 8), (uint8_t)number,
+    (uint8_t)(site.hits >> 24), (uint8_t)(site.hits >> 16),
+    (uint8_t)(site.hits >> 8), (uint8_t)site.hits
+  };
+  sendEvent(MCP_EVENT_BREAK, info, sizeof(info));
+  
+  // Block here until resumed via 'C' command
+  while (_atBreakpoint && _breakpointsEnabled) {
+    if (_events) {
+      // The service task answers commands; sleep until it releases us
+      xEventGroupWaitBits(_events, MCP_EVT_CONTINUE, pdTRUE, pdFALSE, portMAX_DELAY);
+    } else {
+      update();  // Process MCP commands while at breakpoint
+      delay(10);
+    }
+  }
+  
+  _paused = false;
+  if (name) {
+    _out.printf("[MCP] Continuing from breakpoint '%s'\n", name);
+  } else {
+    _out.println("[MCP] Continuing from breakpoint");
+  }
+  sendEvent(MCP_EVENT_CONTINUE, info, 3);
+}
+
+inline void PapilioMCPClass::sendResponse(const char* response) {
+  _out.println(response);
+}
+
+// Copies as much as fits (or nothing, when whole) in one critical section,
+// so a write that fits is never interleaved with another context's output
+inline size_t McpOutput::push(const uint8_t* buf, size_t len, bool whole) {
+  portENTER_CRITICAL(&_mux);
+  uint32_t head = _head;
+  size_t n = MCP_TX_BUFFER_SIZE - (head - _tail);
+  if (n > len) n = len;
+  if (whole && n < len) n = 0;
+  if (n) {
+    uint32_t at = head & (MCP_TX_BUFFER_SIZE - 1);
+    size_t first = MCP_TX_BUFFER_SIZE - at;
+    if (first > n) first = n;
+    memcpy(&_buf[at], buf, first);
+    memcpy(_buf, buf + first, n - first);
+    _head = head + n;
+#if MCP_ENABLE_STATS
+    bytes += n;
+#endif
+  }
+  portEXIT_CRITICAL(&_mux);
+  return n;
+}
+
+inline size_t McpOutput::put(const uint8_t* buf, size_t len) {
+  size_t done = push(buf, len, false);
+  uint32_t progress = millis();
+  while (done < len) {
+    // Ring full: make room ourselves, or wait for whoever is draining.
+    // After one stall, drop at once until the host takes data again.
+    if (drain()) {
+      progress = millis();
+    } else if (_stalled || millis() - progress >= MCP_TX_STALL_MS) {
+      _stalled = true;
+      dropped += len - done;
+      break;
+    } else {
+      delay(1);
+    }
+    done += push(buf + done, len - done, false);
+  }
+  return len;
+}
+
+inline void McpOutput::beginTag(const char* tag, uint8_t len) {
+  memcpy(_tag, tag, len);
+  _tag[len] = ' ';
+  _tagOwner = xTaskGetCurrentTaskHandle();
+  _tagLineStart = true;
+  _tagLen = len + 1;
+}
+
+// A deferred reply keeps its tag while other output goes out untagged
+inline uint8_t McpOutput::suspendTag() {
+  uint8_t len = _tagLen;
+  _tagLen = 0;
+  return len;
+}
+
+inline void McpOutput::resumeTag(uint8_t len) {
+  _tagOwner = xTaskGetCurrentTaskHandle();
+  _tagLineStart = true;
+  _tagLen = len;
+}
+
+// The bare tag ends the reply
+inline void McpOutput::endTag() {
+  uint8_t len = _tagLen;
+  _tagLen = 0;
+  if (!_tagLineStart) put((const uint8_t*)"\r\n", 2);
+  _tag[len - 1] = '\n';
+  put(_tag, len);
+}
+
+// Short lines go out with their tag in one ring write, so they stay whole
+inline size_t McpOutput::writeTagged(const uint8_t* buf, size_t len) {
+  for (size_t off = 0; off < len; ) {
+    const uint8_t* nl = (const uint8_t*)memchr(buf + off, '\n', len - off);
+    size_t n = nl ? nl - (buf + off) + 1 : len - off;
+    if (!_tagLineStart) {
+      put(buf + off, n);
+    } else if (_tagLen + n <= 80) {
+      uint8_t line[80];
+      memcpy(line, _tag, _tagLen);
+      memcpy(line + _tagLen, buf + off, n);
+      put(line, _tagLen + n);
+    } else {
+      put(_tag, _tagLen);
+      put(buf + off, n);
+    }
+    _tagLineStart = nl != nullptr;
+    off += n;
+  }
+  return len;
+}
+
+inline bool McpOutput::drain() {
+  if (__atomic_exchange_n(&_draining, 1, __ATOMIC_ACQUIRE)) return false;
+  bool moved = false;
+  for (;;) {
+    uint32_t tail = _tail;
+    size_t n = _head - tail;
+    if (!n) break;
+    uint32_t at = tail & (MCP_TX_BUFFER_SIZE - 1);
+    if (n > MCP_TX_BUFFER_SIZE - at) n = MCP_TX_BUFFER_SIZE - at;
+#if MCP_USB_DIRECT
+    // Sketch output still queued in Serial goes first, so the two stay in order
+    if (_serialIdle >= 0 && Serial.availableForWrite() >= _serialIdle) {
+      n = writeFifo(&_buf[at], n);
+    } else
+#endif
+    {
+      int room = Serial.availableForWrite();
+      if (room <= 0) break;
+      if (n > (size_t)room) n = room;
+      n = Serial.write(&_buf[at], n);
+    }
+    if (!n) break;
+    __atomic_store_n(&_tail, tail + n, __ATOMIC_RELEASE);
+    moved = true;
+    _stalled = false;
+  }
+  __atomic_store_n(&_draining, 0, __ATOMIC_RELEASE);
+  return moved;
+}
+
+#if MCP_USB_DIRECT
+// Fills the IN FIFO and sends each full packet at once; only the tail of a
+// run goes out short. While the host is reading, a full FIFO frees up again
+// within a few microseconds, so one call moves a whole reply at USB speed.
+// HWCDC's TX interrupt fills the same FIFO from Serial's queue, so it stays
+// masked while MCP bytes go in and cannot splice into an MCP packet.
+inline size_t McpOutput::writeFifo(const uint8_t* buf, size_t len) {
+  uint32_t intr = usb_serial_jtag_ll_get_intr_ena_status() & USB_SERIAL_JTAG_INTR_SERIAL_IN_EMPTY;
+  if (intr) usb_serial_jtag_ll_disable_intr_mask(intr);
+  size_t done = 0;
+  while (done < len) {
+    if (!usb_serial_jtag_ll_txfifo_writable()) {
+      if (_fifoTimedOut) break;   // Don't spin every pass for a closed port
+      uint32_t start = micros();
+      while (!usb_serial_jtag_ll_txfifo_writable() && micros() - start < MCP_USB_SPIN_US) {}
+      if (!usb_serial_jtag_ll_txfifo_writable()) {
+        _fifoTimedOut = true;
+        break;
+      }
+    }
+    _fifoTimedOut = false;
+    size_t n = len - done;
+    if (n > MCP_USB_PACKET) n = MCP_USB_PACKET;
+    done += usb_serial_jtag_ll_write_txfifo(buf + done, n);
+    if (!usb_serial_jtag_ll_txfifo_writable() || done == len) {
+      usb_serial_jtag_ll_txfifo_flush();
+    }
+  }
+  if (intr) usb_serial_jtag_ll_ena_intr_mask(intr);
+  return done;
+}
+
+inline void McpOutput::beginDirect() {
+  Serial.flush();   // Boot messages queued in Serial go first
+  _serialIdle = Serial.availableForWrite();
+}
+#endif
+
+inline void McpOutput::drainFor(uint32_t stallMs) {
+  uint32_t progress = millis();
+  while (pending() && millis() - progress < stallMs) {
+    if (drain()) {
+      progress = millis();
+    } else {
+      delay(1);
+    }
+  }
 }
 
-inline void PapilioMCPClass::disableJTAG() {
-  WRITE_PERI_REG(USB_SERIAL_JTAG_CONF0_REG,
-    READ_PERI_REG(USB_SERIAL_JTAG_CONF0_REG)
-    & ~USB_SERIAL_JTAG_USB_JTAG_BRIDGE_EN);
-  
-  pinMode(MCP_PIN_TCK,  INPUT);
-  pinMode(MCP_PIN_TMS,  INPUT);
-  pinMode(MCP_PIN_TDI,  INPUT);
-  pinMode(MCP_PIN_TDO,  INPUT);
-  pinMode(MCP_PIN_SRST, INPUT);
-  
-  _jtagEnabled = false;
-  Serial.println("[MCP] JTAG bridge disabled");
+inline uint8_t PapilioMCPClass::crc8(const uint8_t* data, size_t len, uint8_t crc) {
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
 }
 
-inline void PapilioMCPClass::pause() {
-  _paused = true;
-  Serial.println("[MCP] Sketch PAUSED - MCP has full control");
+inline bool PapilioMCPClass::wishbonePoll(uint16_t address, uint8_t mask, uint8_t value,
+                                          uint16_t timeoutMs, uint8_t* last) {
+  return wishbonePollUs(address, mask, value, (uint32_t)timeoutMs * 1000, 0, last);
 }
 
-inline void PapilioMCPClass::resume() {
-  _paused = false;
-  _atBreakpoint = false;
-  Serial.println("[MCP] Sketch RESUMED");
+inline bool PapilioMCPClass::wishbonePollUs(uint16_t address, uint8_t mask, uint8_t value,
+                                            uint32_t timeoutUs, uint32_t intervalUs,
+                                            uint8_t* last, uint32_t* elapsedUs) {
+  if (!_spi) return false;
+  unsigned long start = micros();
+  uint32_t elapsed;
+  uint8_t v;
+  bool ok;
+  for (;;) {
+    {
+      // Always live, even inside a cached range; lock per read so the
+      // sketch can run its own transactions in between
+      McpBusLock lock(_bus, busClass());
+      rawRead(address, &v, 1, MCP_BURST_INCREMENT);
+    }
+    elapsed = micros() - start;
+    ok = (v & mask) == value;
+    if (ok || elapsed >= timeoutUs) break;
+    if (intervalUs >= 1000) delay(intervalUs / 1000);  // Lets other tasks run
+    if (intervalUs % 1000) delayMicroseconds(intervalUs % 1000);
+  }
+  if (last) *last = v;
+  if (elapsedUs) *elapsedUs = elapsed;
+  return ok;
 }
 
-inline void PapilioMCPClass::breakpoint(const char* name) {
-  if (!_breakpointsEnabled) return;
+// Execute encoded batch ops. Read/poll results are appended to out.
+// done counts the ops that completed; returns an MCP_ST_* code.
+inline uint8_t PapilioMCPClass::runBatch(const uint8_t* ops, size_t len, uint8_t* out,
+                                         size_t outMax, size_t& outLen, uint8_t& done) {
+  size_t pos = 0;
+  outLen = 0;
+  done = 0;
   
-  _breakpointCount++;
-  _atBreakpoint = true;
-  _paused = true;
+  while (pos < len) {
+    const uint8_t* op = &ops[pos];
+    size_t left = len - pos;
+    uint16_t addr = (left >= 3) ? (uint16_t)((op[1] << 8) | op[2]) : 0;
+    
+    switch (op[0]) {
+      case MCP_BATCH_WRITE:
+      case MCP_BATCH_WRITE_FIXED: {
+        if (left < 4 || left < 4u + op[3]) return MCP_ST_BAD_LEN;
+        wishboneWriteBurst(addr, &op[4], op[3],
+                           op[0] == MCP_BATCH_WRITE_FIXED ? MCP_BURST_FIXED : MCP_BURST_INCREMENT);
+        pos += 4 + op[3];
+        break;
+      }
+      
+      case MCP_BATCH_READ: {
+        if (left < 4) return MCP_ST_BAD_LEN;
+        if (outLen + op[3] > outMax) return MCP_ST_BAD_LEN;
+        wishboneReadBurst(addr, &out[outLen], op[3]);
+        outLen += op[3];
+        pos += 4;
+        break;
+      }
+      
+      case MCP_BATCH_POLL: {
+        if (left < 7 || outLen + 1 > outMax) return MCP_ST_BAD_LEN;
+        bool ok = wishbonePoll(addr, op[3], op[4], (op[5] << 8) | op[6], &out[outLen]);
+        outLen++;
+        if (!ok) return MCP_ST_TIMEOUT;
+        pos += 7;
+        break;
+      }
+      
+      case MCP_BATCH_DELAY: {
+        if (left < 3) return MCP_ST_BAD_LEN;
+        delayMicroseconds((op[1] << 8) | op[2]);
+        pos += 3;
+        break;
+      }
+      
+      case MCP_BATCH_FILL: {
+        if (left < 6) return MCP_ST_BAD_LEN;
+        uint8_t chunk[32];
+        memset(chunk, op[3], sizeof(chunk));
+        for (uint16_t n = (op[4] << 8) | op[5]; n; ) {
+          uint8_t k = n > sizeof(chunk) ? sizeof(chunk) : n;
+          wishboneWriteBurst(addr, chunk, k, MCP_BURST_FIXED);
+          n -= k;
+        }
+        pos += 6;
+        break;
+      }
+      
+      default:
+        return MCP_ST_BAD_OP;
+    }
+    done++;
+  }
+  return MCP_ST_OK;
+}
+
+// Parse "Q op;op;..." into batch ops, run them and print one reply line
+inline void PapilioMCPClass::processBatch(const char* p) {
+  uint8_t ops[256];
+  size_t len = 0;
+  size_t results = 0;   // Reply bytes the ops will produce
+  uint8_t index = 0;
+  const char* err = nullptr;
   
-  if (name) {
-    Serial.printf("[MCP] BREAKPOINT #%d '%s' - Type C to continue\n", _breakpointCount, name);
-  } else {
-    Serial.printf("[MCP] BREAKPOINT #%d - Type C to continue\n", _breakpointCount);
+  for (;;) {
+    while (*p == ' ' || *p == ';') p++;
+    if (!*p) break;
+    
+    char type = toupper(*p++);
+    char* end;
+    uint16_t addr = strtoul(p, &end, 16);
+    if (end == p && type != 'D') { err = "SYNTAX"; break; }
+    p = end;
+    
+    if (type == 'W' || type == 'F') {
+      if (*p++ != '=') { err = "SYNTAX"; break; }
+      size_t head = len;
+      uint8_t n = 0;
+      while (isxdigit(p[0]) && isxdigit(p[1]) && len + 4 + n < sizeof(ops)) {
+        char byteHex[3] = { p[0], p[1], 0 };
+        ops[head + 4 + n++] = strtoul(byteHex, NULL, 16);
+        p += 2;
+      }
+      if (isxdigit(p[0]) && isxdigit(p[1])) { err = "TOO LONG"; break; }
+      if (n == 0) { err = "SYNTAX"; break; }
+      if (*p == '*') {
+        uint16_t repeat = strtoul(p + 1, &end, 16);
+        if (type != 'F' || n != 1 || end == p + 1) { err = "SYNTAX"; break; }
+        p = end;
+        uint8_t value = ops[head + 4];
+        ops[len++] = MCP_BATCH_FILL;
+        ops[len++] = addr >> 8;
+        ops[len++] = addr & 0xFF;
+        ops[len++] = value;
+        ops[len++] = repeat >> 8;
+        ops[len++] = repeat & 0xFF;
+      } else {
+        ops[len++] = (type == 'W') ? MCP_BATCH_WRITE : MCP_BATCH_WRITE_FIXED;
+        ops[len++] = addr >> 8;
+        ops[len++] = addr & 0xFF;
+        ops[len++] = n;
+        len += n;
+      }
+    } else if (type == 'R') {
+      unsigned long n = 1;
+      if (*p == ':') {
+        n = strtoul(p + 1, &end, 16);
+        if (end == p + 1) { err = "SYNTAX"; break; }
+        p = end;
+      }
+      if (n > 0xFF) { err = "BAD COUNT"; break; }
+      results += n;
+      ops[len++] = MCP_BATCH_READ;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+      ops[len++] = n;
+    } else if (type == 'P') {
+      if (*p != '&') { err = "SYNTAX"; break; }
+      uint8_t mask = strtoul(p + 1, &end, 16);
+      p = end;
+      if (*p != '=') { err = "SYNTAX"; break; }
+      uint8_t value = strtoul(p + 1, &end, 16);
+      p = end;
+      uint16_t timeout = MCP_POLL_TIMEOUT_MS;
+      if (*p == '@') {
+        timeout = strtoul(p + 1, &end, 16);
+        p = end;
+      }
+      results++;
+      ops[len++] = MCP_BATCH_POLL;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+      ops[len++] = mask;
+      ops[len++] = value;
+      ops[len++] = timeout >> 8;
+      ops[len++] = timeout & 0xFF;
+    } else if (type == 'D') {
+      ops[len++] = MCP_BATCH_DELAY;
+      ops[len++] = addr >> 8;
+      ops[len++] = addr & 0xFF;
+    } else {
+      err = "SYNTAX";
+      break;
+    }
+    
+    if (*p && *p != ' ' && *p != ';') { err = "SYNTAX"; break; }
+    if (len > sizeof(ops) - 8 || results > MCP_M_MAX) { err = "TOO LONG"; break; }
+    index++;
   }
   
-  // Block here until resumed via 'C' command
-  while (_atBreakpoint && _breakpointsEnabled) {
-    update();  // Process MCP commands while at breakpoint
-    delay(10);
+  if (err) {
+    _out.printf("ERR Q %02X %s\n", index, err);
+    return;
   }
   
-  _paused = false;
-  if (name) {
-    Serial.printf("[MCP] Continuing from breakpoint '%s'\n", name);
+  uint8_t out[MCP_M_MAX];
+  size_t outLen;
+  uint8_t done;
+  uint8_t status = runBatch(ops, len, out, sizeof(out), outLen, done);
+  if (status == MCP_ST_OK) {
+    _out.printf("OK Q %02X:", done);
   } else {
-    Serial.println("[MCP] Continuing from breakpoint");
+    _out.printf("ERR Q %02X %s:", done, status == MCP_ST_TIMEOUT ? "TIMEOUT" :
+                status == MCP_ST_BAD_OP ? "BAD OP" : "BAD LEN");
+  }
+  for (size_t i = 0; i < outLen; i++) {
+    _out.printf(" %02X", out[i]);
   }
+  _out.println();
 }
 
-inline void PapilioMCPClass::sendResponse(const char* response) {
-  Serial.println(response);
+inline uint16_t PapilioMCPClass::crc16(const uint8_t* data, size_t len, uint16_t crc) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+inline void PapilioMCPClass::streamDump(uint16_t addr, uint32_t total) {
+  static const char hex[] = "0123456789ABCDEF";
+  uint8_t data[MCP_STREAM_CHUNK];
+  char line[MCP_STREAM_CHUNK * 2 + 8];
+  uint16_t crc = 0xFFFF;
+  uint16_t seq = 0;
+  
+  for (uint32_t off = 0; off < total; seq++) {
+    uint32_t n = total - off;
+    if (n > MCP_STREAM_CHUNK) n = MCP_STREAM_CHUNK;
+    wishboneReadBurst(addr + off, data, n);
+    crc = crc16(data, n, crc);
+    
+    int pos = snprintf(line, sizeof(line), "X%04X ", seq);
+    for (uint32_t i = 0; i < n; i++) {
+      line[pos++] = hex[data[i] >> 4];
+      line[pos++] = hex[data[i] & 0x0F];
+    }
+    line[pos++] = '\n';
+    _out.write((const uint8_t*)line, pos);
+    off += n;
+  }
+  _out.printf("OK X %04X %04X CRC=%04X\n", addr, (unsigned)total, crc);
 }
 
-inline void PapilioMCPClass::processCommand(String cmd) {
-  cmd.trim();
-  if (cmd.length() == 0) return;
+inline void PapilioMCPClass::feedBinary(uint8_t c) {
+  if (_binPos == 0) _binStart = millis();
+  _binBuf[_binPos++] = c;
   
-  Serial.print("[MCP] ");
-  Serial.println(cmd);
+  if (_binPos == 2) {
+    // LEN must cover at least OP, ADDR_H, ADDR_L and COUNT
+    if (c < 4 || c > MCP_BIN_MAX_PAYLOAD + 4) {
+      _binPos = 0;
+      sendFrame(MCP_ST_BAD_LEN, 0, 0);
+    }
+    return;
+  }
   
-  char cmdType = cmd.charAt(0);
+  if (_binPos < 3 || _binPos < (uint16_t)_binBuf[1] + 3) return;
   
-  switch (cmdType) {
-    case 'W':
-    case 'w': {
-      if (cmd.length() >= 9) {
-        uint16_t addr = strtol(cmd.substring(2, 6).c_str(), NULL, 16);
-        uint8_t data = strtol(cmd.substring(7, 9).c_str(), NULL, 16);
-        wishboneWrite(addr, data);
-        Serial.printf("OK W %04X=%02X\n", addr, data);
-      } else {
-        sendResponse("ERR: W AAAA DD");
-      }
+  // Complete frame: SYNC LEN <LEN bytes> CRC
+  uint8_t len = _binBuf[1];
+  _binPos = 0;
+  if (crc8(&_binBuf[1], len + 1) != _binBuf[len + 2]) {
+    sendFrame(MCP_ST_BAD_CRC, 0, 0);
+    return;
+  }
+  uint16_t addr = ((uint16_t)_binBuf[3] << 8) | _binBuf[4];
+#if MCP_ENABLE_STATS
+  uint32_t start = esp_cpu_get_cycle_count();
+  processFrame(_binBuf[2], addr, _binBuf[5], &_binBuf[6], len - 4);
+  if (_binBuf[2] < MCP_STATS_OPS) {
+    statRecord(_statOp[_binBuf[2]], esp_cpu_get_cycle_count() - start);
+  }
+#else
+  processFrame(_binBuf[2], addr, _binBuf[5], &_binBuf[6], len - 4);
+#endif
+}
+
+// One ring write per frame, so frames from different contexts never interleave
+inline bool PapilioMCPClass::sendFrame(uint8_t status, uint16_t addr, uint8_t count,
+                                       const uint8_t* data, uint8_t len, bool dropIfFull) {
+  uint8_t frame[MCP_BIN_MAX_PAYLOAD + 7] = {
+    MCP_BIN_SYNC, (uint8_t)(len + 4), status,
+    (uint8_t)(addr >> 8), (uint8_t)(addr & 0xFF), count
+  };
+  if (len) memcpy(&frame[6], data, len);
+  frame[6 + len] = crc8(&frame[1], len + 5);
+  if (dropIfFull) return _out.tryWrite(frame, len + 7);
+  _out.write(frame, len + 7);
+  return true;
+}
+
+inline void PapilioMCPClass::processFrame(uint8_t op, uint16_t addr, uint8_t count,
+                                          const uint8_t* payload, uint8_t len) {
+  switch (op) {
+    case MCP_OP_PING: {
+      uint8_t info[2] = { MCP_BIN_VERSION, MCP_BIN_MAX_PAYLOAD };
+      sendFrame(MCP_ST_OK, addr, count, info, sizeof(info));
       break;
     }
     
-    case 'R':
-    case 'r': {
-      if (cmd.length() >= 6) {
-        uint16_t addr = strtol(cmd.substring(2, 6).c_str(), NULL, 16);
-        uint8_t data = wishboneRead(addr);
-        Serial.printf("OK R %04X=%02X\n", addr, data);
-      } else {
-        sendResponse("ERR: R AAAA");
+    case MCP_OP_READ:
+    case MCP_OP_READ_FIXED: {
+      if (count == 0 || count > MCP_BIN_MAX_PAYLOAD || len != 0) {
+        sendFrame(MCP_ST_BAD_LEN, addr, count);
+        break;
       }
+      uint8_t data[MCP_BIN_MAX_PAYLOAD];
+      wishboneReadBurst(addr, data, count,
+                        op == MCP_OP_READ_FIXED ? MCP_BURST_FIXED : MCP_BURST_INCREMENT);
+      sendFrame(MCP_ST_OK, addr, count, data, count);
       break;
     }
     
-    case 'M':
-    case 'm': {
-      if (cmd.length() >= 9) {
-        uint16_t addr = strtol(cmd.substring(2, 6).c_str(), NULL, 16);
-        uint8_t count = strtol(cmd.substring(7, 9).c_str(), NULL, 16);
-        if (count > 64) count = 64;
-        Serial.printf("OK M %04X:", addr);
-        for (int i = 0; i < count; i++) {
-          Serial.printf(" %02X", wishboneRead(addr + i));
-        }
-        Serial.println();
-      } else {
-        sendResponse("ERR: M AAAA NN");
+    case MCP_OP_WRITE:
+    case MCP_OP_WRITE_FIXED: {
+      if (count == 0 || len != count) {
+        sendFrame(MCP_ST_BAD_LEN, addr, count);
+        break;
       }
+      wishboneWriteBurst(addr, payload, count,
+                         op == MCP_OP_WRITE_FIXED ? MCP_BURST_FIXED : MCP_BURST_INCREMENT);
+      sendFrame(MCP_ST_OK, addr, count);
       break;
     }
     
-    case 'D':
-    case 'd': {
-      sendResponse("=== DEBUG DUMP ===");
-      Serial.printf("JTAG Bridge: %s\n", _jtagEnabled ? "ENABLED" : "disabled");
-      sendResponse("--- RGB LED (0x8100-0x8103) ---");
-      for (uint16_t i = 0x8100; i < 0x8104; i++) {
-        Serial.printf("  [%04X] = %02X\n", i, wishboneRead(i));
-      }
-      sendResponse("--- Video Mode ---");
-      Serial.printf("  Video mode: %d\n", wishboneRead(0x8010) & 0x07);
-      sendResponse("=== END DUMP ===");
+#if MCP_ENABLE_TELEMETRY
+    case MCP_OP_SUBSCRIBE: {
+      if (len == 0) {
+        unsubscribe();
+        sendFrame(MCP_ST_OK, addr, count);
+        sendTelemetry();
+        break;
+      }
+      uint8_t n = (len - 4) / 2;
+      if (len < 6 || (len & 1) || n > MCP_SUB_MAX_ADDRS) {
+        sendFrame(MCP_ST_BAD_LEN, addr, count);
+        break;
+      }
+      uint32_t periodUs = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) |
+                          ((uint32_t)payload[2] << 8) | payload[3];
+      uint16_t addrs[MCP_SUB_MAX_ADDRS];
+      for (uint8_t i = 0; i < n; i++) {
+        addrs[i] = (payload[4 + i * 2] << 8) | payload[5 + i * 2];
+      }
+      // Acknowledge first so the reply precedes the first record
+      sendFrame(periodUs >= MCP_SUB_MIN_PERIOD_US ? MCP_ST_OK : MCP_ST_BAD_LEN, addr, n);
+      if (periodUs >= MCP_SUB_MIN_PERIOD_US) subscribe(addrs, n, periodUs);
       break;
     }
+#endif
     
-    case 'J':
-    case 'j': {
-      if (cmd.length() >= 3) {
-        char action = cmd.charAt(2);
-        if (action == '1') enableJTAG();
-        else if (action == '0') disableJTAG();
-        else Serial.printf("JTAG: %s\n", _jtagEnabled ? "ENABLED" : "disabled");
-      } else {
-        Serial.printf("JTAG: %s\n", _jtagEnabled ? "ENABLED" : "disabled");
+    case MCP_OP_POLL: {
+      if (len != 8) {
+        sendFrame(MCP_ST_BAD_LEN, addr, count);
+        break;
       }
+      uint32_t timeoutUs = ((uint32_t)payload[2] << 24) | ((uint32_t)payload[3] << 16) |
+                           ((uint32_t)payload[4] << 8) | payload[5];
+      uint16_t intervalUs = (payload[6] << 8) | payload[7];
+      awaitBegin(addr, payload[0], payload[1], timeoutUs, intervalUs, true, count);
       break;
     }
     
-    case 'P':
-    case 'p': {
-      if (cmd.length() >= 3) {
-        char action = cmd.charAt(2);
-        if (action == '1') pause();
-        else if (action == '0') resume();
-        else Serial.printf("Sketch: %s\n", _paused ? "PAUSED" : "running");
-      } else {
-        // Toggle if no argument
-        if (_paused) resume();
-        else pause();
-      }
+    case MCP_OP_BATCH: {
+      uint8_t out[MCP_BIN_MAX_PAYLOAD];
+      size_t outLen;
+      uint8_t done;
+      uint8_t status = runBatch(payload, len, out, sizeof(out), outLen, done);
+      sendFrame(status, addr, done, out, outLen);
       break;
     }
-    
-    case 'C':
-    case 'c': {
-      // Continue from breakpoint
-      if (_atBreakpoint) {
-        _atBreakpoint = false;
-        // resume() will be called when breakpoint() exits its loop
-      } else if (_paused) {
-        resume();
-      } else {
-        sendResponse("OK: Not at breakpoint");
+#if MCP_ENABLE_JTAG_PROG
+    case MCP_OP_JTAG:
+      jtagFrame(addr, count, payload, len);
+      break;
+    case MCP_OP_JTAG_DATA:
+      jtagData(addr, count, payload, len);
+      break;
+#endif
+#if MCP_ENABLE_EVENTS
+    case MCP_OP_EVENTS: {
+      if (len != 0) {
+        sendFrame(MCP_ST_BAD_LEN, addr, count);
+        break;
       }
+      _eventMask = count & MCP_EVENT_ALL;
+      uint8_t flags = (_paused ? MCP_STATE_PAUSED : 0) |
+                      (_atBreakpoint ? MCP_STATE_BREAKPOINT : 0) |
+                      (_breakpointsEnabled ? MCP_STATE_BP_ENABLED : 0);
+      uint8_t state[4] = { flags, jtagState(),
+                           (uint8_t)(_breakpointCount >> 8), (uint8_t)_breakpointCount };
+      sendFrame(MCP_ST_OK, addr, _eventMask, state, sizeof(state));
       break;
     }
+#endif
     
-    case 'B':
-    case 'b': {
-      if (cmd.length() >= 3) {
-        char action = cmd.charAt(2);
-        if (action == '1') {
-          _breakpointsEnabled = true;
-          Serial.println("[MCP] Breakpoints ENABLED");
-        } else if (action == '0') {
-          _breakpointsEnabled = false;
-          _atBreakpoint = false;  // Release any current breakpoint
-          Serial.println("[MCP] Breakpoints DISABLED - all breakpoints will be skipped");
+    default:
+      sendFrame(MCP_ST_BAD_OP, addr, count);
+      break;
+  }
+}
+
+// Split line into space-separated tokens in place (no allocation)
+inline uint8_t PapilioMCPClass::tokenize(char* line, char** argv, uint8_t maxArgs) {
+  uint8_t argc = 0;
+  while (*line && argc < maxArgs) {
+    while (*line == ' ' || *line == '\t') *line++ = '\0';
+    if (!*line) break;
+    argv[argc++] = line;
+    while (*line && *line != ' ' && *line != '\t') line++;
+  }
+  return argc;
+}
+
+// Parse a whole token as hex (1-8 digits); false on anything else
+inline bool PapilioMCPClass::parseHex(const char* token, uint32_t& value) {
+  uint8_t digits = 0;
+  value = 0;
+  for (; *token; token++, digits++) {
+    char c = *token;
+    uint8_t nibble;
+    if (c >= '0' && c <= '9') nibble = c - '0';
+    else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    if (digits == 8) return false;
+    value = (value << 4) | nibble;
+  }
+  return digits > 0;
+}
+
+// Walks the MCP_COMMANDS entries; every step is a compile-time constant
+// compare, so the chain folds into the same code as a switch
+template <typename Command, typename... Rest>
+struct McpDispatch<Command, Rest...> {
+  static bool run(PapilioMCPClass& mcp, char letter, char* line) {
+    if (letter != Command::letter) return McpDispatch<Rest...>::run(mcp, letter, line);
+    McpArgs args;
+    mcp.parseArgs(line, args, Command::raw);
+#if MCP_ENABLE_STATS
+    uint32_t start = esp_cpu_get_cycle_count();
+    Command::call(mcp, args);
+    // Letters index the table; '?' is the only other entry and is H
+    uint8_t slot = letter >= 'A' && letter <= 'Z' ? letter - 'A' : 'H' - 'A';
+    PapilioMCPClass::statRecord(mcp._statCmd[slot], esp_cpu_get_cycle_count() - start);
+#else
+    Command::call(mcp, args);
+#endif
+    return true;
+  }
+};
+
+template <typename... Rest>
+struct McpDispatch<McpCommandEnd, Rest...> {
+  static bool run(PapilioMCPClass& mcp, char letter, char* line) { return false; }
+};
+
+inline void PapilioMCPClass::parseArgs(char* line, McpArgs& args, bool raw) {
+  args.rest = line + 1;
+  args.argc = raw ? 0 : tokenize(line, args.argv, MCP_CMD_MAX_ARGS);
+  args.arg1 = args.arg2 = 0;
+  args.has1 = args.argc >= 2 && parseHex(args.argv[1], args.arg1);
+  args.has2 = args.argc >= 3 && parseHex(args.argv[2], args.arg2);
+  args.action = args.argc >= 2 ? args.argv[1][0] : '\0';
+}
+
+inline void PapilioMCPClass::processCommand(char* cmd) {
+  // Trim in place
+  while (*cmd == ' ' || *cmd == '\t') cmd++;
+  size_t len = strlen(cmd);
+  while (len && (cmd[len - 1] == ' ' || cmd[len - 1] == '\t')) cmd[--len] = '\0';
+  if (len == 0) return;
+  
+  // "#II cmd": tagged reply, no echo
+  bool tagged = *cmd == '#';
+  if (tagged) {
+    uint8_t tagLen = 1;
+    while (tagLen <= MCP_TAG_DIGITS && isxdigit((unsigned char)cmd[tagLen])) tagLen++;
+    if (tagLen == 1 || (cmd[tagLen] && cmd[tagLen] != ' ')) {
+      sendResponse("ERR: Tag is #II (1-4 hex digits) before the command");
+      return;
+    }
+    _out.beginTag(cmd, tagLen);
+    cmd += tagLen;
+    while (*cmd == ' ') cmd++;
+  } else {
+    _out.print("[MCP] ");
+    _out.println(cmd);
+  }
+  
+#define MCP_CMD_TYPE(letter, handler, raw, help) \
+  McpCommand<letter, &PapilioMCPClass::handler, raw>,
+  typedef McpDispatch<MCP_COMMANDS(MCP_CMD_TYPE) McpCommandEnd> Dispatch;
+#undef MCP_CMD_TYPE
+  
+  if (*cmd && !Dispatch::run(*this, toupper(cmd[0]), cmd)) {
+    sendResponse("ERR: Unknown command (H for help)");
+  }
+  if (tagged) {
+    if (_awaitPending) _await.tagLen = _out.suspendTag();
+    else _out.endTag();
+  }
+}
+
+inline void PapilioMCPClass::cmdWrite(McpArgs& a) {
+  if (a.has1 && a.has2) {
+    uint16_t addr = a.arg1;
+    uint8_t data = a.arg2;
+    wishboneWrite(addr, data);
+    _out.printf("OK W %04X=%02X\n", addr, data);
+  } else {
+    sendResponse("ERR: W AAAA DD");
+  }
+}
+
+inline void PapilioMCPClass::cmdRead(McpArgs& a) {
+  if (a.has1) {
+    uint16_t addr = a.arg1;
+    uint8_t data = wishboneRead(addr);
+    _out.printf("OK R %04X=%02X\n", addr, data);
+  } else {
+    sendResponse("ERR: R AAAA");
+  }
+}
+
+inline void PapilioMCPClass::cmdMulti(McpArgs& a) {
+  if (a.has1 && a.has2) {
+    uint16_t addr = a.arg1;
+    uint16_t count = a.arg2 > MCP_M_MAX ? MCP_M_MAX : a.arg2;
+    uint8_t data[MCP_M_MAX];
+    wishboneReadBurst(addr, data, count);
+    _out.printf("OK M %04X:", addr);
+    for (int i = 0; i < count; i++) {
+      _out.printf(" %02X", data[i]);
+    }
+    _out.println();
+  } else {
+    sendResponse("ERR: M AAAA NN");
+  }
+}
+
+inline void PapilioMCPClass::cmdStream(McpArgs& a) {
+  if (a.has1 && a.has2 && a.arg2 <= 0xFFFF) {
+    streamDump(a.arg1, a.arg2);
+  } else {
+    sendResponse("ERR: X AAAA LLLL");
+  }
+}
+
+#if MCP_ENABLE_LA
+// L [NNNN]
+inline void PapilioMCPClass::cmdLogic(McpArgs& a) {
+  uint32_t count = a.has1 ? a.arg1 : MCP_LA_DEPTH;
+  if (a.argc > 2 || (a.argc == 2 && !a.has1) || count == 0 || count > MCP_LA_DEPTH) {
+    sendResponse("ERR: L [NNNN]");
+    return;
+  }
+  uint8_t status = wishboneRead(MCP_LA_BASE);
+  if (!(status & MCP_LA_STATUS_DONE)) {
+    _out.printf("ERR L NOT DONE %02X\n", status);
+    return;
+  }
+  
+  uint8_t raw[MCP_STREAM_CHUNK & ~3];
+  char line[MCP_LA_LINE + 24];
+  uint16_t seq = 0;
+  int pos = snprintf(line, sizeof(line), "L%04X", seq);
+  uint16_t crc = 0xFFFF;
+  uint32_t records = 0, last = 0, value = 0, run = 0;
+  
+  for (uint32_t i = 0; i < count; ) {
+    uint32_t n = count - i;
+    if (n > sizeof(raw) / 4) n = sizeof(raw) / 4;
+    wishboneReadBurst(MCP_LA_BASE + MCP_LA_DATA + i * 4, raw, n * 4);
+    crc = crc16(raw, n * 4, crc);
+    for (uint32_t k = 0; k < n * 4; k += 4) {
+      uint32_t v = raw[k] | (uint32_t)raw[k + 1] << 8 | (uint32_t)raw[k + 2] << 16 |
+                   (uint32_t)raw[k + 3] << 24;
+      if (run && v == value) {
+        run++;
+        continue;
+      }
+      if (run) {
+        laRecord(line, pos, seq, value, records++ ? value ^ last : 0xFFFFFFFF, run);
+        last = value;
+      }
+      value = v;
+      run = 1;
+    }
+    i += n;
+  }
+  laRecord(line, pos, seq, value, records++ ? value ^ last : 0xFFFFFFFF, run);
+  line[pos++] = '\n';
+  _out.write((const uint8_t*)line, pos);
+  _out.printf("OK L %04X %04X CRC=%04X\n", (unsigned)count, (unsigned)records, crc);
+}
+
+// Appends one " M<bytes>[*run]" record; changed has a bit set in every byte
+// that differs from the previous record. Full lines go out first.
+inline void PapilioMCPClass::laRecord(char* line, int& pos, uint16_t& seq, uint32_t value,
+                                      uint32_t changed, uint32_t run) {
+  static const char hex[] = "0123456789ABCDEF";
+  if (pos >= MCP_LA_LINE) {
+    line[pos++] = '\n';
+    _out.write((const uint8_t*)line, pos);
+    pos = snprintf(line, 8, "L%04X", ++seq);
+  }
+  uint8_t mask = 0;
+  for (uint8_t b = 0; b < 4; b++) {
+    if ((changed >> (8 * b)) & 0xFF) mask |= 1 << b;
+  }
+  line[pos++] = ' ';
+  line[pos++] = hex[mask];
+  for (int b = 3; b >= 0; b--) {
+    if (mask & (1 << b)) {
+      uint8_t b8 = value >> (8 * b);
+      line[pos++] = hex[b8 >> 4];
+      line[pos++] = hex[b8 & 0x0F];
+    }
+  }
+  if (run > 1) pos += snprintf(&line[pos], 11, "*%lX", (unsigned long)run);
+}
+#endif
+
+// A AAAA MM VV [TTTTTTTT [IIII]]
+inline void PapilioMCPClass::cmdAwait(McpArgs& a) {
+  uint32_t value, timeoutUs = MCP_AWAIT_TIMEOUT_US, intervalUs = 0;
+  if (a.has1 && a.has2 && a.argc >= 4 && parseHex(a.argv[3], value) &&
+      (a.argc < 5 || parseHex(a.argv[4], timeoutUs)) &&
+      (a.argc < 6 || parseHex(a.argv[5], intervalUs))) {
+    awaitBegin(a.arg1, a.arg2, value, timeoutUs, intervalUs, false, 0);
+  } else {
+    sendResponse("ERR: A AAAA MM VV [TTTTTTTT [IIII]]");
+  }
+}
+
+// With the service task the wait simply blocks it. Under update() it would
+// block loop() too, and with it any bus traffic the wait is for, so a long
+// wait runs one MCP_AWAIT_SLICE_US step per service pass instead.
+inline void PapilioMCPClass::awaitBegin(uint16_t address, uint8_t mask, uint8_t value,
+                                        uint32_t timeoutUs, uint32_t intervalUs,
+                                        bool binary, uint8_t count) {
+  McpAwait& w = _await;
+  w.address = address;
+  w.mask = mask;
+  w.value = value;
+  w.timeoutUs = timeoutUs;
+  w.intervalUs = intervalUs;
+  w.startUs = micros();
+  w.binary = binary;
+  w.count = count;
+  w.tagLen = 0;
+  if (_task || timeoutUs <= MCP_AWAIT_SLICE_US) {
+    uint32_t elapsed;
+    bool ok = wishbonePollUs(address, mask, w.value, timeoutUs, intervalUs, &w.last, &elapsed);
+    awaitReply(ok, elapsed);
+    return;
+  }
+  _awaitPending = true;
+  w.readUs = w.startUs - intervalUs;   // First read right away
+  awaitStep();
+}
+
+// Reads until the slice is used up or the next read is not due yet
+inline void PapilioMCPClass::awaitStep() {
+  McpAwait& w = _await;
+  unsigned long slice = micros();
+  do {
+    if (micros() - w.readUs < w.intervalUs) return;
+    w.readUs = micros();
+    {
+      McpBusLock lock(_bus, busClass());
+      rawRead(w.address, &w.last, 1, MCP_BURST_INCREMENT);
+    }
+    uint32_t elapsed = micros() - w.startUs;
+    bool ok = (w.last & w.mask) == w.value;
+    if (ok || elapsed >= w.timeoutUs) {
+      _awaitPending = false;
+      awaitReply(ok, elapsed);
+      return;
+    }
+  } while (micros() - slice < MCP_AWAIT_SLICE_US);
+}
+
+inline void PapilioMCPClass::awaitReply(bool ok, uint32_t elapsed) {
+  const McpAwait& w = _await;
+  if (w.binary) {
+    uint8_t out[5] = { w.last, (uint8_t)(elapsed >> 24), (uint8_t)(elapsed >> 16),
+                       (uint8_t)(elapsed >> 8), (uint8_t)elapsed };
+    sendFrame(ok ? MCP_ST_OK : MCP_ST_TIMEOUT, w.address, w.count, out, sizeof(out));
+    return;
+  }
+  if (w.tagLen) _out.resumeTag(w.tagLen);
+  _out.printf("%s A %04X=%02X %s%luus\n", ok ? "OK" : "ERR", (unsigned)w.address, w.last,
+              ok ? "in " : "TIMEOUT after ", (unsigned long)elapsed);
+  if (w.tagLen) _out.endTag();
+}
+
+#if MCP_ENABLE_SNAPSHOT
+// CRC of the range list, stored with persisted blobs
+inline uint16_t PapilioMCPClass::snapLayout() {
+  uint16_t crc = 0xFFFF;
+  for (const McpRegRange& r : McpMaps<>::snapshot) {
+    uint8_t entry[4] = { (uint8_t)(r.start >> 8), (uint8_t)r.start,
+                         (uint8_t)(r.len >> 8), (uint8_t)r.len };
+    crc = crc16(entry, sizeof(entry), crc);
+  }
+  return crc;
+}
+
+inline bool PapilioMCPClass::snapshotSave(uint8_t slot) {
+  if (slot >= MCP_SNAPSHOT_SLOTS) return false;
+  uint8_t* p = _snapData[slot];
+  for (const McpRegRange& r : McpMaps<>::snapshot) {
+    for (uint32_t done = 0; done < r.len; ) {
+      uint16_t n = r.len - done > MCP_M_MAX ? MCP_M_MAX : r.len - done;
+      wishboneReadBurst(r.start + done, p, n);
+      p += n;
+      done += n;
+    }
+  }
+  _snapCrc[slot] = crc16(_snapData[slot], MCP_SNAP_BYTES);
+  _snapValid[slot] = true;
+  _snapFill[slot] = 0;
+  return true;
+}
+
+inline bool PapilioMCPClass::snapshotRestore(uint8_t slot) {
+  if (slot >= MCP_SNAPSHOT_SLOTS || !_snapValid[slot]) return false;
+  const uint8_t* p = _snapData[slot];
+  for (const McpRegRange& r : McpMaps<>::snapshot) {
+    for (uint32_t done = 0; done < r.len; ) {
+      uint16_t n = r.len - done > MCP_M_MAX ? MCP_M_MAX : r.len - done;
+      wishboneWriteBurst(r.start + done, p, n);
+      p += n;
+      done += n;
+    }
+  }
+  return true;
+}
+
+#if MCP_SNAPSHOT_NVS
+inline bool PapilioMCPClass::snapshotPersist(uint8_t slot) {
+  if (slot >= MCP_SNAPSHOT_SLOTS || !_snapValid[slot]) return false;
+  char key[8], layoutKey[8];
+  snprintf(key, sizeof(key), "snap%u", slot);
+  snprintf(layoutKey, sizeof(layoutKey), "snap%uL", slot);
+  uint16_t layout = snapLayout();
+  Preferences prefs;
+  if (!prefs.begin(MCP_SNAP_NVS_NAME, false)) return false;
+  bool ok = prefs.putUShort(layoutKey, layout) == sizeof(layout) &&
+            prefs.putBytes(key, _snapData[slot], MCP_SNAP_BYTES) == MCP_SNAP_BYTES;
+  prefs.end();
+  return ok;
+}
+
+inline bool PapilioMCPClass::snapshotLoad(uint8_t slot) {
+  if (slot >= MCP_SNAPSHOT_SLOTS) return false;
+  char key[8], layoutKey[8];
+  snprintf(key, sizeof(key), "snap%u", slot);
+  snprintf(layoutKey, sizeof(layoutKey), "snap%uL", slot);
+  Preferences prefs;
+  if (!prefs.begin(MCP_SNAP_NVS_NAME, true)) return false;
+  bool ok = prefs.getUShort(layoutKey, 0) == snapLayout() &&
+            prefs.getBytesLength(key) == MCP_SNAP_BYTES &&
+            prefs.getBytes(key, _snapData[slot], MCP_SNAP_BYTES) == MCP_SNAP_BYTES;
+  prefs.end();
+  if (ok) _snapCrc[slot] = crc16(_snapData[slot], MCP_SNAP_BYTES);
+  _snapValid[slot] = ok;
+  _snapFill[slot] = 0;
+  return ok;
+}
+#else
+inline bool PapilioMCPClass::snapshotPersist(uint8_t slot) { return false; }
+inline bool PapilioMCPClass::snapshotLoad(uint8_t slot) { return false; }
+#endif
+
+// N | N S|R|P|L|D [n] | N W n OOOO HH..
+inline void PapilioMCPClass::cmdSnapshot(McpArgs& a) {
+  uint32_t slot = 0, offset = 0;
+  bool slotOk = a.argc < 3 || parseHex(a.argv[2], slot);
+  char action = a.argc >= 2 && !a.argv[1][1] ? a.action : '\0';
+  
+  if (a.argc == 1) {
+    for (uint8_t i = 0; i < MCP_SNAPSHOT_SLOTS; i++) {
+      if (_snapValid[i]) _out.printf("N %u VALID CRC=%04X\n", i, _snapCrc[i]);
+      else _out.printf("N %u EMPTY\n", i);
+    }
+    for (const McpRegRange& r : McpMaps<>::snapshot) {
+      _out.printf("N RANGE %s %04X %04X\n", r.name, r.start, r.len);
+    }
+    _out.printf("OK N %u SLOTS %04X BYTES LAYOUT=%04X\n", MCP_SNAPSHOT_SLOTS,
+                (unsigned)MCP_SNAP_BYTES, snapLayout());
+    return;
+  }
+  if (!slotOk || slot >= MCP_SNAPSHOT_SLOTS || (action != 'W' && a.argc > 3)) {
+    sendResponse("ERR: N [S|R|P|L|D [n] | W n OOOO HH..]");
+    return;
+  }
+  
+  switch (action) {
+    case 'S':
+      snapshotSave(slot);
+      _out.printf("OK N S %u %04X CRC=%04X\n", (unsigned)slot, (unsigned)MCP_SNAP_BYTES,
+                  _snapCrc[slot]);
+      break;
+    case 'R':
+      if (snapshotRestore(slot)) _out.printf("OK N R %u %04X\n", (unsigned)slot, (unsigned)MCP_SNAP_BYTES);
+      else _out.printf("ERR N R %u EMPTY\n", (unsigned)slot);
+      break;
+    case 'P':
+      if (!_snapValid[slot]) _out.printf("ERR N P %u EMPTY\n", (unsigned)slot);
+      else if (snapshotPersist(slot)) _out.printf("OK N P %u\n", (unsigned)slot);
+      else _out.printf("ERR N P %u NVS\n", (unsigned)slot);
+      break;
+    case 'L':
+      if (snapshotLoad(slot)) _out.printf("OK N L %u CRC=%04X\n", (unsigned)slot, _snapCrc[slot]);
+      else _out.printf("ERR N L %u MISSING\n", (unsigned)slot);
+      break;
+    case 'D': {
+      if (!_snapValid[slot]) {
+        _out.printf("ERR N D %u EMPTY\n", (unsigned)slot);
+        break;
+      }
+      static const char hex[] = "0123456789ABCDEF";
+      char line[MCP_SNAP_LINE * 2 + 8];
+      for (size_t off = 0; off < MCP_SNAP_BYTES; off += MCP_SNAP_LINE) {
+        int pos = snprintf(line, sizeof(line), "N %04X ", (unsigned)off);
+        for (size_t i = off; i < MCP_SNAP_BYTES && i < off + MCP_SNAP_LINE; i++) {
+          line[pos++] = hex[_snapData[slot][i] >> 4];
+          line[pos++] = hex[_snapData[slot][i] & 0x0F];
         }
-      } else {
-        Serial.printf("Breakpoints: %s (hit %d times)\n", 
-                      _breakpointsEnabled ? "ENABLED" : "disabled",
-                      _breakpointCount);
+        line[pos++] = '\n';
+        _out.write((const uint8_t*)line, pos);
       }
+      _out.printf("OK N D %u %04X CRC=%04X\n", (unsigned)slot, (unsigned)MCP_SNAP_BYTES,
+                  _snapCrc[slot]);
       break;
     }
-    
-    case 'H':
-    case 'h':
-    case '?': {
-      sendResponse("=== PAPILIO MCP DEBUG ===");
-      sendResponse("W AAAA DD  - Write DD to addr AAAA");
-      sendResponse("R AAAA     - Read from addr AAAA");
-      sendResponse("M AAAA NN  - Read NN bytes from AAAA");
-      sendResponse("D          - Dump debug registers");
-      sendResponse("J [1|0]    - Enable/disable JTAG");
-      sendResponse("P [1|0]    - Pause/resume sketch");
-      sendResponse("C          - Continue from breakpoint");
-      sendResponse("B [1|0]    - Enable/disable breakpoints");
-      sendResponse("H          - This help");
-      Serial.printf("Status: Sketch %s, JTAG %s, Breakpoints %s\n", 
-                    _paused ? "PAUSED" : "running",
-                    _jtagEnabled ? "ENABLED" : "disabled",
-                    _breakpointsEnabled ? "ENABLED" : "disabled");
+    case 'W': {
+      const char* hexBytes = a.argc == 5 ? a.argv[4] : "";
+      size_t n = strlen(hexBytes) / 2;
+      bool ok = a.argc == 5 && parseHex(a.argv[3], offset) && strlen(hexBytes) % 2 == 0 &&
+                n > 0 && offset + n <= MCP_SNAP_BYTES;
+      for (size_t i = 0; ok && i < 2 * n; i++) ok = isxdigit((unsigned char)hexBytes[i]);
+      // Chunks go in order from offset 0, which starts a new upload. The
+      // slot stays invalid until the last byte is in; any error drops it.
+      if (ok && offset == 0) _snapFill[slot] = 0;
+      if (!ok || offset != _snapFill[slot]) {
+        _snapValid[slot] = false;
+        _snapFill[slot] = 0;
+        if (ok) _out.printf("ERR N W %u %04X ORDER\n", (unsigned)slot, (unsigned)offset);
+        else sendResponse("ERR: N W n OOOO HH..");
+        break;
+      }
+      _snapValid[slot] = false;
+      for (size_t i = 0; i < n; i++) {
+        char pair[3] = { hexBytes[2 * i], hexBytes[2 * i + 1], '\0' };
+        uint32_t v;
+        parseHex(pair, v);
+        _snapData[slot][offset + i] = v;
+      }
+      _snapFill[slot] = offset + n;
+      if (_snapFill[slot] < MCP_SNAP_BYTES) {
+        _out.printf("OK N W %u %04X %04X\n", (unsigned)slot, (unsigned)offset, (unsigned)n);
+        break;
+      }
+      // Complete: the host checks this CRC against the one it saved
+      _snapCrc[slot] = crc16(_snapData[slot], MCP_SNAP_BYTES);
+      _snapValid[slot] = true;
+      _snapFill[slot] = 0;
+      _out.printf("OK N W %u %04X %04X CRC=%04X\n", (unsigned)slot, (unsigned)offset,
+                  (unsigned)n, _snapCrc[slot]);
       break;
     }
-    
     default:
-      sendResponse("ERR: Unknown command (H for help)");
+      sendResponse("ERR: N [S|R|P|L|D [n] | W n OOOO HH..]");
       break;
   }
 }
+#endif
+
+// One burst per MCP_REGISTER_MAP range, 16 bytes per output line
+inline void PapilioMCPClass::cmdDump(McpArgs& a) {
+  sendResponse("=== DEBUG DUMP ===");
+  _out.printf("JTAG Bridge: %s\n", _jtagEnabled ? "ENABLED" : "disabled");
+  for (const McpRegRange& r : McpMaps<>::registers) {
+    _out.printf("--- %s (0x%04X-0x%04X) ---\n", r.name, r.start, r.start + r.len - 1);
+    uint8_t data[MCP_M_MAX];
+    for (uint32_t done = 0; done < r.len; ) {
+      uint16_t n = r.len - done > MCP_M_MAX ? MCP_M_MAX : r.len - done;
+      wishboneReadBurst(r.start + done, data, n);
+      for (uint16_t i = 0; i < n; i += 16) {
+        _out.printf("  [%04X] =", (unsigned)(r.start + done + i));
+        for (uint16_t j = i; j < n && j < i + 16; j++) _out.printf(" %02X", data[j]);
+        _out.println();
+      }
+      done += n;
+    }
+  }
+  sendResponse("=== END DUMP ===");
+}
+
+// T | T AAAA [NN [SSSS]] | T S HHHHHHHH WWWW
+inline void PapilioMCPClass::cmdTiming(McpArgs& a) {
+  uint32_t len = 4, scratch = 0, hz, wait;
+  if (a.argc == 4 && toupper(a.action) == 'S' && !a.argv[1][1] &&
+      parseHex(a.argv[2], hz) && parseHex(a.argv[3], wait) && hz && wait <= 0xFFFF) {
+    setSPITiming(hz, wait, false);
+  } else if (a.argc >= 2 && a.argc <= 4 && a.has1 && a.arg1 <= 0xFFFF &&
+             (a.argc < 3 || (a.has2 && a.arg2 >= 1 && a.arg2 <= MCP_CAL_MAX_ID)) &&
+             (a.argc < 4 || (parseHex(a.argv[3], scratch) && scratch <= 0xFFFF))) {
+    if (a.argc >= 3) len = a.arg2;
+    if (!calibrateSPI(a.arg1, len, a.argc == 4 ? (int32_t)scratch : -1)) return;
+  } else if (a.argc != 1) {
+    sendResponse("ERR: T [AAAA [NN [SSSS]]] | T S HHHHHHHH WWWW");
+    return;
+  }
+  _out.printf("OK T %luHz WAIT=%uns READY=%u TIMEOUTS=%lu\n", (unsigned long)_spiHz,
+              _readWaitNs, _readyByte, (unsigned long)_readyTimeouts);
+}
+
+inline void PapilioMCPClass::cmdJtag(McpArgs& a) {
+  if (isJTAGProgramming()) sendResponse("ERR J PROGRAMMING");
+  else if (a.action == '1') enableJTAG();
+  else if (a.action == '0') disableJTAG();
+  else _out.printf("JTAG: %s\n", _jtagEnabled ? "ENABLED" : "disabled");
+}
+
+inline void PapilioMCPClass::cmdPause(McpArgs& a) {
+  if (a.argc >= 2) {
+    if (a.action == '1') pause();
+    else if (a.action == '0') resume();
+    else _out.printf("Sketch: %s\n", _paused ? "PAUSED" : "running");
+  } else {
+    // Toggle if no argument
+    if (_paused) resume();
+    else pause();
+  }
+}
+
+// Continue from breakpoint
+inline void PapilioMCPClass::cmdContinue(McpArgs& a) {
+  if (_atBreakpoint) {
+    releaseBreakpoint();
+    sendResponse("OK C");  // The sketch prints "Continuing" once it runs again
+  } else if (_paused) {
+    resume();
+  } else {
+    sendResponse("OK: Not at breakpoint");
+  }
+}
+
+inline void PapilioMCPClass::printSite(const char* prefix, const McpBreakSite& site) {
+  _out.printf("%sB %02X %s %s hits=%lu after=%lu", prefix, site.id,
+              site.name ? site.name : "-", site.enabled ? "EN" : "OFF",
+              (unsigned long)site.hits, (unsigned long)site.after);
+  if (site.condMask) {
+    _out.printf(" if %04X&%02X==%02X", site.condAddr, site.condMask, site.condValue);
+  }
+  _out.println();
+}
+
+// B | B 1|0 | B II 1|0|R | B II N NNNNNNNN | B II C [AAAA MM VV]
+inline void PapilioMCPClass::cmdBreakpoints(McpArgs& a) {
+  if (a.argc == 1) {
+    for (uint8_t i = 0; i < _bpCount; i++) printSite("", *_bpSites[i]);
+    _out.printf("OK B %s, hit %d times, %u sites\n", _breakpointsEnabled ? "ENABLED" : "disabled",
+                _breakpointCount, _bpCount);
+    return;
+  }
+  if (a.argc == 2 && (a.action == '1' || a.action == '0') && !a.argv[1][1]) {
+    if (a.action == '1') {
+      setBreakpointsEnabled(true);
+      _out.println("[MCP] Breakpoints ENABLED");
+    } else {
+      setBreakpointsEnabled(false);
+      releaseBreakpoint();  // Release any current breakpoint
+      _out.println("[MCP] Breakpoints DISABLED - all breakpoints will be skipped");
+    }
+    return;
+  }
+  
+  McpBreakSite* site = a.has1 && a.arg1 >= 1 && a.arg1 <= _bpCount ? _bpSites[a.arg1 - 1] : nullptr;
+  char op = a.argc >= 3 && !a.argv[2][1] ? toupper(a.argv[2][0]) : '\0';
+  uint32_t n, addr, mask, value;
+  bool ok = site != nullptr;
+  if (!ok) {
+    // Fall through to the error
+  } else if (a.argc == 3 && (op == '1' || op == '0')) {
+    site->enabled = op == '1';
+    setBreakpointsEnabled(_breakpointsEnabled);   // Re-arm
+  } else if (a.argc == 3 && op == 'R') {
+    site->hits = 0;
+  } else if (a.argc == 4 && op == 'N' && parseHex(a.argv[3], n)) {
+    site->after = n;
+  } else if (a.argc == 3 && op == 'C') {
+    site->condMask = 0;
+  } else if (a.argc == 6 && op == 'C' && parseHex(a.argv[3], addr) && addr <= 0xFFFF &&
+             parseHex(a.argv[4], mask) && mask && mask <= 0xFF &&
+             parseHex(a.argv[5], value) && value <= 0xFF) {
+    // Mask last: the sketch only looks at the condition once it is non-zero
+    site->condAddr = addr;
+    site->condValue = value & mask;
+    site->condMask = mask;
+  } else {
+    ok = false;
+  }
+  if (ok) {
+    printSite("OK ", *site);
+  } else {
+    sendResponse("ERR: B [1|0] | B II 1|0|R | B II N NNNNNNNN | B II C [AAAA MM VV]");
+  }
+}
+
+// Lists exactly the commands compiled into MCP_COMMANDS
+inline void PapilioMCPClass::cmdHelp(McpArgs& a) {
+#define MCP_CMD_HELP(letter, handler, raw, help) help,
+  static const char* const lines[] = { MCP_COMMANDS(MCP_CMD_HELP) };
+#undef MCP_CMD_HELP
+  sendResponse("=== PAPILIO MCP DEBUG ===");
+  for (const char* line : lines) {
+    if (line) sendResponse(line);
+  }
+  sendResponse("(0xA5 starts a binary frame - see PapilioMCP.h)");
+  _out.printf("Status: Sketch %s, JTAG %s, Breakpoints %s\n", 
+                _paused ? "PAUSED" : "running",
+                _jtagEnabled ? "ENABLED" : "disabled",
+                _breakpointsEnabled ? "ENABLED" : "disabled");
+}
+
+#if MCP_ENABLE_STATS
+inline void PapilioMCPClass::resetStats() {
+  memset(_statCmd, 0, sizeof(_statCmd));
+  memset(_statOp, 0, sizeof(_statOp));
+  _statBytesIn = 0;
+  _out.bytes = 0;
+  _out.dropped = 0;
+  memset(_statSpiCount, 0, sizeof(_statSpiCount));
+  memset(_statSpiBytes, 0, sizeof(_statSpiBytes));
+  _statSince = millis();
+}
+
+inline void PapilioMCPClass::statRecord(McpCmdStats& st, uint32_t cycles) {
+  int bucket = (31 - __builtin_clz(cycles | 1)) - MCP_STATS_LOG2_MIN;
+  if (bucket < 0) bucket = 0;
+  if (bucket >= MCP_STATS_BUCKETS) bucket = MCP_STATS_BUCKETS - 1;
+  st.count++;
+  st.totalCycles += cycles;
+  if (cycles > st.maxCycles) st.maxCycles = cycles;
+  st.hist[bucket]++;
+}
+
+inline void PapilioMCPClass::statPrint(const char* kind, const char* name,
+                                       const McpCmdStats& st) {
+  uint8_t last = MCP_STATS_BUCKETS;
+  while (last > 1 && !st.hist[last - 1]) last--;   // Trailing empty buckets omitted
+  _out.printf("Z %s %s N=%lu MEAN=%lu MAX=%lu H=", kind, name, (unsigned long)st.count,
+              (unsigned long)(st.totalCycles / st.count), (unsigned long)st.maxCycles);
+  for (uint8_t i = 0; i < last; i++) {
+    _out.printf(i ? ",%lu" : "%lu", (unsigned long)st.hist[i]);
+  }
+  _out.println();
+}
+
+// Z | Z R
+inline void PapilioMCPClass::cmdStats(McpArgs& a) {
+  if (a.argc >= 2) {
+    if (toupper(a.action) == 'R') {
+      resetStats();
+      sendResponse("OK Z RESET");
+    } else {
+      sendResponse("ERR: Z [R]");
+    }
+    return;
+  }
+  
+  // Snapshot first so the report does not count itself
+  uint32_t in = _statBytesIn, out = _out.bytes;
+  _out.printf("Z SERIAL IN=%lu OUT=%lu DROP=%lu\n", (unsigned long)in, (unsigned long)out,
+              (unsigned long)_out.dropped);
+  _out.printf("Z SPI SKETCH=%lu/%lu DEBUG=%lu/%lu\n",
+              (unsigned long)_statSpiCount[MCP_BUS_SKETCH],
+              (unsigned long)_statSpiBytes[MCP_BUS_SKETCH],
+              (unsigned long)_statSpiCount[MCP_BUS_DEBUG],
+              (unsigned long)_statSpiBytes[MCP_BUS_DEBUG]);
+  for (uint8_t i = 0; i < 26; i++) {
+    if (!_statCmd[i].count) continue;
+    char name[2] = { (char)('A' + i), '\0' };
+    statPrint("CMD", name, _statCmd[i]);
+  }
+  for (uint8_t i = 0; i < MCP_STATS_OPS; i++) {
+    if (!_statOp[i].count) continue;
+    char name[3];
+    snprintf(name, sizeof(name), "%02X", i);
+    statPrint("OP", name, _statOp[i]);
+  }
+  _out.printf("OK Z CPU=%lu SPI=%lu T=%lu\n", (unsigned long)getCpuFrequencyMhz(),
+              (unsigned long)_spiHz, (unsigned long)(millis() - _statSince));
+}
+#endif
 
-// Global instance
-PapilioMCPClass PapilioMCP;
+// Global instance: one object however many translation units include this.
+// Before C++17 the name expands to a template static member, which has
+// external linkage; a per-unit static reference would break inline callers.
+#if __cplusplus >= 201703L
+inline PapilioMCPClass PapilioMCP;
+#else
+template <typename T> struct McpGlobal { static T instance; };
+template <typename T> T McpGlobal<T>::instance;
+#define PapilioMCP (McpGlobal<PapilioMCPClass>::instance)
+#endif
 
 #else // PAPILIO_MCP_ENABLED not defined
 
-// Stub class when MCP is disabled - compiles to nothing
+// Stub class when MCP is disabled: static no-ops, so calls compile to nothing
+#define MCP_BREAKPOINT(siteName) do {} while (0)
+
 class PapilioMCPClass {
 public:
-  void begin(SPIClass* spi = nullptr) {}
-  void update() {}
-  void wishboneWrite(uint16_t address, uint8_t data) {}
-  uint8_t wishboneRead(uint16_t address) { return 0; }
-  void enableJTAG() {}
-  void disableJTAG() {}
-  bool isJTAGEnabled() { return false; }
-  void pause() {}
-  void resume() {}
-  bool isPaused() { return false; }  // Never paused when MCP disabled
-  void breakpoint(const char* name = nullptr) {}  // No-op when disabled
-  void enableBreakpoints() {}
-  void disableBreakpoints() {}
-  bool areBreakpointsEnabled() { return false; }
+  static void begin(SPIClass* spi = nullptr) {}
+  static void update() {}
+  static bool beginTask(int core = 0, unsigned priority = 1, SPIClass* spi = nullptr) { return false; }
+  static bool isTaskRunning() { return false; }
+  static uint32_t busContention() { return 0; }
+  static void wishboneWrite(uint16_t address, uint8_t data) {}
+  static uint8_t wishboneRead(uint16_t address) { return 0; }
+  static void wishboneReadBurst(uint16_t address, uint8_t* buf, size_t len,
+                                McpBurstMode mode = MCP_BURST_INCREMENT) {}
+  static void wishboneWriteBurst(uint16_t address, const uint8_t* buf, size_t len,
+                                 McpBurstMode mode = MCP_BURST_INCREMENT) {}
+  static bool negotiateBurst(uint16_t scratchAddress) { return false; }
+  static void setBurstEnabled(bool enabled) {}
+  static bool isBurstEnabled() { return false; }
+  static bool calibrateSPI(uint16_t idAddress, uint8_t idLen = 4, int32_t scratchAddress = -1) { return false; }
+  static void setSPITiming(uint32_t clockHz, uint16_t readWaitNs, bool readyByte = false) {}
+  static uint32_t spiClock() { return 0; }
+  static uint16_t readWaitNs() { return 0; }
+  static bool isReadyByteEnabled() { return false; }
+  static bool cacheRange(uint16_t start, uint16_t len, McpCachePolicy policy) { return false; }
+  static uint16_t flushCache() { return 0; }
+  static void invalidateCache() {}
+  static void clearCache() {}
+  static bool snapshotSave(uint8_t slot) { return false; }
+  static bool snapshotRestore(uint8_t slot) { return false; }
+  static bool snapshotPersist(uint8_t slot) { return false; }
+  static bool snapshotLoad(uint8_t slot) { return false; }
+  static bool subscribe(const uint16_t* addrs, uint8_t count, uint32_t periodUs) { return false; }
+  static void unsubscribe() {}
+  static bool isSubscribed() { return false; }
+  static uint8_t watch(uint16_t address, uint8_t mask = 0xFF, int16_t value = -1, bool pause = false) { return 0; }
+  static bool unwatch(uint8_t id) { return false; }
+  static void clearWatches() {}
+  static bool setWatchPeriod(uint32_t periodUs) { return false; }
+  static void textWrite(uint8_t x, uint8_t y, const char* text, uint8_t attr) {}
+  static void textFill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, char c, uint8_t attr) {}
+  static void textRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, const uint8_t* cells) {}
+  static void textInvalidate() {}
+  static bool wishbonePoll(uint16_t address, uint8_t mask, uint8_t value,
+                           uint16_t timeoutMs, uint8_t* last = nullptr) { return false; }
+  static bool wishbonePollUs(uint16_t address, uint8_t mask, uint8_t value, uint32_t timeoutUs,
+                             uint32_t intervalUs = 0, uint8_t* last = nullptr,
+                             uint32_t* elapsedUs = nullptr) { return false; }
+  static void enableJTAG() {}
+  static void disableJTAG() {}
+  static bool isJTAGEnabled() { return false; }
+  static bool isJTAGProgramming() { return false; }
+  static void pause() {}
+  static void resume() {}
+  static bool isPaused() { return false; }  // Never paused when MCP disabled
+  static void waitWhilePaused() {}
+  static void breakpoint(const char* name = nullptr) {}  // No-op when disabled
+  static void enableBreakpoints() {}
+  static void disableBreakpoints() {}
+  static bool areBreakpointsEnabled() { return false; }
+  static void resetStats() {}
 };
 
-PapilioMCPClass PapilioMCP;
+// No storage: only static members are called through it
+static constexpr PapilioMCPClass PapilioMCP = {};
 
 #endif // PAPILIO_MCP_ENABLED
 